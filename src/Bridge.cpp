@@ -31,8 +31,8 @@
 float Bridge::_heightref;
 bool Bridge::_flatten;
 
-Bridge::Bridge(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref, bool flatten)
-  : Boundary3D(wkt, layername, attributes, pid) {
+Bridge::Bridge(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref, bool flatten)
+  : Boundary3D(p2, layername, attributes, pid) {
   _heightref = heightref;
   _flatten = flatten;
 }
@@ -66,18 +66,15 @@ bool Bridge::get_flatten() {
   return _flatten;
 }
 
-void Bridge::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "Bridge"; 
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Bridge::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"Bridge\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Bridge::get_citygml(std::wostream& of) {
+void Bridge::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<bri:Bridge gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -93,7 +90,7 @@ void Bridge::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Bridge::get_citygml_imgeo(std::wostream& of) {
+void Bridge::get_citygml_imgeo(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<bri:BridgeConstructionElement gml:id=\"" << this->get_id() << "\">";
   get_imgeo_object_info(of, this->get_id());
@@ -27,6 +27,7 @@
 */
 
 #include "Building.h"
+#include "checkpoint.h"
 
 //-- static variable
 float Building::_heightref_top;
@@ -36,8 +37,8 @@ bool Building::_building_include_floor;
 bool Building::_building_inner_walls;
 std::set<int> Building::_las_classes_roof;
 std::set<int> Building::_las_classes_ground;
-Building::Building(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base, bool building_triangulate, bool building_include_floor, bool building_inner_walls)
-  : Flat(wkt, layername, attributes, pid)
+Building::Building(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base, bool building_triangulate, bool building_include_floor, bool building_inner_walls)
+  : Flat(p2, layername, attributes, pid)
 {
   _heightref_top = heightref_top;
   _heightref_base = heightref_base;
@@ -295,6 +296,15 @@ void Building::cleanup_elevations() {
   Flat::cleanup_elevations();
 }
 
+void Building::write_checkpoint(std::ostream& of) {
+  Flat::write_checkpoint(of);
+  write_binary_vector(of, _zvaluesground);
+}
+
+bool Building::read_checkpoint(const char*& p, const char* end) {
+  return (Flat::read_checkpoint(p, end) && read_binary_vector(p, end, _zvaluesground));
+}
+
 void Building::get_csv(std::wostream& of) {
   of << this->get_id() << ";" <<
     std::setprecision(2) << std::fixed <<
@@ -306,42 +316,20 @@ std::string Building::get_mtl() {
   return "usemtl Building";
 }
 
-void Building::get_obj(std::unordered_map< std::string, unsigned long > &dPts, int lod, std::string mtl, std::string &fs) {
+void Building::get_obj(VertexPool& vertices, int lod, std::string mtl, std::string &fs) {
   if (lod == 1) {
-    TopoFeature::get_obj(dPts, mtl, fs);
+    TopoFeature::get_obj(vertices, mtl, fs);
   }
   else if (lod == 0) {
     fs += mtl;
     fs += "\n";
     float z = z_to_float(this->get_height_base());
     for (auto& t : _triangles) {
-      unsigned long a, b, c;
-      auto it = dPts.find(gen_key_bucket(&_vertices[t.v0].first, z));
-      if (it == dPts.end()) {
-        a = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v0].first, z)] = a;
-      }
-      else {
-        a = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v1].first, z));
-      if (it == dPts.end()) {
-        b = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v1].first, z)] = b;
-      }
-      else {
-        b = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v2].first, z));
-      if (it == dPts.end()) {
-        c = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v2].first, z)] = c;
-      }
-      else {
-        c = it->second;
-      }
+      unsigned long a = vertices.add(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), z);
+      unsigned long b = vertices.add(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), z);
+      unsigned long c = vertices.add(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), z);
       if ((a != b) && (a != c) && (b != c)) {
-        fs += "f "; fs += std::to_string(a); fs += " "; fs += std::to_string(b); fs += " "; fs += std::to_string(c); fs += "\n";
+        write_obj_face(fs, a, b, c);
       }
     }
   }
@@ -349,90 +337,70 @@ void Building::get_obj(std::unordered_map< std::string, unsigned long > &dPts, i
     fs += "usemtl BuildingFloor\n";
     float z = z_to_float(this->get_height_base());
     for (auto& t : _triangles) {
-      unsigned long a, b, c;
-      auto it = dPts.find(gen_key_bucket(&_vertices[t.v0].first, z));
-      if (it == dPts.end()) {
-        a = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v0].first, z)] = a;
-      }
-      else {
-        a = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v1].first, z));
-      if (it == dPts.end()) {
-        b = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v1].first, z)] = b;
-      }
-      else {
-        b = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v2].first, z));
-      if (it == dPts.end()) {
-        c = dPts.size() + 1;
-        dPts[gen_key_bucket(&_vertices[t.v2].first, z)] = c;
-      }
-      else {
-        c = it->second;
-      }
+      unsigned long a = vertices.add(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), z);
+      unsigned long b = vertices.add(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), z);
+      unsigned long c = vertices.add(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), z);
       //reverse orientation for floor polygon, a-c-b instead of a-b-c.
       if ((a != b) && (a != c) && (b != c)) {
-        fs += "f "; fs += std::to_string(a); fs += " "; fs += std::to_string(c); fs += " "; fs += std::to_string(b); fs += "\n";
+        write_obj_face(fs, a, c, b);
       }
     }
   }
 }
 
-void Building::get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long> &dPts) {
-  nlohmann::json b;
-  b["type"] = "Building";
-  b["attributes"];
-  get_cityjson_attributes(b, _attributes);
+void Building::get_glb(GLBMesh& mesh, int lod, std::string mtl) {
+  if (lod == 1) {
+    TopoFeature::get_glb(mesh, mtl);
+  }
+  else if (lod == 0) {
+    mesh.set_material(mtl);
+    float z = z_to_float(this->get_height_base());
+    for (auto& t : _triangles) {
+      unsigned long a = mesh.add_vertex(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), z);
+      unsigned long b = mesh.add_vertex(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), z);
+      unsigned long c = mesh.add_vertex(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), z);
+      mesh.add_triangle(a, b, c);
+    }
+  }
+  if (_building_include_floor) {
+    mesh.set_material("BuildingFloor");
+    float z = z_to_float(this->get_height_base());
+    for (auto& t : _triangles) {
+      unsigned long a = mesh.add_vertex(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), z);
+      unsigned long b = mesh.add_vertex(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), z);
+      unsigned long c = mesh.add_vertex(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), z);
+      //reverse orientation for floor polygon, a-c-b instead of a-b-c.
+      mesh.add_triangle(a, c, b);
+    }
+  }
+}
+
+void Building::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"Building\",\"attributes\":{";
+  if (get_cityjson_attributes(of, _attributes))
+    of << ",";
   float hbase = z_to_float(this->get_height_base());
   float h = z_to_float(this->get_height());
-  b["attributes"]["min-height-surface"] = hbase;
-  b["attributes"]["measuredHeight"] = h - hbase;
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts, "Solid");
-
+  of << "\"min-height-surface\":" << hbase << ",\"measuredHeight\":" << h - hbase;
+  of << "},\"geometry\":[{\"type\":\"Solid\",\"lod\":" << (lod_string ? "\"1\"" : "1") << ",\"boundaries\":[[";
+  bool first = true;
+  this->get_cityjson_surfaces(of, vertices, first);
   if (_building_include_floor) {
     for (auto& t : _triangles) {
-      unsigned long a, b, c;
-      auto it = dPts.find(gen_key_bucket(&_vertices[t.v0].first, hbase));
-      if (it == dPts.end()) {
-        a = dPts.size();
-        dPts[gen_key_bucket(&_vertices[t.v0].first, hbase)] = a;
-      }
-      else {
-        a = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v1].first, hbase));
-      if (it == dPts.end()) {
-        b = dPts.size();
-        dPts[gen_key_bucket(&_vertices[t.v1].first, hbase)] = b;
-      }
-      else {
-        b = it->second;
-      }
-      it = dPts.find(gen_key_bucket(&_vertices[t.v2].first, hbase));
-      if (it == dPts.end()) {
-        c = dPts.size();
-        dPts[gen_key_bucket(&_vertices[t.v2].first, hbase)] = c;
-      }
-      else {
-        c = it->second;
-      }
+      unsigned long a = vertices.add(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), hbase);
+      unsigned long b = vertices.add(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), hbase);
+      unsigned long c = vertices.add(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), hbase);
       //reverse orientation for floor polygon, a-c-b instead of a-b-c.
       if ((a != b) && (a != c) && (b != c)) {
-        g["boundaries"].at(0).push_back({{ a, c, b }});
+        of << (first ? "[[" : ",[[") << a << "," << c << "," << b << "]]";
+        first = false;
       }
     }
   }
-
-  b["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = b;
+  of << "]]}]}";
 }
 
-void Building::get_citygml(std::wostream& of) {
+void Building::get_citygml(TextWriter& of) {
   float h = z_to_float(this->get_height());
   float hbase = z_to_float(this->get_height_base());
   of << "<cityObjectMember>";
@@ -481,7 +449,7 @@ void Building::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Building::get_citygml_imgeo(std::wostream& of) {
+void Building::get_citygml_imgeo(TextWriter& of) {
   float h = z_to_float(this->get_height());
   float hbase = z_to_float(this->get_height_base());
   of << "<cityObjectMember>";
@@ -542,7 +510,7 @@ void Building::get_citygml_imgeo(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Building::get_imgeo_nummeraanduiding(std::wostream& of) {
+void Building::get_imgeo_nummeraanduiding(TextWriter& of) {
   std::string attribute;
   bool btekst, bplaatsingspunt, bhoek, blaagnr, bhoognr;
   std::string tekst, plaatsingspunt, hoek, laagnr, hoognr;
@@ -35,22 +35,25 @@
 
 class Building: public Flat {
 public:
-  Building(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base, bool building_triangulate, bool building_include_floor, bool building_inner_walls);
+  Building(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base, bool building_triangulate, bool building_include_floor, bool building_inner_walls);
   bool          lift();
   bool          add_elevation_point(Point2 &p, double z, float radius, int lasclass, bool within);
   void          construct_building_walls(const NodeColumn& nc);
-  void          get_obj(std::unordered_map< std::string, unsigned long > &dPts, int lod, std::string mtl, std::string &fs);
-  void          get_citygml(std::wostream& of);
-  void          get_citygml_imgeo(std::wostream& of);
-  void          get_imgeo_nummeraanduiding(std::wostream& of);
+  void          get_obj(VertexPool& vertices, int lod, std::string mtl, std::string &fs);
+  void          get_glb(GLBMesh& mesh, int lod, std::string mtl);
+  void          get_citygml(TextWriter& of);
+  void          get_citygml_imgeo(TextWriter& of);
+  void          get_imgeo_nummeraanduiding(TextWriter& of);
   void          get_csv(std::wostream& of);
-  void          get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long> &dPts);
+  void          get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string);
   std::string   get_all_z_values();
   std::string   get_mtl();
   bool          get_shape(OGRLayer* layer, bool writeAttributes, const AttributeMap& extraAttributes = AttributeMap());
   TopoClass     get_class();
   bool          is_hard();
   void          cleanup_elevations();
+  void          write_checkpoint(std::ostream& of);
+  bool          read_checkpoint(const char*& p, const char* end);
   int           get_height_base();
   int           get_height_ground_at_percentile(float percentile);
   int           get_height_roof_at_percentile(float percentile);
@@ -28,8 +28,8 @@
 
 #include "Forest.h"
 
-Forest::Forest(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer)
-  : TIN(wkt, layername, attributes, pid, simplification, simplification_tinsimp, innerbuffer) {}
+Forest::Forest(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer, TinSimpMethod simplification_tinsimp_method)
+  : TIN(p2, layername, attributes, pid, simplification, simplification_tinsimp, innerbuffer, simplification_tinsimp_method) {}
 
 TopoClass Forest::get_class() {
   return FOREST;
@@ -56,18 +56,15 @@ bool Forest::lift() {
   return true;
 }
 
-void Forest::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "PlantCover";
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Forest::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"PlantCover\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Forest::get_citygml(std::wostream& of) {
+void Forest::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<veg:PlantCover gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -83,7 +80,7 @@ void Forest::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Forest::get_citygml_imgeo(std::wostream& of) {
+void Forest::get_citygml_imgeo(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<veg:PlantCover gml:id=\"" << this->get_id() << "\">";
   get_imgeo_object_info(of, this->get_id());
@@ -27,6 +27,275 @@
 */
 
 #include "Map3d.h"
+#include "checkpoint.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem.hpp>
+#include <climits>
+#include <memory>
+#include <unordered_set>
+
+//-- records of the polygon cache, see Map3d::save_polygon_cache()
+struct PolygonCacheFeature {
+  std::uint64_t firstring;  //-- index in the ring offsets
+  std::uint32_t nrings;     //-- outer ring + inner rings
+  std::uint32_t layertype;  //-- strings are indices in the string table
+  std::uint32_t id;
+  std::uint32_t layername;
+  std::uint64_t firstattribute;
+  std::uint32_t nattributes;
+  std::uint32_t toplevel;
+};
+
+struct PolygonCacheAttribute {
+  std::uint32_t name;
+  std::int32_t  type;       //-- OGRFieldType
+  std::uint32_t value;
+  std::uint32_t padding;
+};
+
+//-- the outputs are serialised in chunks of features that are rendered in
+//-- parallel, each in its own buffer, and written in their order
+const std::size_t SERIALIZE_CHUNK = 64;
+
+//-- render(begin, end, slot, threadid) serialises the features [begin, end)
+//-- in one of the slots, emit(begin, end, slot) writes that slot. There are
+//-- at most 4 chunks per thread in memory.
+template <typename Slot, typename Render, typename Emit>
+void serialize_features(std::size_t n, int threads, Render render, Emit emit) {
+  std::size_t nchunks = (n + SERIALIZE_CHUNK - 1) / SERIALIZE_CHUNK;
+  std::vector<Slot> slots(std::max<std::size_t>(1, std::min<std::size_t>(nchunks, 4 * std::max(threads, 1))));
+  parallel_ordered(nchunks, threads, slots.size(), [&](std::size_t c, int threadid) {
+    render(c * SERIALIZE_CHUNK, std::min(n, (c + 1) * SERIALIZE_CHUNK), slots[c % slots.size()], threadid);
+  }, [&](std::size_t c) {
+    emit(c * SERIALIZE_CHUNK, std::min(n, (c + 1) * SERIALIZE_CHUNK), slots[c % slots.size()]);
+  });
+}
+
+//-- a chunk of CityGML: the text of its features and where each one ends
+struct GMLChunk {
+  TextWriter               text;
+  std::vector<std::size_t> ends;
+
+  void clear() {
+    text.clear();
+    ends.clear();
+    text << std::setprecision(3) << std::fixed;
+  }
+
+  void add(TopoFeature* f, bool imgeo) {
+    if (imgeo)
+      f->get_citygml_imgeo(text);
+    else
+      f->get_citygml(text);
+    ends.push_back(text.str().size());
+  }
+
+  void render(const std::vector<TopoFeature*>& features, std::size_t begin, std::size_t end, bool imgeo) {
+    clear();
+    for (std::size_t i = begin; i < end; i++)
+      add(features[i], imgeo);
+  }
+
+  std::string feature(std::size_t i) const {
+    std::size_t start = (i == 0) ? 0 : ends[i - 1];
+    return text.str().substr(start, ends[i] - start);
+  }
+
+  //-- the feature i on its line
+  void write(TextWriter& of, std::size_t i) const {
+    std::size_t start = (i == 0) ? 0 : ends[i - 1];
+    of.write(text.str().data() + start, ends[i] - start);
+    of << "\n";
+  }
+};
+
+//-- a chunk of OBJ: the faces and, for the first pass, the vertices in the
+//-- order they are first used
+struct OBJChunk {
+  VertexPool  vertices;
+  std::string fs;
+};
+
+//-- the header of an OBJ file and its vertices
+void write_obj_vertices(std::ostream& of, const VertexPool& vertices) {
+  of << "mtllib ./3dfier.mtl\n";
+  for (auto& v : vertices.vertices()) {
+    of << "v ";
+    write_fixed(of, v[0], 3);
+    of << " ";
+    write_fixed(of, v[1], 3);
+    of << " ";
+    write_fixed(of, v[2], 2);
+    of << "\n";
+  }
+}
+
+//-- a tile of the 3D Tiles quadtree: a square of the extent, the features of
+//-- its subtree (bbox centre in the square) and the box of its subtree
+struct TilesetNode {
+  int                       level, col, row;
+  double                    x, y, size;
+  std::vector<TopoFeature*> features;
+  std::size_t               parent;
+  std::vector<std::size_t>  children;
+  bool                      content;
+  bool                      bounded;
+  double                    min[3], max[3];
+
+  TilesetNode() : level(0), col(0), row(0), x(0), y(0), size(0), parent(0), content(false), bounded(false) {}
+
+  //-- 0 for the leaves, which have all their features
+  double geometric_error() const {
+    return children.empty() ? 0.0 : size / 32.0;
+  }
+
+  std::string uri() const {
+    return "tiles/" + std::to_string(level) + "_" + std::to_string(col) + "_" + std::to_string(row) + ".glb";
+  }
+};
+
+void write_tileset_node(std::ostream& of, const std::vector<TilesetNode>& nodes, std::size_t i) {
+  const TilesetNode& n = nodes[i];
+  of << "{\"boundingVolume\":{\"box\":[";
+  of << (n.min[0] + n.max[0]) / 2 << "," << (n.min[1] + n.max[1]) / 2 << "," << (n.min[2] + n.max[2]) / 2 << ",";
+  of << (n.max[0] - n.min[0]) / 2 << ",0,0,0," << (n.max[1] - n.min[1]) / 2 << ",0,0,0," << std::max((n.max[2] - n.min[2]) / 2, 0.5) << "]}";
+  of << ",\"geometricError\":" << n.geometric_error() << ",\"refine\":\"REPLACE\"";
+  if (n.content)
+    of << ",\"content\":{\"uri\":\"" << n.uri() << "\"}";
+  bool first = true;
+  for (auto& c : n.children) {
+    if (!nodes[c].bounded)
+      continue;
+    of << (first ? ",\"children\":[" : ",");
+    write_tileset_node(of, nodes, c);
+    first = false;
+  }
+  if (!first)
+    of << "]";
+  of << "}";
+}
+
+//-- the root transform of a tileset, from the coordinates of the input (in
+//-- that EPSG) to ECEF: a local frame at the origin, with its x and y axes
+//-- along the projected axes there (central differences over 100 m, so the
+//-- meridian convergence and the scale of the projection are in) and its z
+//-- axis along the normal of the ellipsoid. The heights are taken as they are.
+bool get_ecef_transform(int epsg, const double origin[3], double transform[16]) {
+  OGRSpatialReference src, dst;
+  if (src.importFromEPSG(epsg) != OGRERR_NONE || dst.importFromEPSG(4979) != OGRERR_NONE) {
+    std::cerr << "ERROR: unknown EPSG code " << epsg << std::endl;
+    return false;
+  }
+#if GDAL_VERSION_MAJOR >= 3
+  src.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+  dst.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#endif
+  OGRCoordinateTransformation* ct = OGRCreateCoordinateTransformation(&src, &dst);
+  if (ct == NULL) {
+    std::cerr << "ERROR: cannot transform EPSG:" << epsg << " to EPSG:4979.\n";
+    return false;
+  }
+  const double d = 100.0;
+  double x[5] = { origin[0], origin[0] - d, origin[0] + d, origin[0], origin[0] };
+  double y[5] = { origin[1], origin[1], origin[1], origin[1] - d, origin[1] + d };
+  double z[5] = { origin[2], origin[2], origin[2], origin[2], origin[2] };
+  bool transformed = (ct->Transform(5, x, y, z) != 0);
+  OCTDestroyCoordinateTransformation((OGRCoordinateTransformationH)ct);
+  if (!transformed) {
+    std::cerr << "ERROR: cannot transform the origin of the tileset to EPSG:4979.\n";
+    return false;
+  }
+  //-- WGS84 geodetic to ECEF
+  const double a = 6378137.0;
+  const double f = 1 / 298.257223563;
+  const double e2 = f * (2 - f);
+  const double deg = 3.14159265358979323846 / 180.0;
+  double ecef[5][3];
+  for (int i = 0; i < 5; i++) {
+    double lon = x[i] * deg;
+    double lat = y[i] * deg;
+    double n = a / std::sqrt(1 - e2 * std::sin(lat) * std::sin(lat));
+    ecef[i][0] = (n + z[i]) * std::cos(lat) * std::cos(lon);
+    ecef[i][1] = (n + z[i]) * std::cos(lat) * std::sin(lon);
+    ecef[i][2] = (n * (1 - e2) + z[i]) * std::sin(lat);
+  }
+  double lon = x[0] * deg;
+  double lat = y[0] * deg;
+  double up[3] = { std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat) };
+  //-- column-major, the origin of the input goes to ecef[0]
+  for (int j = 0; j < 3; j++) {
+    transform[j] = (ecef[2][j] - ecef[1][j]) / (2 * d);
+    transform[4 + j] = (ecef[4][j] - ecef[3][j]) / (2 * d);
+    transform[8 + j] = up[j];
+  }
+  for (int j = 0; j < 3; j++)
+    transform[12 + j] = ecef[0][j] - transform[j] * origin[0] - transform[4 + j] * origin[1] - transform[8 + j] * origin[2];
+  transform[3] = transform[7] = transform[11] = 0.0;
+  transform[15] = 1.0;
+  return true;
+}
+
+//-- an OBJ file being written. The vertices are deduplicated on their
+//-- quantised coordinates in a VertexPool, and the faces that refer to them
+//-- are spilled to a temporary file next to it, as the vertices come first
+//-- in the file. Only the unique vertices stay in memory.
+struct OBJOutput {
+  std::string   filename;
+  std::ofstream of;
+  std::ofstream faces;
+  VertexPool    vertices;
+
+  bool open(const std::string& name) {
+    filename = name;
+    of.open(filename);
+    faces.open(filename + ".faces", std::ios::out | std::ios::binary);
+    return of.is_open() && faces.is_open();
+  }
+
+  void add_faces(const std::string& fs) {
+    faces.write(fs.data(), fs.size());
+  }
+
+  bool close() {
+    faces.close();
+    bool written = !faces.fail();
+    write_obj_vertices(of, vertices);
+    std::ifstream in(filename + ".faces", std::ios::in | std::ios::binary);
+    if (in.peek() != std::ifstream::traits_type::eof())
+      of << in.rdbuf();
+    in.close();
+    of << "\n";
+    of.close();
+    boost::filesystem::remove(filename + ".faces");
+    return written && !of.fail();
+  }
+};
+
+//-- a feature id or a layer name used in a filename, with the characters that
+//-- are path separators or not allowed in a filename (on Windows) replaced by _
+std::string get_safe_filename(std::string name) {
+  for (auto& c : name) {
+    if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|')
+      c = '_';
+  }
+  return name;
+}
+
+//-- a chunk of Map3d::get_outputs(), one buffer per format
+struct OutputChunk {
+  GMLChunk           citygml;
+  GMLChunk           imgeo;
+  std::ostringstream cityjson;
+  std::ostringstream cityjsonseq;
+  std::string        obj;
+};
+
+//-- the first pass of Map3d::get_outputs(), the vertices of CityJSON and OBJ
+struct OutputVerticesChunk {
+  VertexPool cityjson;
+  OBJChunk   obj;
+};
 
 Map3d::Map3d() {
   OGRRegisterAll();
@@ -40,6 +309,8 @@ Map3d::Map3d() {
   _forest_simplification = 0;
   _terrain_simplification_tinsimp = 0.0;
   _forest_simplification_tinsimp = 0.0;
+  _terrain_simplification_tinsimp_method = TINSIMP_GREEDY;
+  _forest_simplification_tinsimp_method = TINSIMP_GREEDY;
   _terrain_innerbuffer = 0.0;
   _forest_innerbuffer = 0.0;
   _water_heightref = 0.1;
@@ -51,11 +322,30 @@ Map3d::Map3d() {
   _radius_vertex_elevation = 1.0;
   _building_radius_vertex_elevation = 3.0;
   _threshold_jump_edges = 50;
+  _threads = 1;
+  _cdt_split_points = 0;
+  _cdt_split_area = 0.0;
+  _fast_triangulation = true;
+  _cdt_validation = true;
+  _lift_gap_interpolation = false;
+  _checkpoint_save = false;
+  _polygon_cache = "";
+  _cityjson_transform = false;
+  _obj_tile_size = 0;
+  _tileset_max_features = 1000;
+  _tileset_epsg = 7415;
   _requestedExtent = Box2(Point2(0, 0), Point2(0, 0));
+  _tilingExtent = Box2(Point2(0, 0), Point2(0, 0));
+  _tile_size = 0.0;
+  _tile_col = 0;
+  _tile_row = 0;
   _bbox = Box2(Point2(999999, 999999), Point2(-999999, -999999));
 }
 
 Map3d::~Map3d() {
+  //-- with tiling one Map3d is created per tile, so free the features
+  for (auto& f : _lsFeatures)
+    delete f;
   _lsFeatures.clear();
 }
 
@@ -111,6 +401,14 @@ void Map3d::set_forest_simplification_tinsimp(double tinsimp_threshold){
   _forest_simplification_tinsimp = tinsimp_threshold;
 }
 
+void Map3d::set_terrain_simplification_tinsimp_method(TinSimpMethod method) {
+  _terrain_simplification_tinsimp_method = method;
+}
+
+void Map3d::set_forest_simplification_tinsimp_method(TinSimpMethod method) {
+  _forest_simplification_tinsimp_method = method;
+}
+
 void Map3d::set_terrain_innerbuffer(float innerbuffer) {
   _terrain_innerbuffer = innerbuffer;
 }
@@ -147,10 +445,65 @@ void Map3d::set_bridge_flatten(bool flatten) {
   _bridge_flatten = flatten;
 }
 
+void Map3d::set_threads(int threads) {
+  _threads = threads;
+}
+
+void Map3d::set_cdt_split_points(int maxpoints) {
+  _cdt_split_points = maxpoints;
+}
+
+void Map3d::set_cdt_split_area(double maxarea) {
+  _cdt_split_area = maxarea;
+}
+
+void Map3d::set_fast_triangulation(bool fast) {
+  _fast_triangulation = fast;
+}
+
+void Map3d::set_cdt_validation(bool validate) {
+  _cdt_validation = validate;
+}
+
+void Map3d::set_lift_gap_interpolation(bool interpolate) {
+  _lift_gap_interpolation = interpolate;
+}
+
+void Map3d::set_checkpoint_save(bool save) {
+  _checkpoint_save = save;
+}
+
+void Map3d::set_polygon_cache(std::string filename) {
+  _polygon_cache = filename;
+}
+
+void Map3d::set_cityjson_transform(bool transform) {
+  _cityjson_transform = transform;
+}
+
+void Map3d::set_obj_tile_size(double size) {
+  _obj_tile_size = size;
+}
+
+void Map3d::set_tileset_max_features(int max) {
+  _tileset_max_features = max;
+}
+
+void Map3d::set_tileset_epsg(int epsg) {
+  _tileset_epsg = epsg;
+}
+
 void Map3d::set_requested_extent(double xmin, double ymin, double xmax, double ymax) {
   _requestedExtent = Box2(Point2(xmin, ymin), Point2(xmax, ymax));
 }
 
+void Map3d::set_tile(const Box2& tiling, double tilesize, int col, int row) {
+  _tilingExtent = tiling;
+  _tile_size = tilesize;
+  _tile_col = col;
+  _tile_row = row;
+}
+
 Box2 Map3d::get_bbox() {
   return _bbox;
 }
@@ -162,100 +515,301 @@ liblas::Bounds<double> Map3d::get_bounds() {
 }
 
 bool Map3d::get_cityjson(std::string filename) {
-  std::cout << "CityJSON" << std::endl;
-  nlohmann::json j;
-  j["type"] = "CityJSON";
-  j["version"] = "0.8";
-  j["metadata"] = {};
-  double b[] = {bg::get<bg::min_corner, 0>(_bbox),
-                bg::get<bg::min_corner, 1>(_bbox), 
-                0,
-                bg::get<bg::max_corner, 0>(_bbox),
-                bg::get<bg::max_corner, 1>(_bbox), 
-                0};
-  j["metadata"]["geographicalExtent"] = b;
-  std::unordered_map< std::string, unsigned long > dPts;
-  for (auto& f : _lsFeatures) {
-    f->get_cityjson(j, dPts);
-  }
-  //-- vertices
-  std::vector<std::string> thepts;
-  thepts.resize(dPts.size());
-  for (auto& p : dPts)
-    thepts[p.second] = p.first;
-  dPts.clear();
-  for (auto& p : thepts) {
-    std::vector<std::string> c;
-    boost::split(c, p, boost::is_any_of(" "));
-    j["vertices"].push_back({std::stod(c[0], NULL), std::stod(c[1], NULL), std::stod(c[2], NULL) });
-  }
-  std::ofstream o(filename);
-  // o << j.dump(2) << std::endl;      
-  o << j.dump() << std::endl;      
-  return true;
+  return get_outputs({ std::make_pair(std::string("CityJSON"), filename) });
+}
+
+bool Map3d::get_cityjsonseq(std::string filename) {
+  return get_outputs({ std::make_pair(std::string("CityJSONSeq"), filename) });
+}
+
+//-- writes the outputs (format, filename) in CityGML, CityGML-IMGeo, CityJSON,
+//-- CityJSONSeq and OBJ in one pass over the features: every feature of a chunk
+//-- is rendered for all the formats in turn, while its geometry and attributes
+//-- are in the cache, and each format is appended to its file in order (see
+//-- serialize_features()). CityJSON and OBJ number their vertices in a first
+//-- pass when there are several threads, as in get_obj().
+bool Map3d::get_outputs(const std::vector<std::pair<std::string, std::string> >& outputs) {
+  std::unique_ptr<TextWriter> citygml, imgeo;
+  std::unique_ptr<std::ofstream> cityjson, cityjsonseq;
+  std::unique_ptr<OBJOutput> obj;
+  for (auto& output : outputs) {
+    bool opened = false;
+    if (output.first == "CityGML") {
+      citygml.reset(new TextWriter(output.second));
+      opened = citygml->is_open();
+    }
+    else if (output.first == "CityGML-IMGeo") {
+      imgeo.reset(new TextWriter(output.second));
+      opened = imgeo->is_open();
+    }
+    else if (output.first == "CityJSON") {
+      cityjson.reset(new std::ofstream(output.second, std::ios::out | std::ios::binary));
+      opened = cityjson->is_open();
+    }
+    else if (output.first == "CityJSONSeq") {
+      cityjsonseq.reset(new std::ofstream(output.second, std::ios::out | std::ios::binary));
+      opened = cityjsonseq->is_open();
+    }
+    else if (output.first == "OBJ") {
+      obj.reset(new OBJOutput());
+      opened = obj->open(output.second);
+    }
+    else {
+      std::cerr << "ERROR: " << output.first << " output is not written by Map3d::get_outputs()" << std::endl;
+      return false;
+    }
+    if (!opened) {
+      std::cerr << "ERROR: could not write " << output.second << std::endl;
+      return false;
+    }
+  }
+
+  double translate[3];
+  get_cityjson_translate(translate);
+  long long offset[] = { (long long)translate[0] * 1000, (long long)translate[1] * 1000, 0 };
+  if (citygml)
+    create_citygml_header(*citygml);
+  if (imgeo)
+    create_citygml_imgeo_header(*imgeo);
+  if (cityjson)
+    create_cityjson_header(*cityjson, translate);
+  if (cityjsonseq)
+    create_cityjsonseq_header(*cityjsonseq, translate);
+
+  VertexPool vertices;
+  if (_threads > 1 && (cityjson || obj)) {
+    serialize_features<OutputVerticesChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, OutputVerticesChunk& chunk, int) {
+      std::ostream discard(nullptr);
+      chunk.cityjson.clear();
+      chunk.obj.vertices.clear();
+      for (std::size_t i = begin; i < end; i++) {
+        if (cityjson)
+          _lsFeatures[i]->get_cityjson(discard, chunk.cityjson, false);
+        if (obj) {
+          chunk.obj.fs.clear();
+          get_obj_feature(_lsFeatures[i], chunk.obj.vertices, chunk.obj.fs, true);
+        }
+      }
+    }, [&](std::size_t, std::size_t, OutputVerticesChunk& chunk) {
+      for (auto& v : chunk.cityjson.vertices())
+        vertices.add(v);
+      if (obj) {
+        for (auto& v : chunk.obj.vertices.vertices())
+          obj->vertices.add(v);
+      }
+    });
+  }
+  serialize_features<OutputChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, OutputChunk& chunk, int) {
+    chunk.citygml.clear();
+    chunk.imgeo.clear();
+    chunk.cityjson.str("");
+    chunk.cityjsonseq.str("");
+    chunk.obj.clear();
+    VertexPool featurevertices;
+    for (std::size_t i = begin; i < end; i++) {
+      TopoFeature* f = _lsFeatures[i];
+      if (citygml)
+        chunk.citygml.add(f, false);
+      if (imgeo)
+        chunk.imgeo.add(f, true);
+      if (cityjson) {
+        if (i > 0)
+          chunk.cityjson << ",";
+        write_json_string(chunk.cityjson, f->get_id());
+        chunk.cityjson << ":";
+        f->get_cityjson(chunk.cityjson, vertices, false);
+      }
+      if (cityjsonseq)
+        get_cityjsonseq_feature(chunk.cityjsonseq, f, featurevertices, offset);
+      if (obj)
+        get_obj_feature(f, obj->vertices, chunk.obj, true);
+    }
+  }, [&](std::size_t begin, std::size_t end, OutputChunk& chunk) {
+    for (std::size_t i = 0; i < end - begin; i++) {
+      if (citygml)
+        chunk.citygml.write(*citygml, i);
+      if (imgeo)
+        chunk.imgeo.write(*imgeo, i);
+    }
+    if (cityjson)
+      *cityjson << chunk.cityjson.rdbuf();
+    if (cityjsonseq)
+      *cityjsonseq << chunk.cityjsonseq.rdbuf();
+    if (obj)
+      obj->add_faces(chunk.obj);
+  });
+
+  bool written = true;
+  if (citygml)
+    *citygml << "</CityModel>\n";
+  if (imgeo)
+    *imgeo << "</CityModel>\n";
+  if (cityjson) {
+    create_cityjson_footer(*cityjson, vertices, translate);
+    cityjson->close();
+    written = written && !cityjson->fail();
+  }
+  if (cityjsonseq) {
+    cityjsonseq->close();
+    written = written && !cityjsonseq->fail();
+  }
+  if (obj) {
+    written = obj->close() && written;
+  }
+  if (!written) {
+    std::cerr << "ERROR: could not write the outputs" << std::endl;
+  }
+  return written;
+}
+
+//-- the CityObjects are written one by one as they are generated, the vertices
+//-- are collected (deduplicated) in a VertexPool and written at the end. With
+//-- the transform the vertices are written as integers (mm for x and y, cm for
+//-- z) relative to the lower-left corner, in metres, of the tiling extent or
+//-- of the polygons; every tile then uses the same transform.
+void Map3d::create_cityjson_header(std::ostream& of, const double translate[3]) {
+  of << "{\"type\":\"CityJSON\",\"version\":\"0.8\",";
+  if (_cityjson_transform) {
+    of << std::setprecision(17) << "\"transform\":{\"scale\":[0.001,0.001,0.01],\"translate\":["
+      << translate[0] << "," << translate[1] << "," << translate[2] << "]},";
+  }
+  of << std::setprecision(6) << "\"CityObjects\":{";
+}
+
+void Map3d::create_cityjson_footer(std::ostream& of, const VertexPool& vertices, const double translate[3]) {
+  long long offset[] = { (long long)translate[0] * 1000, (long long)translate[1] * 1000, 0 };
+  VertexPool::Vertex vmin = { { LLONG_MAX, LLONG_MAX, LLONG_MAX } };
+  VertexPool::Vertex vmax = { { LLONG_MIN, LLONG_MIN, LLONG_MIN } };
+  of << "},\"vertices\":[";
+  bool first = true;
+  for (auto& v : vertices.vertices()) {
+    of << (first ? "[" : ",[");
+    if (_cityjson_transform) {
+      of << v[0] - offset[0] << "," << v[1] - offset[1] << "," << v[2];
+    }
+    else {
+      write_fixed(of, v[0], 3);
+      of << ",";
+      write_fixed(of, v[1], 3);
+      of << ",";
+      write_fixed(of, v[2], 2);
+    }
+    of << "]";
+    for (int i = 0; i < 3; i++) {
+      vmin[i] = std::min(vmin[i], v[i]);
+      vmax[i] = std::max(vmax[i], v[i]);
+    }
+    first = false;
+  }
+  of << "],\"metadata\":{\"geographicalExtent\":[";
+  if (vertices.size() > 0) {
+    write_fixed(of, vmin[0], 3); of << ",";
+    write_fixed(of, vmin[1], 3); of << ",";
+    write_fixed(of, vmin[2], 2); of << ",";
+    write_fixed(of, vmax[0], 3); of << ",";
+    write_fixed(of, vmax[1], 3); of << ",";
+    write_fixed(of, vmax[2], 2);
+  }
+  else {
+    of << std::setprecision(17) << bg::get<bg::min_corner, 0>(_bbox) << "," << bg::get<bg::min_corner, 1>(_bbox) << ",0,"
+      << bg::get<bg::max_corner, 0>(_bbox) << "," << bg::get<bg::max_corner, 1>(_bbox) << ",0";
+  }
+  of << "]}}" << std::endl;
 }
 
-void Map3d::get_citygml(std::wostream& of) {
-  create_citygml_header(of);
-  for (auto& f : _lsFeatures) {
-    f->get_citygml(of);
-    of << "\n";
+//-- CityJSON Text Sequences: a CityJSON header on the first line, then one
+//-- CityJSONFeature per line with its own vertices (always with the transform),
+//-- so the memory used does not grow with the number of features and the file
+//-- can be split on the lines. The header has no geographicalExtent, the heights
+//-- are only known once all the features are written.
+void Map3d::create_cityjsonseq_header(std::ostream& of, const double translate[3]) {
+  of << std::setprecision(17);
+  of << "{\"type\":\"CityJSON\",\"version\":\"1.1\",\"transform\":{\"scale\":[0.001,0.001,0.01],\"translate\":["
+    << translate[0] << "," << translate[1] << "," << translate[2] << "]},\"CityObjects\":{},\"vertices\":[]}\n";
+  of << std::setprecision(6);
+}
+
+void Map3d::get_cityjsonseq_feature(std::ostream& of, TopoFeature* f, VertexPool& vertices, const long long offset[3]) {
+  vertices.clear();
+  of << "{\"type\":\"CityJSONFeature\",\"id\":";
+  write_json_string(of, f->get_id());
+  of << ",\"CityObjects\":{";
+  write_json_string(of, f->get_id());
+  of << ":";
+  f->get_cityjson(of, vertices, true);
+  of << "},\"vertices\":[";
+  bool first = true;
+  for (auto& v : vertices.vertices()) {
+    of << (first ? "[" : ",[") << v[0] - offset[0] << "," << v[1] - offset[1] << "," << v[2] << "]";
+    first = false;
   }
-  of << "</CityModel>\n";
+  of << "]}\n";
 }
 
-void Map3d::get_citygml_multifile(std::string ofname) {
-  std::unordered_map<std::string, std::wofstream*> ofs;
+//-- the translate of the CityJSON transform, the floored lower-left corner of the
+//-- tiling extent (the same for all tiles) or of the polygons
+void Map3d::get_cityjson_translate(double translate[3]) {
+  const Box2& origin = (_tile_size > 0) ? _tilingExtent : _bbox;
+  translate[0] = std::floor(bg::get<bg::min_corner, 0>(origin));
+  translate[1] = std::floor(bg::get<bg::min_corner, 1>(origin));
+  translate[2] = 0.0;
+}
 
-  for (auto& f : _lsFeatures) {
-    std::string filename = ofname + f->get_layername() + ".gml";
-    if (ofs.find(filename) == ofs.end()) {
-      std::wofstream* of = new std::wofstream();
-      of->open(filename);
-      ofs.emplace(filename, of);
-      create_citygml_header(*ofs[filename]);
+bool Map3d::get_citygml(std::string filename) {
+  return get_outputs({ std::make_pair(std::string("CityGML"), filename) });
+}
+
+void Map3d::get_citygml_multifile(std::string ofname) {
+  std::unordered_map<std::string, TextWriter*> ofs;
+
+  serialize_features<GMLChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, GMLChunk& chunk, int) {
+    chunk.render(_lsFeatures, begin, end, false);
+  }, [&](std::size_t begin, std::size_t end, GMLChunk& chunk) {
+    for (std::size_t i = begin; i < end; i++) {
+      std::string filename = ofname + _lsFeatures[i]->get_layername() + ".gml";
+      if (ofs.find(filename) == ofs.end()) {
+        TextWriter* of = new TextWriter(filename);
+        ofs.emplace(filename, of);
+        create_citygml_header(*of);
+      }
+      chunk.write(*ofs[filename], i - begin);
     }
-    f->get_citygml(*ofs[filename]);
-    *ofs[filename] << "\n";
-  }
+  });
   for (auto it = ofs.begin(); it != ofs.end(); it++) {
-    std::wofstream& of = *(it->second);
-    of << "</CityModel>\n";
-    of.close();
+    TextWriter* of = it->second;
+    *of << "</CityModel>\n";
+    delete of;
   }
 }
 
-void Map3d::get_citygml_imgeo(std::wostream& of) {
-  create_citygml_imgeo_header(of);
-  for (auto& f : _lsFeatures) {
-    f->get_citygml_imgeo(of);
-    of << "\n";
-  }
-  of << "</CityModel>\n";
+bool Map3d::get_citygml_imgeo(std::string filename) {
+  return get_outputs({ std::make_pair(std::string("CityGML-IMGeo"), filename) });
 }
 
 void Map3d::get_citygml_imgeo_multifile(std::string ofname) {
-  std::unordered_map<std::string, std::wofstream*> ofs;
-
-  for (auto& f : _lsFeatures) {
-    std::string filename = ofname + f->get_layername() + ".gml";
-    if (ofs.find(filename) == ofs.end()) {
-      std::wofstream* of = new std::wofstream();
-      of->open(filename);
-      ofs.emplace(filename, of);
-      create_citygml_imgeo_header(*ofs[filename]);
+  std::unordered_map<std::string, TextWriter*> ofs;
+
+  serialize_features<GMLChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, GMLChunk& chunk, int) {
+    chunk.render(_lsFeatures, begin, end, true);
+  }, [&](std::size_t begin, std::size_t end, GMLChunk& chunk) {
+    for (std::size_t i = begin; i < end; i++) {
+      std::string filename = ofname + _lsFeatures[i]->get_layername() + ".gml";
+      if (ofs.find(filename) == ofs.end()) {
+        TextWriter* of = new TextWriter(filename);
+        ofs.emplace(filename, of);
+        create_citygml_imgeo_header(*of);
+      }
+      chunk.write(*ofs[filename], i - begin);
     }
-    f->get_citygml_imgeo(*ofs[filename]);
-    *ofs[filename] << "\n";
-  }
+  });
   for (auto it = ofs.begin(); it != ofs.end(); it++) {
-    std::wofstream& of = *(it->second);
-    of << "</CityModel>\n";
-    of.close();
+    TextWriter* of = it->second;
+    *of << "</CityModel>\n";
+    delete of;
   }
 }
 
-void Map3d::create_citygml_header(std::wostream& of) {
+void Map3d::create_citygml_header(TextWriter& of) {
     of << std::setprecision(3) << std::fixed;
     get_xml_header(of);
     get_citygml_namespaces(of);
@@ -273,7 +827,7 @@ void Map3d::create_citygml_header(std::wostream& of) {
     of << "</gml:boundedBy>\n";
 }
 
-void Map3d::create_citygml_imgeo_header(std::wostream& of) {
+void Map3d::create_citygml_imgeo_header(TextWriter& of) {
     of << std::setprecision(3) << std::fixed;
     get_xml_header(of);
     get_citygml_imgeo_namespaces(of);
@@ -341,64 +895,299 @@ void Map3d::get_csv_buildings_multiple_heights(std::wostream& of) {
   }
 }
 
-void Map3d::get_obj_per_feature(std::wostream& of) {
-  std::unordered_map< std::string, unsigned long > dPts;
-  std::string fs;
-  
-  for (auto& p : _lsFeatures) {
-    fs += "o "; fs += p->get_id(); fs += "\n";
-    if (p->get_class() == BUILDING) {
-      Building* b = dynamic_cast<Building*>(p);
-      b->get_obj(dPts, _building_lod, b->get_mtl(), fs);
-    }
-    else {
-      p->get_obj(dPts, p->get_mtl(), fs);
+bool Map3d::get_obj_per_feature(std::string filename) {
+  return get_outputs({ std::make_pair(std::string("OBJ"), filename) });
+}
+
+bool Map3d::get_obj_per_class(std::string filename) {
+  std::vector<TopoFeature*> features;
+  for (int c = 0; c < 6; c++) {
+    for (auto& p : _lsFeatures) {
+      if (p->get_class() == c)
+        features.push_back(p);
     }
   }
+  return get_obj(filename, features, false);
+}
 
-  //-- sort the points in the map: simpler to copy to a vector
-  std::vector<std::string> thepts;
-  thepts.resize(dPts.size());
-  for (auto& p : dPts)
-    thepts[p.second - 1] = p.first;
-  dPts.clear();
-
-  of << "mtllib ./3dfier.mtl" << "\n";
-  for (auto& p : thepts) {
-    of << "v " << p << "\n";
+//-- the faces are rendered in parallel once all the vertices are numbered: in
+//-- a first pass each chunk numbers its vertices in its own pool and they are
+//-- added in order to the shared one, which gives the numbers of a serial run
+//-- and leaves that pool unchanged (and thus shared safely) in the second pass
+bool Map3d::get_obj(std::string filename, const std::vector<TopoFeature*>& features, bool ids) {
+  OBJOutput obj;
+  if (!obj.open(filename)) {
+    std::cerr << "ERROR: could not write " << filename << std::endl;
+    return false;
+  }
+  if (_threads > 1) {
+    serialize_features<OBJChunk>(features.size(), _threads, [&](std::size_t begin, std::size_t end, OBJChunk& chunk, int) {
+      chunk.vertices.clear();
+      for (std::size_t i = begin; i < end; i++) {
+        chunk.fs.clear();
+        get_obj_feature(features[i], chunk.vertices, chunk.fs, ids);
+      }
+    }, [&](std::size_t, std::size_t, OBJChunk& chunk) {
+      for (auto& v : chunk.vertices.vertices())
+        obj.vertices.add(v);
+    });
+  }
+  serialize_features<OBJChunk>(features.size(), _threads, [&](std::size_t begin, std::size_t end, OBJChunk& chunk, int) {
+    chunk.fs.clear();
+    for (std::size_t i = begin; i < end; i++)
+      get_obj_feature(features[i], obj.vertices, chunk.fs, ids);
+  }, [&](std::size_t, std::size_t, OBJChunk& chunk) {
+    obj.add_faces(chunk.fs);
+  });
+  if (!obj.close()) {
+    std::cerr << "ERROR: could not write " << filename << std::endl;
+    return false;
   }
-  of << fs << std::endl;
+  return true;
 }
 
-void Map3d::get_obj_per_class(std::wostream& of) {
-  std::unordered_map< std::string, unsigned long > dPts;
-  std::string fs;
-  for (int c = 0; c < 6; c++) {
-    for (auto& p : _lsFeatures) {
-      if (p->get_class() == c) {
-        if (p->get_class() == BUILDING) {
-          Building* b = dynamic_cast<Building*>(p);
-          b->get_obj(dPts, _building_lod, b->get_mtl(), fs);
-        }
-        else {
-          p->get_obj(dPts, p->get_mtl(), fs);
-        }
+//-- OBJ split in files that each have their own vertices, as with the splitobj
+//-- tools: one file per feature, named with its id (see get_safe_filename()),
+//-- or one per layer. Each file is an OBJOutput, its faces are spilled as they
+//-- are generated. With
+//-- obj_tile_size the layers are cut further in square tiles, a feature going
+//-- in the tile of the centre of its bbox (_col_row, counted from the lower-left
+//-- corner of the tiling extent or of the polygons). The files are written in
+//-- parallel, the features of a file in their order.
+bool Map3d::get_obj_multifile(std::string ofname, bool perfeature) {
+  std::vector< std::pair< std::string, std::vector<TopoFeature*> > > files;
+  std::unordered_map<std::string, std::size_t> fileindex;
+  double translate[3];
+  get_cityjson_translate(translate);
+  for (auto& f : _lsFeatures) {
+    std::string filename = ofname;
+    if (perfeature) {
+      filename += get_safe_filename(f->get_id());
+    }
+    else {
+      filename += get_safe_filename(f->get_layername());
+      if (_obj_tile_size > 0) {
+        Point2 centre;
+        bg::centroid(f->get_bbox2d(), centre);
+        filename += "_" + std::to_string(int(std::floor((centre.x() - translate[0]) / _obj_tile_size)));
+        filename += "_" + std::to_string(int(std::floor((centre.y() - translate[1]) / _obj_tile_size)));
       }
     }
+    filename += ".obj";
+    auto it = fileindex.find(filename);
+    if (it == fileindex.end()) {
+      it = fileindex.emplace(filename, files.size()).first;
+      files.push_back(std::make_pair(filename, std::vector<TopoFeature*>()));
+    }
+    files[it->second].second.push_back(f);
+  }
+
+  std::atomic<bool> written(true);
+  parallel_for(files.size(), _threads, [&](std::size_t i, int) {
+    OBJOutput obj;
+    bool opened = obj.open(files[i].first);
+    std::string fs;
+    for (auto& f : files[i].second) {
+      if (!opened)
+        break;
+      fs.clear();
+      get_obj_feature(f, obj.vertices, fs, true);
+      obj.add_faces(fs);
+    }
+    if (!obj.close() || !opened) {
+      std::cerr << "ERROR: could not write " << files[i].first << std::endl;
+      written = false;
+    }
+  });
+  return written;
+}
+
+void Map3d::get_obj_feature(TopoFeature* p, VertexPool& vertices, std::string& fs, bool ids) {
+  if (ids) {
+    fs += "o "; fs += p->get_id(); fs += "\n";
+  }
+  if (p->get_class() == BUILDING) {
+    Building* b = dynamic_cast<Building*>(p);
+    b->get_obj(vertices, _building_lod, b->get_mtl(), fs);
+  }
+  else {
+    p->get_obj(vertices, p->get_mtl(), fs);
+  }
+}
+
+//-- the features are numbered in their order, as in the CityJSON; the chunks
+//-- are meshed in parallel and appended in order
+bool Map3d::get_glb(std::string filename) {
+  double origin[3];
+  get_cityjson_translate(origin);
+  GLBMesh mesh;
+  mesh.set_origin(origin);
+  serialize_features<GLBMesh>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, GLBMesh& chunk, int) {
+    chunk.clear();
+    chunk.set_origin(origin);
+    for (std::size_t i = begin; i < end; i++) {
+      chunk.begin_feature(i);
+      get_glb_feature(_lsFeatures[i], chunk);
+    }
+  }, [&](std::size_t begin, std::size_t end, GLBMesh& chunk) {
+    mesh.append(chunk);
+    for (std::size_t i = begin; i < end; i++)
+      mesh.add_feature(_lsFeatures[i]->get_id(), _lsFeatures[i]->get_layername());
+  });
+  if (!mesh.write(filename)) {
+    std::cerr << "ERROR: could not write " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//-- 3D Tiles: tileset.json and a GLB per tile in dirname/tiles. The extent is
+//-- cut in a quadtree until the tiles have at most tileset_max_features
+//-- features (by the centre of their bbox). The leaves have their features as
+//-- in the GLB output; the coarser tiles, replaced by their children, have the
+//-- features of their subtree larger than their geometric error (1/32 of their
+//-- size), with Terrain and Forest simplified by the tinsimp up to that error.
+//-- The tiles and their boxes are in the CRS of the input; with tileset_epsg the
+//-- root gets the transform from that CRS, at the centre of the extent, to ECEF
+//-- (see get_ecef_transform()). The tiles are written in parallel.
+bool Map3d::get_3dtiles(std::string dirname) {
+  try {
+    boost::filesystem::create_directories(boost::filesystem::path(dirname) / "tiles");
+  }
+  catch (boost::filesystem::filesystem_error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return false;
+  }
+  double origin[3];
+  get_cityjson_translate(origin);
+  std::vector<TilesetNode> nodes(1);
+  nodes[0].x = origin[0];
+  nodes[0].y = origin[1];
+  nodes[0].size = std::max(std::ceil(bg::get<bg::max_corner, 0>(_bbox) - origin[0]), std::ceil(bg::get<bg::max_corner, 1>(_bbox) - origin[1]));
+  nodes[0].size = std::max(nodes[0].size, 1.0);
+  nodes[0].features = _lsFeatures;
+  for (std::size_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].features.size() <= std::size_t(_tileset_max_features) || nodes[i].level >= 20)
+      continue;
+    std::vector<int> quadrants;
+    std::size_t quadrant[4] = { 0, 0, 0, 0 };
+    for (auto& f : nodes[i].features) {
+      Point2 centre;
+      bg::centroid(f->get_bbox2d(), centre);
+      int q = (centre.x() >= nodes[i].x + nodes[i].size / 2 ? 1 : 0) + (centre.y() >= nodes[i].y + nodes[i].size / 2 ? 2 : 0);
+      quadrants.push_back(q);
+      quadrant[q] = 1;
+    }
+    for (int q = 0; q < 4; q++) {
+      if (quadrant[q] == 0)
+        continue;
+      TilesetNode child;
+      child.level = nodes[i].level + 1;
+      child.col = 2 * nodes[i].col + (q & 1);
+      child.row = 2 * nodes[i].row + (q >> 1);
+      child.size = nodes[i].size / 2;
+      child.x = nodes[i].x + (q & 1) * child.size;
+      child.y = nodes[i].y + (q >> 1) * child.size;
+      child.parent = i;
+      quadrant[q] = nodes.size();
+      nodes[i].children.push_back(nodes.size());
+      nodes.push_back(child);
+    }
+    for (std::size_t j = 0; j < quadrants.size(); j++)
+      nodes[quadrant[quadrants[j]]].features.push_back(nodes[i].features[j]);
+  }
+
+  std::atomic<bool> written(true);
+  parallel_for(nodes.size(), _threads, [&](std::size_t i, int) {
+    TilesetNode& n = nodes[i];
+    double error = n.geometric_error();
+    double tileorigin[3] = { n.x, n.y, 0.0 };
+    GLBMesh mesh;
+    mesh.set_origin(tileorigin);
+    for (auto& f : n.features) {
+      const Box2& b = f->get_bbox2d();
+      if (error > 0 && bg::distance(b.min_corner(), b.max_corner()) < error)
+        continue;
+      mesh.begin_feature(mesh.get_number_features());
+      std::string mtl = f->get_mtl();
+      mtl = mtl.substr(mtl.find(' ') + 1);
+      if (error > 0 && (f->get_class() == TERRAIN || f->get_class() == FOREST))
+        dynamic_cast<TIN*>(f)->get_glb_simplified(mesh, mtl, error);
+      else
+        get_glb_feature(f, mesh);
+      mesh.add_feature(f->get_id(), f->get_layername());
+    }
+    n.content = (mesh.get_number_triangles() > 0);
+    n.bounded = n.content && mesh.get_bounds(n.min, n.max);
+    if (n.content && !mesh.write(dirname + "/" + n.uri())) {
+      std::cerr << "ERROR: could not write " << dirname + "/" + n.uri() << std::endl;
+      written = false;
+    }
+  });
+
+  //-- the boxes of the subtrees, the children coming after their parent
+  for (std::size_t i = nodes.size(); i-- > 1;) {
+    if (!nodes[i].bounded)
+      continue;
+    TilesetNode& p = nodes[nodes[i].parent];
+    for (int j = 0; j < 3; j++) {
+      p.min[j] = p.bounded ? std::min(p.min[j], nodes[i].min[j]) : nodes[i].min[j];
+      p.max[j] = p.bounded ? std::max(p.max[j], nodes[i].max[j]) : nodes[i].max[j];
+    }
+    p.bounded = true;
+  }
+  TilesetNode& root = nodes[0];
+  if (!root.bounded) {
+    root.min[0] = root.x;
+    root.min[1] = root.y;
+    root.max[0] = root.x + root.size;
+    root.max[1] = root.y + root.size;
+    root.min[2] = root.max[2] = 0.0;
+  }
+
+  double transform[16];
+  double transformorigin[3] = { root.x + root.size / 2, root.y + root.size / 2, 0.0 };
+  if (_tileset_epsg > 0 && !get_ecef_transform(_tileset_epsg, transformorigin, transform)) {
+    return false;
   }
 
-  //-- sort the points in the map: simpler to copy to a vector
-  std::vector<std::string> thepts;
-  thepts.resize(dPts.size());
-  for (auto& p : dPts)
-    thepts[p.second - 1] = p.first;
-  dPts.clear();
+  std::string filename = dirname + "/tileset.json";
+  std::ofstream of(filename);
+  of << std::fixed << std::setprecision(3);
+  of << "{\"asset\":{\"version\":\"1.1\",\"generator\":\"3dfier\"}";
+  of << ",\"geometricError\":" << root.size / 16.0 << ",\"root\":";
+  std::ostringstream rootnode;
+  rootnode << std::fixed << std::setprecision(3);
+  write_tileset_node(rootnode, nodes, 0);
+  if (_tileset_epsg > 0) {
+    std::string node = rootnode.str();
+    of << node.substr(0, node.size() - 1) << std::setprecision(12) << ",\"transform\":[";
+    for (int i = 0; i < 16; i++)
+      of << (i > 0 ? "," : "") << transform[i];
+    of << "]}";
+  }
+  else {
+    of << rootnode.str();
+  }
+  of << "}\n";
+  of.close();
+  if (of.fail()) {
+    std::cerr << "ERROR: could not write " << filename << std::endl;
+    return false;
+  }
+  return written;
+}
 
-  of << "mtllib ./3dfier.mtl\n";
-  for (auto& p : thepts) {
-    of << "v " << p << std::endl;
+void Map3d::get_glb_feature(TopoFeature* p, GLBMesh& mesh) {
+  std::string mtl = p->get_mtl();
+  mtl = mtl.substr(mtl.find(' ') + 1);
+  if (p->get_class() == BUILDING) {
+    Building* b = dynamic_cast<Building*>(p);
+    b->get_glb(mesh, _building_lod, mtl);
+  }
+  else {
+    p->get_glb(mesh, mtl);
   }
-  of << fs << std::endl;
 }
 
 bool Map3d::get_pdok_output(std::string filename) {
@@ -448,33 +1237,38 @@ bool Map3d::get_pdok_output(std::string filename) {
   }
 
   // create and write features to layers
+  //-- the CityGML of the features is rendered in parallel, the database is written in order
   int i = 1;
-  for (auto& f : _lsFeatures) {
-    std::string layername = f->get_layername();
-    //Add additional attribute describing CityGML of feature
-    std::wstring_convert<codecvt<wchar_t, char, std::mbstate_t>>converter;
-    std::wstringstream ss;
-    ss << std::fixed << std::setprecision(3);
-    f->get_citygml_imgeo(ss);
-    std::string gmlAttribute = converter.to_bytes(ss.str());
-    ss.clear();
-    AttributeMap extraAttribute = AttributeMap();
-    extraAttribute["xml"] = std::make_pair(OFTString, gmlAttribute);
-
-    if (!f->get_shape(layers[layername], true, extraAttribute)) {
-      return false;
-    }
-    if (i % 1000 == 0) {
-      if (dataSource->CommitTransaction() != OGRERR_NONE) {
-        std::cerr << "Writing to database failed.\n";
-        return false;
-      }  
-      if (dataSource->StartTransaction() != OGRERR_NONE) {
-        std::cerr << "Starting database transaction failed.\n";
-        return false;
+  std::atomic<bool> written(true);
+  serialize_features<GMLChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, GMLChunk& chunk, int) {
+    if (written)
+      chunk.render(_lsFeatures, begin, end, true);
+  }, [&](std::size_t begin, std::size_t end, GMLChunk& chunk) {
+    for (std::size_t fi = begin; fi < end && written; fi++) {
+      TopoFeature* f = _lsFeatures[fi];
+      std::string layername = f->get_layername();
+      //Add additional attribute describing CityGML of feature
+      AttributeMap extraAttribute = AttributeMap();
+      extraAttribute["xml"] = std::make_pair(OFTString, chunk.feature(fi - begin));
+
+      if (!f->get_shape(layers[layername], true, extraAttribute)) {
+        written = false;
+      }
+      else if (i % 1000 == 0) {
+        if (dataSource->CommitTransaction() != OGRERR_NONE) {
+          std::cerr << "Writing to database failed.\n";
+          written = false;
+        }
+        else if (dataSource->StartTransaction() != OGRERR_NONE) {
+          std::cerr << "Starting database transaction failed.\n";
+          written = false;
+        }
       }
+      i++;
     }
-    i++;
+  });
+  if (!written) {
+    return false;
   }
   if (dataSource->CommitTransaction() != OGRERR_NONE) {
     std::cerr << "Writing to database failed.\n";
@@ -533,33 +1327,38 @@ bool Map3d::get_pdok_citygml_output(std::string filename) {
   }
 
   // create and write features to layers
+  //-- the CityGML of the features is rendered in parallel, the database is written in order
   int i = 1;
-  for (auto& f : _lsFeatures) {
-    std::string layername = f->get_layername();
-    //Add additional attribute describing CityGML of feature
-    std::wstring_convert<codecvt<wchar_t, char, std::mbstate_t>>converter;
-    std::wstringstream ss;
-    ss << std::fixed << std::setprecision(3);
-    f->get_citygml(ss);
-    std::string gmlAttribute = converter.to_bytes(ss.str());
-    ss.clear();
-    AttributeMap extraAttribute = AttributeMap();
-    extraAttribute["xml"] = std::make_pair(OFTString, gmlAttribute);
-
-    if (!f->get_shape(layers[layername], true, extraAttribute)) {
-      return false;
-    }
-    if (i % 1000 == 0) {
-      if (dataSource->CommitTransaction() != OGRERR_NONE) {
-        std::cerr << "Writing to database failed.\n";
-        return false;
-      }  
-      if (dataSource->StartTransaction() != OGRERR_NONE) {
-        std::cerr << "Starting database transaction failed.\n";
-        return false;
+  std::atomic<bool> written(true);
+  serialize_features<GMLChunk>(_lsFeatures.size(), _threads, [&](std::size_t begin, std::size_t end, GMLChunk& chunk, int) {
+    if (written)
+      chunk.render(_lsFeatures, begin, end, false);
+  }, [&](std::size_t begin, std::size_t end, GMLChunk& chunk) {
+    for (std::size_t fi = begin; fi < end && written; fi++) {
+      TopoFeature* f = _lsFeatures[fi];
+      std::string layername = f->get_layername();
+      //Add additional attribute describing CityGML of feature
+      AttributeMap extraAttribute = AttributeMap();
+      extraAttribute["xml"] = std::make_pair(OFTString, chunk.feature(fi - begin));
+
+      if (!f->get_shape(layers[layername], true, extraAttribute)) {
+        written = false;
       }
+      else if (i % 1000 == 0) {
+        if (dataSource->CommitTransaction() != OGRERR_NONE) {
+          std::cerr << "Writing to database failed.\n";
+          written = false;
+        }
+        else if (dataSource->StartTransaction() != OGRERR_NONE) {
+          std::cerr << "Starting database transaction failed.\n";
+          written = false;
+        }
+      }
+      i++;
     }
-    i++;
+  });
+  if (!written) {
+    return false;
   }
   if (dataSource->CommitTransaction() != OGRERR_NONE) {
     std::cerr << "Writing to database failed.\n";
@@ -728,6 +1527,55 @@ bool Map3d::get_shapefile2d(std::string filename) {
   return true;
 }
 
+//-- a feature belongs to exactly one tile: the one containing the centre of its bbox.
+//-- Tiles are half-open [min, max), and centres outside the tiling extent are clamped
+//-- to the border tiles so features crossing the extent are not lost.
+bool Map3d::is_in_tile(TopoFeature* f) {
+  Box2 b = f->get_bbox2d();
+  double cx = (bg::get<bg::min_corner, 0>(b) + bg::get<bg::max_corner, 0>(b)) / 2;
+  double cy = (bg::get<bg::min_corner, 1>(b) + bg::get<bg::max_corner, 1>(b)) / 2;
+  double minx = bg::get<bg::min_corner, 0>(_tilingExtent);
+  double miny = bg::get<bg::min_corner, 1>(_tilingExtent);
+  int ncols = std::max(1, int(std::ceil((bg::get<bg::max_corner, 0>(_tilingExtent) - minx) / _tile_size)));
+  int nrows = std::max(1, int(std::ceil((bg::get<bg::max_corner, 1>(_tilingExtent) - miny) / _tile_size)));
+  int col = std::min(std::max(int(std::floor((cx - minx) / _tile_size)), 0), ncols - 1);
+  int row = std::min(std::max(int(std::floor((cy - miny) / _tile_size)), 0), nrows - 1);
+  return (col == _tile_col && row == _tile_row);
+}
+
+//-- drop the features of the tile buffer, they were only loaded so that the
+//-- features of the tile are lifted and stitched as in a run without tiling
+unsigned long Map3d::remove_features_outside_tile() {
+  if (_tile_size <= 0) {
+    return 0;
+  }
+  std::vector<TopoFeature*> keep;
+  std::unordered_set<TopoFeature*> removed;
+  for (auto& f : _lsFeatures) {
+    if (is_in_tile(f)) {
+      keep.push_back(f);
+    }
+    else {
+      removed.insert(f);
+    }
+  }
+  //-- the features kept must not point to the buffer features any more
+  if (!removed.empty()) {
+    for (auto& f : keep) {
+      std::vector<TopoFeature*>* adj = f->get_adjacent_features();
+      adj->erase(std::remove_if(adj->begin(), adj->end(), [&](TopoFeature* fadj) { return removed.count(fadj) > 0; }), adj->end());
+    }
+  }
+  for (auto& f : removed) {
+    delete f;
+  }
+  _lsFeatures.swap(keep);
+  for (auto& rtree : _rtrees) {
+    rtree.clear();
+  }
+  return (unsigned long)removed.size();
+}
+
 unsigned long Map3d::get_num_polygons() {
   return _lsFeatures.size();
 }
@@ -736,93 +1584,376 @@ const std::vector<TopoFeature*>& Map3d::get_polygons3d() {
   return _lsFeatures;
 }
 
+//-- the LAS classes of the point are tested per class of feature, so only the
+//-- rtrees of the classes that accept the point are queried
+bool Map3d::is_las_class_allowed(TopoClass tc, int c, bool& within) {
+  static const AllowedLASTopo lastopo[] = { LAS_BUILDING_ROOF, LAS_WATER, LAS_BRIDGE, LAS_ROAD, LAS_TERRAIN, LAS_FOREST, LAS_SEPARATION };
+  within = false;
+  if (tc == BUILDING) {
+    return true;
+  }
+  if (_las_classes_allowed_within[lastopo[tc]].count(c) > 0) {
+    within = true;
+    return true;
+  }
+  return (_las_classes_allowed[lastopo[tc]].empty() || _las_classes_allowed[lastopo[tc]].count(c) > 0);
+}
+
 void Map3d::add_elevation_point(liblas::Point const& laspt) {
+  //-- only process last returns; 
+  //-- although perhaps not smart for vegetation/forest in the future
+  //-- TODO: always ignore the non-last-return points?
+  if (laspt.GetReturnNumber() != laspt.GetNumberOfReturns())
+    return;
+
+  int c = laspt.GetClassification().GetClass();
+  Point2 p(laspt.GetX(), laspt.GetY());
   std::vector<PairIndexed> re;
-  Point2 minp(laspt.GetX() - _radius_vertex_elevation, laspt.GetY() - _radius_vertex_elevation);
-  Point2 maxp(laspt.GetX() + _radius_vertex_elevation, laspt.GetY() + _radius_vertex_elevation);
-  Box2 querybox(minp, maxp);
-  _rtree.query(bgi::intersects(querybox), std::back_inserter(re));
-  minp = Point2(laspt.GetX() - _building_radius_vertex_elevation, laspt.GetY() - _building_radius_vertex_elevation);
-  maxp = Point2(laspt.GetX() + _building_radius_vertex_elevation, laspt.GetY() + _building_radius_vertex_elevation);
-  querybox = Box2(minp, maxp);
-  _rtree_buildings.query(bgi::intersects(querybox), std::back_inserter(re));
-
-  for (auto& v : re) {
-    TopoFeature* f = v.second;
-    float radius = _radius_vertex_elevation;
-    //-- only process last returns; 
-    //-- although perhaps not smart for vegetation/forest in the future
-    //-- TODO: always ignore the non-last-return points?
-    if (laspt.GetReturnNumber() != laspt.GetNumberOfReturns()) 
+  for (int tc = 0; tc < NUM_TOPOCLASS; tc++) {
+    bool bWithin;
+    if (_rtrees[tc].empty() || !is_las_class_allowed(TopoClass(tc), c, bWithin)) {
       continue;
+    }
+    float radius = (tc == BUILDING) ? _building_radius_vertex_elevation : _radius_vertex_elevation;
+    Box2 querybox(Point2(laspt.GetX() - radius, laspt.GetY() - radius), Point2(laspt.GetX() + radius, laspt.GetY() + radius));
+    re.clear();
+    _rtrees[tc].query(bgi::intersects(querybox), std::back_inserter(re));
+    for (auto& v : re) {
+      v.second->add_elevation_point(p, laspt.GetZ(), radius, c, bWithin);
+    }
+  }
+}
+
+//-- the settings used to assign the points to the features, a checkpoint
+//-- can only be used with the same ones
+void Map3d::write_checkpoint_settings(std::ostream& of) {
+  write_binary(of, _radius_vertex_elevation);
+  write_binary(of, _building_radius_vertex_elevation);
+  for (int i = 0; i < NUM_ALLOWEDLASTOPO; i++) {
+    write_binary_vector(of, std::vector<int>(_las_classes_allowed[i].begin(), _las_classes_allowed[i].end()));
+    write_binary_vector(of, std::vector<int>(_las_classes_allowed_within[i].begin(), _las_classes_allowed_within[i].end()));
+  }
+}
+
+bool Map3d::read_checkpoint_settings(const char*& p, const char* end) {
+  float radius, building_radius;
+  if (!read_binary(p, end, radius) || !read_binary(p, end, building_radius))
+    return false;
+  bool same = (radius == _radius_vertex_elevation && building_radius == _building_radius_vertex_elevation);
+  for (int i = 0; i < NUM_ALLOWEDLASTOPO; i++) {
+    std::vector<int> allowed, within;
+    if (!read_binary_vector(p, end, allowed) || !read_binary_vector(p, end, within))
+      return false;
+    if (allowed != std::vector<int>(_las_classes_allowed[i].begin(), _las_classes_allowed[i].end()) ||
+      within != std::vector<int>(_las_classes_allowed_within[i].begin(), _las_classes_allowed_within[i].end()))
+      same = false;
+  }
+  if (!same) {
+    std::cerr << "ERROR: the radius or LAS classes differ from the ones used to create the checkpoint.\n";
+  }
+  return same;
+}
 
-    int c = laspt.GetClassification().GetClass();
-    bool bInsert = false;
-    bool bWithin = false;
-    if (f->get_class() == BUILDING) {
-      bInsert = true;
-      radius = _building_radius_vertex_elevation;
+void Map3d::thin_lidar_points() {
+  for (auto& f : _lsFeatures) {
+    if (f->get_class() == TERRAIN || f->get_class() == FOREST) {
+      dynamic_cast<TIN*>(f)->thin_lidar_points();
     }
-    else if (f->get_class() == TERRAIN) {
-      if (_las_classes_allowed[LAS_TERRAIN].empty() || _las_classes_allowed[LAS_TERRAIN].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_TERRAIN].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
-      }
+  }
+}
+
+//-- snapshot of the points assigned to the features, so that the lifting can be
+//-- redone with other lifting_options without reading the LAS files again.
+//-- The TIN points are kept unthinned (see TIN::set_defer_thinning) so the
+//-- simplification and innerbuffer can be changed as well.
+void Map3d::save_checkpoint(std::ostream& of) {
+  of.write("3DFCKPT1", 8);
+  write_checkpoint_settings(of);
+  write_binary(of, std::uint64_t(_lsFeatures.size()));
+  for (auto& f : _lsFeatures) {
+    write_binary_string(of, f->get_id());
+    write_binary(of, std::int32_t(f->get_class()));
+    f->write_checkpoint(of);
+  }
+}
+
+bool Map3d::save_checkpoint(std::string filename) {
+  std::clog << "Writing checkpoint: " << filename << std::endl;
+  std::ofstream of(filename, std::ios::out | std::ios::binary);
+  if (of.good()) {
+    save_checkpoint(of);
+    of.close();
+  }
+  if (of.fail()) {
+    std::cerr << "ERROR: could not write checkpoint " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//-- the polygons must be the same as when the checkpoint was written, they are
+//-- read again (in the same order) and matched on their id and class
+bool Map3d::load_checkpoint(const char* p, const char* end) {
+  if (end - p < 8 || std::memcmp(p, "3DFCKPT1", 8) != 0) {
+    std::cerr << "ERROR: not a 3dfier checkpoint.\n";
+    return false;
+  }
+  p += 8;
+  if (!read_checkpoint_settings(p, end))
+    return false;
+  std::uint64_t n;
+  if (!read_binary(p, end, n) || n != _lsFeatures.size()) {
+    std::cerr << "ERROR: checkpoint was made with other polygons.\n";
+    return false;
+  }
+  for (auto& f : _lsFeatures) {
+    std::string id;
+    std::int32_t c;
+    if (!read_binary_string(p, end, id) || !read_binary(p, end, c) ||
+      id != f->get_id() || c != std::int32_t(f->get_class()) || !f->read_checkpoint(p, end)) {
+      std::cerr << "ERROR: checkpoint does not match polygon " << f->get_id() << ".\n";
+      return false;
     }
-    else if (f->get_class() == FOREST) {
-      if (_las_classes_allowed[LAS_FOREST].empty() || _las_classes_allowed[LAS_FOREST].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_FOREST].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
-      }
+  }
+  thin_lidar_points();
+  return true;
+}
+
+bool Map3d::load_checkpoint(std::string filename) {
+  std::clog << "Reading checkpoint: " << filename << std::endl;
+  try {
+    namespace bip = boost::interprocess;
+    bip::file_mapping file(filename.c_str(), bip::read_only);
+    bip::mapped_region region(file, bip::read_only);
+    const char* p = static_cast<const char*>(region.get_address());
+    return load_checkpoint(p, p + region.get_size());
+  }
+  catch (std::exception& e) {
+    std::cerr << "ERROR: could not read checkpoint " << filename << ": " << e.what() << std::endl;
+    return false;
+  }
+}
+
+//-- once the checkpoints are written, thin the points kept for them
+void Map3d::thin_checkpoint_lidar_points() {
+  if (_checkpoint_save) {
+    TIN::set_defer_thinning(false);
+    thin_lidar_points();
+    _checkpoint_save = false;
+  }
+}
+
+//-- identifies the polygons that are read: a cache is only used when the files
+//-- (name, size and modification time), the fields, the layers with their lifting
+//-- classes and the requested extent are the same
+std::string Map3d::get_polygon_cache_fingerprint(std::vector<PolygonFile>& files) {
+  std::ostringstream ss;
+  ss << std::setprecision(17);
+  ss << bg::get<bg::min_corner, 0>(_requestedExtent) << " " << bg::get<bg::min_corner, 1>(_requestedExtent) << " "
+    << bg::get<bg::max_corner, 0>(_requestedExtent) << " " << bg::get<bg::max_corner, 1>(_requestedExtent) << "\n";
+  for (auto& file : files) {
+    if (strncmp(file.filename.c_str(), "PG:", strlen("PG:")) == 0) {
+      std::clog << "Polygon cache is not used with a PostgreSQL database.\n";
+      return "";
     }
-    else if (f->get_class() == ROAD) {
-      if (_las_classes_allowed[LAS_ROAD].empty() || _las_classes_allowed[LAS_ROAD].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_ROAD].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
-      }
+    boost::system::error_code ec;
+    boost::uintmax_t size = boost::filesystem::file_size(file.filename, ec);
+    if (ec) {
+      return "";
     }
-    else if (f->get_class() == WATER) {
-      if (_las_classes_allowed[LAS_WATER].empty() || _las_classes_allowed[LAS_WATER].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_WATER].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
-      }
+    std::time_t mtime = boost::filesystem::last_write_time(file.filename, ec);
+    if (ec) {
+      return "";
     }
-    else if (f->get_class() == SEPARATION) {
-      if (_las_classes_allowed[LAS_SEPARATION].empty() || _las_classes_allowed[LAS_SEPARATION].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_SEPARATION].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
-      }
+    ss << file.filename << "\n" << size << " " << mtime << "\n";
+    ss << file.idfield << "\n" << file.heightfield << "\n" << file.handle_multiple_heights << "\n";
+    for (auto& l : file.layers) {
+      ss << l.first << "\t" << l.second << "\n";
     }
-    else if (f->get_class() == BRIDGE) {
-      if (_las_classes_allowed[LAS_BRIDGE].empty() || _las_classes_allowed[LAS_BRIDGE].count(c) > 0) {
-        bInsert = true;
-      }
-      if (_las_classes_allowed_within[LAS_BRIDGE].count(c) > 0) {
-        bInsert = true;
-        bWithin = true;
+  }
+  return ss.str();
+}
+
+//-- the polygons as read (after unique and correct), in flat arrays that are
+//-- used in place when the file is memory-mapped: the features, the ring
+//-- offsets in the points, the xy of the points, the attributes and a table of
+//-- the (deduplicated) strings. The features keep the order in which they were
+//-- read, so checkpoints remain valid.
+void Map3d::write_polygon_cache(std::ostream& of, const std::string& fingerprint) {
+  static const char* layertypes[] = { "Building", "Water", "Bridge/Overpass", "Road", "Terrain", "Forest", "Separation" };
+  std::vector<PolygonCacheFeature> features;
+  std::vector<std::uint64_t> rings(1, 0);
+  std::vector<double> points;
+  std::vector<PolygonCacheAttribute> attributes;
+  std::vector<std::uint64_t> stringoffsets(1, 0);
+  std::vector<char> strings;
+  std::unordered_map<std::string, std::uint32_t> stringids;
+  auto add_string = [&](const std::string& str) {
+    auto it = stringids.find(str);
+    if (it != stringids.end())
+      return it->second;
+    std::uint32_t sid = std::uint32_t(stringids.size());
+    stringids[str] = sid;
+    strings.insert(strings.end(), str.begin(), str.end());
+    stringoffsets.push_back(strings.size());
+    return sid;
+  };
+  auto add_ring = [&](const Ring2& ring) {
+    for (auto& pt : ring) {
+      points.push_back(pt.x());
+      points.push_back(pt.y());
+    }
+    rings.push_back(points.size() / 2);
+  };
+
+  features.reserve(_lsFeatures.size());
+  for (auto& f : _lsFeatures) {
+    PolygonCacheFeature cf;
+    Polygon2* p2 = f->get_Polygon2();
+    cf.firstring = rings.size() - 1;
+    cf.nrings = std::uint32_t(p2->inners().size() + 1);
+    add_ring(p2->outer());
+    for (auto& iring : p2->inners()) {
+      add_ring(iring);
+    }
+    cf.layertype = add_string(layertypes[f->get_class()]);
+    cf.id = add_string(f->get_id());
+    cf.layername = add_string(f->get_layername());
+    cf.firstattribute = attributes.size();
+    cf.nattributes = std::uint32_t(f->get_attributes().size());
+    for (auto& attr : f->get_attributes()) {
+      PolygonCacheAttribute ca;
+      ca.name = add_string(attr.first);
+      ca.type = std::int32_t(attr.second.first);
+      ca.value = add_string(attr.second.second);
+      ca.padding = 0;
+      attributes.push_back(ca);
+    }
+    cf.toplevel = f->get_top_level() ? 1 : 0;
+    features.push_back(cf);
+  }
+
+  of.write("3DFPOLY2", 8);
+  write_binary_string(of, fingerprint);
+  write_binary_array(of, features);
+  write_binary_array(of, rings);
+  write_binary_array(of, points);
+  write_binary_array(of, attributes);
+  write_binary_array(of, stringoffsets);
+  write_binary_array(of, strings);
+}
+
+bool Map3d::save_polygon_cache(std::string filename, const std::string& fingerprint) {
+  std::clog << "Writing polygon cache: " << filename << std::endl;
+  std::ofstream of(filename, std::ios::out | std::ios::binary);
+  if (of.good()) {
+    write_polygon_cache(of, fingerprint);
+    of.close();
+  }
+  if (of.fail()) {
+    std::cerr << "ERROR: could not write polygon cache " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//-- the polygons already read, kept in memory to build the features again
+//-- with other lifting_options
+void Map3d::save_polygon_cache(std::ostream& of) {
+  write_polygon_cache(of, "");
+}
+
+bool Map3d::load_polygon_cache(const char* p, const char* end) {
+  return read_polygon_cache(p, end, "", "in memory");
+}
+
+bool Map3d::load_polygon_cache(std::string filename, const std::string& fingerprint) {
+  if (!boost::filesystem::exists(filename)) {
+    return false;
+  }
+  try {
+    namespace bip = boost::interprocess;
+    bip::file_mapping file(filename.c_str(), bip::read_only);
+    bip::mapped_region region(file, bip::read_only);
+    const char* begin = static_cast<const char*>(region.get_address());
+    return read_polygon_cache(begin, begin + region.get_size(), fingerprint, filename);
+  }
+  catch (std::exception& e) {
+    std::cerr << "ERROR: could not read polygon cache " << filename << ": " << e.what() << std::endl;
+    return false;
+  }
+}
+
+bool Map3d::read_polygon_cache(const char* begin, const char* end, const std::string& fingerprint, const std::string& filename) {
+  const char* p = begin;
+  std::string cachedfingerprint;
+  if (end - p < 8 || std::memcmp(p, "3DFPOLY2", 8) != 0) {
+    std::cerr << "ERROR: not a 3dfier polygon cache: " << filename << std::endl;
+    return false;
+  }
+  p += 8;
+  if (!read_binary_string(p, end, cachedfingerprint)) {
+    std::cerr << "ERROR: polygon cache " << filename << " is corrupt.\n";
+    return false;
+  }
+  if (cachedfingerprint != fingerprint) {
+    std::clog << "Polygon cache " << filename << " is outdated, reading the polygons.\n";
+    return false;
+  }
+  const PolygonCacheFeature* features;
+  const std::uint64_t* rings;
+  const double* points;
+  const PolygonCacheAttribute* attributes;
+  const std::uint64_t* stringoffsets;
+  const char* strings;
+  std::uint64_t nfeatures, nrings, npoints, nattributes, nstrings, nchars;
+  if (!view_binary_array(p, begin, end, features, nfeatures) ||
+    !view_binary_array(p, begin, end, rings, nrings) ||
+    !view_binary_array(p, begin, end, points, npoints) ||
+    !view_binary_array(p, begin, end, attributes, nattributes) ||
+    !view_binary_array(p, begin, end, stringoffsets, nstrings) ||
+    !view_binary_array(p, begin, end, strings, nchars) ||
+    nrings == 0 || rings[nrings - 1] * 2 > npoints || nstrings == 0 || stringoffsets[nstrings - 1] > nchars) {
+    std::cerr << "ERROR: polygon cache " << filename << " is corrupt.\n";
+    return false;
+  }
+  //-- check all indices before creating any feature
+  for (std::uint64_t i = 0; i < nfeatures; i++) {
+    const PolygonCacheFeature& cf = features[i];
+    bool valid = (cf.nrings > 0 && cf.firstring + cf.nrings < nrings && cf.firstattribute + cf.nattributes <= nattributes &&
+      cf.layertype + 1 < nstrings && cf.id + 1 < nstrings && cf.layername + 1 < nstrings);
+    for (std::uint64_t j = cf.firstattribute; valid && j < cf.firstattribute + cf.nattributes; j++) {
+      valid = (attributes[j].name + 1 < nstrings && attributes[j].value + 1 < nstrings);
+    }
+    if (!valid) {
+      std::cerr << "ERROR: polygon cache " << filename << " is corrupt.\n";
+      return false;
+    }
+  }
+  auto get_string = [&](std::uint32_t sid) {
+    return std::string(strings + stringoffsets[sid], strings + stringoffsets[sid + 1]);
+  };
+
+  std::clog << "Reading polygon cache: " << filename << std::endl;
+  for (std::uint64_t i = 0; i < nfeatures; i++) {
+    const PolygonCacheFeature& cf = features[i];
+    Polygon2* p2 = new Polygon2();
+    p2->inners().resize(cf.nrings - 1);
+    for (std::uint32_t r = 0; r < cf.nrings; r++) {
+      Ring2& ring = (r == 0) ? p2->outer() : p2->inners()[r - 1];
+      ring.reserve(std::size_t(rings[cf.firstring + r + 1] - rings[cf.firstring + r]));
+      for (std::uint64_t j = rings[cf.firstring + r]; j < rings[cf.firstring + r + 1]; j++) {
+        ring.push_back(Point2(points[2 * j], points[2 * j + 1]));
       }
     }
- 
-    if (bInsert == true) { //-- only insert if in the allowed LAS classes
-      Point2 p(laspt.GetX(), laspt.GetY());
-      f->add_elevation_point(p, laspt.GetZ(), radius, c, bWithin); 
+    AttributeMap attrs;
+    for (std::uint64_t j = cf.firstattribute; j < cf.firstattribute + cf.nattributes; j++) {
+      attrs[get_string(attributes[j].name)] = std::make_pair(OGRFieldType(attributes[j].type), get_string(attributes[j].value));
     }
+    add_feature(p2, get_string(cf.layername), attrs, get_string(cf.id), get_string(cf.layertype), cf.toplevel != 0);
   }
+  std::clog << "\t(" << boost::locale::as::number << _lsFeatures.size() << " features)\n";
+  return true;
 }
 
 void Map3d::cleanup_elevations() {
@@ -839,6 +1970,7 @@ bool Map3d::threeDfy(bool stitching) {
   */
   try {
     std::clog << "===== /LIFTING =====\n";
+    TopoFeature::set_lift_gap_interpolation(_lift_gap_interpolation);
     for (auto& f : _lsFeatures) {
       f->lift();
     }
@@ -869,15 +2001,28 @@ bool Map3d::threeDfy(bool stitching) {
       }
 
       std::clog << "=====  /BOWTIES =====\n";
+      //-- fixing a bowtie edits the elevations of the adjacent feature. The adjacent
+      //-- segments are searched in parallel (read-only), the fixes are then applied
+      //-- in the serial order so the result does not depend on the number of threads
+      std::vector<TopoFeature*> lsvw;
       for (auto& f : _lsFeatures) {
         if (f->has_vertical_walls()) {
-          f->fix_bowtie();
+          lsvw.push_back(f);
         }
       }
+      std::vector< std::vector<AdjacentSegment> > segments(lsvw.size());
+      parallel_for(lsvw.size(), _threads, [&](std::size_t i, int threadid) {
+        lsvw[i]->collect_adjacent_segments(segments[i]);
+      });
+      for (std::size_t i = 0; i < lsvw.size(); i++) {
+        lsvw[i]->fix_bowtie(segments[i]);
+      }
       std::clog << "=====  BOWTIES/ =====\n";
 
       std::clog << "=====  /VERTICAL WALLS =====\n";
-      for (auto& f : _lsFeatures) {
+      //-- the node columns and elevations are fixed now, each feature only writes its own walls
+      parallel_for(_lsFeatures.size(), _threads, [&](std::size_t i, int threadid) {
+        TopoFeature* f = _lsFeatures[i];
         if (f->get_class() == BUILDING) {
           Building* b = dynamic_cast<Building*>(f);
           b->construct_building_walls(_nc_building_walls);
@@ -885,7 +2030,7 @@ bool Map3d::threeDfy(bool stitching) {
         else if (f->has_vertical_walls()) {
           f->construct_vertical_walls(_nc);
         }
-      }
+      });
       std::clog << "=====  VERTICAL WALLS/ =====\n";
     }
   }
@@ -898,15 +2043,81 @@ bool Map3d::threeDfy(bool stitching) {
 
 bool Map3d::construct_CDT() {
   std::clog << "=====  /CDT =====\n";
-  for (auto& p : _lsFeatures) {
+  TopoFeature::set_triangulation(_fast_triangulation, _cdt_validation);
+  TIN::set_cdt_split(_cdt_split_points, _cdt_split_area, _threads);
+  //-- schedule the most expensive features (LiDAR points + vertices) first so that
+  //-- the large terrain TINs are not started last while the other threads are idle
+  std::vector<std::size_t> order(_lsFeatures.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  if (_threads > 1) {
+    std::vector<std::size_t> cost(_lsFeatures.size());
+    for (std::size_t i = 0; i < cost.size(); i++) {
+      cost[i] = _lsFeatures[i]->get_number_lidar_points() + bg::num_points(*(_lsFeatures[i]->get_Polygon2()));
+    }
+    std::stable_sort(order.begin(), order.end(), [&cost](std::size_t a, std::size_t b) {
+      return cost[a] > cost[b];
+    });
+  }
+  //-- the TINs cut in strips (cdt_split) are triangulated after the others, one at a
+  //-- time, so that their strips get all the threads
+  std::vector<std::size_t> split;
+  if (_cdt_split_points > 0 || _cdt_split_area > 0) {
+    std::vector<std::size_t> unsplit;
+    for (std::size_t i : order) {
+      TopoFeature* f = _lsFeatures[i];
+      if ((f->get_class() == TERRAIN || f->get_class() == FOREST) && dynamic_cast<TIN*>(f)->get_cdt_strips() > 1)
+        split.push_back(i);
+      else
+        unsplit.push_back(i);
+    }
+    order.swap(unsplit);
+  }
+  //-- a failing feature is reported and left without triangles, the others continue
+  std::vector<std::string> errors(_lsFeatures.size());
+  auto build = [&](std::size_t i) {
+    TopoFeature* p = _lsFeatures[i];
     try {
       p->buildCDT();
     }
-    catch (std::exception e) {
-      std::cerr << std::endl << "CDT failed for " << p->get_id() << " (" << p->get_class() << ") with error: " << e.what() << std::endl;
-      return false;
+    catch (const std::exception& e) {
+      errors[i] = e.what();
+      p->clear_triangulation();
+    }
+  };
+  parallel_for(order.size(), _threads, [&](std::size_t i, int threadid) {
+    build(order[i]);
+  });
+  for (std::size_t i : split) {
+    build(i);
+  }
+  int nfailed = 0;
+  for (std::size_t i = 0; i < _lsFeatures.size(); i++) {
+    if (errors[i].empty() == false) {
+      std::cerr << "CDT failed for " << _lsFeatures[i]->get_id() << " (" << _lsFeatures[i]->get_class() << ") with error: " << errors[i] << std::endl;
+      nfailed++;
     }
   }
+  if (nfailed > 0) {
+    std::cerr << "ERROR: CDT failed for " << nfailed << " of " << _lsFeatures.size() << " features, these have no triangles in the output\n";
+  }
+  //-- report the work done by the TIN simplification
+  TinSimpStats stats;
+  std::size_t ntriangles = 0;
+  for (auto& f : _lsFeatures) {
+    if (f->get_class() == TERRAIN || f->get_class() == FOREST) {
+      const TinSimpStats& s = dynamic_cast<TIN*>(f)->get_tinsimp_stats();
+      ntriangles += f->get_number_triangles();
+      stats.candidates += s.candidates;
+      stats.inserted += s.inserted;
+      stats.iterations += s.iterations;
+      stats.updates += s.updates;
+    }
+  }
+  if (stats.candidates > 0) {
+    std::clog << "TIN simplification inserted " << stats.inserted << " of " << stats.candidates << " points in " << stats.iterations << " iterations (" << stats.updates << " error updates), " << ntriangles << " triangles\n";
+  }
   std::clog << "=====  CDT/ =====\n";
   return true;
 }
@@ -917,24 +2128,26 @@ bool Map3d::save_building_variables() {
   return true;
 }
 
+//-- one rtree per class, bulk-loaded (STR packing) from the boxes of the features:
+//-- faster to build than inserting one by one, and the packed trees are faster to query
 bool Map3d::construct_rtree() {
   std::clog << "Constructing the R-tree...";
+  std::array<std::vector<PairIndexed>, NUM_TOPOCLASS> boxes;
   for (auto p : _lsFeatures) {
-    if (p->get_class() == BUILDING) {
-      _rtree_buildings.insert(std::make_pair(p->get_bbox2d(), p));
-    }
-    else {
-      _rtree.insert(std::make_pair(p->get_bbox2d(), p));
-    }
+    boxes[p->get_class()].push_back(std::make_pair(p->get_bbox2d(), p));
+  }
+  for (int tc = 0; tc < NUM_TOPOCLASS; tc++) {
+    _rtrees[tc] = bgi::rtree< PairIndexed, bgi::rstar<16> >(boxes[tc].begin(), boxes[tc].end());
   }
   std::clog << " done.\n";
 
-  //-- update the bounding box from _rtree and _rtree_buildings 
-  _bbox = Box2(
-    Point2(std::min(bg::get<bg::min_corner, 0>(_rtree.bounds()), bg::get<bg::min_corner, 0>(_rtree_buildings.bounds())),
-      std::min(bg::get<bg::min_corner, 1>(_rtree.bounds()), bg::get<bg::min_corner, 1>(_rtree_buildings.bounds()))),
-    Point2(std::max(bg::get<bg::max_corner, 0>(_rtree.bounds()), bg::get<bg::max_corner, 0>(_rtree_buildings.bounds())),
-      std::max(bg::get<bg::max_corner, 1>(_rtree.bounds()), bg::get<bg::max_corner, 1>(_rtree_buildings.bounds()))));
+  //-- update the bounding box from the rtrees
+  bg::assign_inverse(_bbox);
+  for (auto& rtree : _rtrees) {
+    if (!rtree.empty()) {
+      bg::expand(_bbox, rtree.bounds());
+    }
+  }
   return true;
 }
 
@@ -947,7 +2160,18 @@ bool Map3d::add_polygons_files(std::vector<PolygonFile> &files) {
     GDALAllRegister();
 #endif
 
-  for (auto file = files.begin(); file != files.end(); ++file) {
+  std::string fingerprint;
+  if (!_polygon_cache.empty()) {
+    fingerprint = get_polygon_cache_fingerprint(files);
+    if (!fingerprint.empty() && load_polygon_cache(_polygon_cache, fingerprint)) {
+      return true;
+    }
+  }
+
+  for (auto it = files.begin(); it != files.end(); ++it) {
+    //-- copy, the layers are expanded below and the files must stay as given for the cache
+    PolygonFile filecopy = *it;
+    PolygonFile* file = &filecopy;
     std::string logstring = "Reading input dataset: " + file->filename;
     if (strncmp(file->filename.c_str(), "PG:", strlen("PG:")) == 0) {
       logstring = "Opening PostgreSQL database connection.";
@@ -975,7 +2199,7 @@ bool Map3d::add_polygons_files(std::vector<PolygonFile> &files) {
         file->layers.emplace_back(dataLayer->GetName(), lifting);
       }
     }
-    bool wentgood = this->extract_and_add_polygon(dataSource, &(*file));
+    bool wentgood = this->extract_and_add_polygon(dataSource, file);
 #if GDAL_VERSION_MAJOR < 2
     OGRDataSource::DestroyDataSource(dataSource);
 #else
@@ -986,9 +2210,62 @@ bool Map3d::add_polygons_files(std::vector<PolygonFile> &files) {
       return false;
     }
   }
+  if (!fingerprint.empty()) {
+    save_polygon_cache(_polygon_cache, fingerprint);
+  }
   return true;
 }
 
+//-- union of the extents of the layers to read, without reading the features
+bool Map3d::get_polygons_extent(std::vector<PolygonFile> &files, Box2& extent) {
+#if GDAL_VERSION_MAJOR < 2
+  if (OGRSFDriverRegistrar::GetRegistrar()->GetDriverCount() == 0)
+    OGRRegisterAll();
+#else
+  if (GDALGetDriverCount() == 0)
+    GDALAllRegister();
+#endif
+  OGREnvelope total;
+  bool found = false;
+  for (auto& file : files) {
+#if GDAL_VERSION_MAJOR < 2
+    OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(file.filename.c_str(), false);
+#else
+    GDALDataset *dataSource = (GDALDataset*)GDALOpenEx(file.filename.c_str(), GDAL_OF_READONLY | GDAL_OF_VECTOR, NULL, NULL, NULL);
+#endif
+    if (dataSource == NULL) {
+      std::cerr << "\tERROR: Reading input dataset: " << file.filename << std::endl;
+      return false;
+    }
+    for (auto& l : file.layers) {
+      std::vector<OGRLayer*> layers;
+      if (l.first.empty()) {
+        for (int i = 0; i < dataSource->GetLayerCount(); i++)
+          layers.push_back(dataSource->GetLayer(i));
+      }
+      else if (dataSource->GetLayerByName(l.first.c_str()) != NULL) {
+        layers.push_back(dataSource->GetLayerByName(l.first.c_str()));
+      }
+      for (auto& dataLayer : layers) {
+        OGREnvelope env;
+        if (dataLayer->GetExtent(&env, true) == OGRERR_NONE) {
+          total.Merge(env);
+          found = true;
+        }
+      }
+    }
+#if GDAL_VERSION_MAJOR < 2
+    OGRDataSource::DestroyDataSource(dataSource);
+#else
+    GDALClose(dataSource);
+#endif
+  }
+  if (found) {
+    extent = Box2(Point2(total.MinX, total.MinY), Point2(total.MaxX, total.MaxY));
+  }
+  return found;
+}
+
 #if GDAL_VERSION_MAJOR < 2
 bool Map3d::extract_and_add_polygon(OGRDataSource* dataSource, PolygonFile* file) {
 #else
@@ -1029,6 +2306,8 @@ bool Map3d::extract_and_add_polygon(GDALDataset* dataSource, PolygonFile* file)
       extent.MinY = bg::get<bg::min_corner, 1>(_requestedExtent);
       extent.MaxY = bg::get<bg::max_corner, 1>(_requestedExtent);
       useRequestedExtent = true;
+      //-- let the driver use its spatial index, the envelopes are still tested below
+      dataLayer->SetSpatialFilterRect(extent.MinX, extent.MinY, extent.MaxX, extent.MaxY);
     }
 
     int numSplitMulti = 0;
@@ -1085,59 +2364,69 @@ bool Map3d::extract_and_add_polygon(GDALDataset* dataSource, PolygonFile* file)
 }
 
 void Map3d::extract_feature(OGRFeature *f, std::string layername, const char *idfield, const char *heightfield, std::string layertype, bool multiple_heights) {
+  //-- flag all polygons at (niveau != 0) or skip them if not handling multiple height levels
+  bool toplevel = true;
+  if ((f->GetFieldIndex(heightfield) != -1) && (f->GetFieldAsInteger(heightfield) != 0)) {
+    if (!multiple_heights) {
+      return;
+    }
+    toplevel = false;
+  }
   char *wkt;
   OGRGeometry *geom = f->GetGeometryRef();
   geom->flattenTo2D();
   geom->exportToWkt(&wkt);
+  Polygon2* p2 = new Polygon2();
+  bg::read_wkt(wkt, *p2);
+  CPLFree(wkt);
+  bg::unique(*p2); //-- remove duplicate vertices
+  bg::correct(*p2); //-- correct the orientation of the polygons!
   AttributeMap attributes;
   int attributeCount = f->GetFieldCount();
   std::string id = f->GetFieldAsString(idfield);
   for (int i = 0; i < attributeCount; i++) {
     attributes[boost::locale::to_lower(f->GetFieldDefnRef(i)->GetNameRef())] = std::make_pair(f->GetFieldDefnRef(i)->GetType(), f->GetFieldAsString(i));
   }
+  add_feature(p2, layername, attributes, id, layertype, toplevel);
+}
+
+void Map3d::add_feature(Polygon2* p2, std::string layername, AttributeMap& attributes, std::string id, std::string layertype, bool toplevel) {
+  TopoFeature* p3;
   if (layertype == "Building") {
-    Building* p3 = new Building(wkt, layername, attributes, id, _building_heightref_roof, _building_heightref_ground, _building_triangulate, _building_include_floor, _building_inner_walls);
-    _lsFeatures.push_back(p3);
+    p3 = new Building(p2, layername, attributes, id, _building_heightref_roof, _building_heightref_ground, _building_triangulate, _building_include_floor, _building_inner_walls);
   }
   else if (layertype == "Terrain") {
-    Terrain* p3 = new Terrain(wkt, layername, attributes, id, this->_terrain_simplification, this->_terrain_simplification_tinsimp, this->_terrain_innerbuffer);
-    _lsFeatures.push_back(p3);
+    p3 = new Terrain(p2, layername, attributes, id, this->_terrain_simplification, this->_terrain_simplification_tinsimp, this->_terrain_innerbuffer, this->_terrain_simplification_tinsimp_method);
   }
   else if (layertype == "Forest") {
-    Forest* p3 = new Forest(wkt, layername, attributes, id, this->_forest_simplification, this->_forest_simplification_tinsimp, this->_forest_innerbuffer);
-    _lsFeatures.push_back(p3);
+    p3 = new Forest(p2, layername, attributes, id, this->_forest_simplification, this->_forest_simplification_tinsimp, this->_forest_innerbuffer, this->_forest_simplification_tinsimp_method);
   }
   else if (layertype == "Water") {
-    Water* p3 = new Water(wkt, layername, attributes, id, this->_water_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = new Water(p2, layername, attributes, id, this->_water_heightref);
   }
   else if (layertype == "Road") {
-    Road* p3 = new Road(wkt, layername, attributes, id, this->_road_heightref, this->_road_filter_outliers, this->_road_flatten);
-    _lsFeatures.push_back(p3);
+    p3 = new Road(p2, layername, attributes, id, this->_road_heightref, this->_road_filter_outliers, this->_road_flatten);
   }
   else if (layertype == "Separation") {
-    Separation* p3 = new Separation(wkt, layername, attributes, id, this->_separation_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = new Separation(p2, layername, attributes, id, this->_separation_heightref);
   }
   else if (layertype == "Bridge/Overpass") {
-    Bridge* p3 = new Bridge(wkt, layername, attributes, id, this->_bridge_heightref, _bridge_flatten);
-    _lsFeatures.push_back(p3);
+    p3 = new Bridge(p2, layername, attributes, id, this->_bridge_heightref, _bridge_flatten);
   }
-  //-- flag all polygons at (niveau != 0) or remove if not handling multiple height levels
-  if ((f->GetFieldIndex(heightfield) != -1) && (f->GetFieldAsInteger(heightfield) != 0)) {
-    if (multiple_heights) {
-      // std::clog << "niveau=" << f->GetFieldAsInteger(heightfield) << ": " << f->GetFieldAsString(idfield) << std::endl;
-      _lsFeatures.back()->set_top_level(false);
-    }
-    else {
-      _lsFeatures.pop_back();
-    }
+  else {
+    delete p2;
+    return;
   }
+  if (!toplevel) {
+    p3->set_top_level(false);
+  }
+  _lsFeatures.push_back(p3);
 }
 
 //-- http://www.liblas.org/tutorial/cpp.html#applying-filters-to-a-reader-to-extract-specified-classes
 bool Map3d::add_las_file(PointFile pointFile) {
   std::clog << "Reading LAS/LAZ file: " << pointFile.filename << std::endl;
+  TIN::set_defer_thinning(_checkpoint_save);
   std::ifstream ifs;
   ifs.open(pointFile.filename.c_str(), std::ios::in | std::ios::binary);
   if (ifs.is_open() == false) {
@@ -1212,9 +2501,13 @@ bool Map3d::add_las_file(PointFile pointFile) {
 
 void Map3d::collect_adjacent_features(TopoFeature* f) {
   std::vector<PairIndexed> re;
-  Box2 b = f->get_bbox2d();
-  _rtree.query(bgi::satisfies([&](PairIndexed const& v) {return bg::distance(v.first, b) < TOPODIST; }), std::back_inserter(re));
-  _rtree_buildings.query(bgi::satisfies([&](PairIndexed const& v) {return bg::distance(v.first, b) < TOPODIST; }), std::back_inserter(re));
+  const Box2& b = f->get_bbox2d();
+  //-- the box grown by TOPODIST lets the rtree prune, the distance is tested on what it returns
+  Box2 querybox(Point2(bg::get<bg::min_corner, 0>(b) - TOPODIST, bg::get<bg::min_corner, 1>(b) - TOPODIST),
+    Point2(bg::get<bg::max_corner, 0>(b) + TOPODIST, bg::get<bg::max_corner, 1>(b) + TOPODIST));
+  for (auto& rtree : _rtrees) {
+    rtree.query(bgi::intersects(querybox) && bgi::satisfies([&](PairIndexed const& v) {return bg::distance(v.first, b) < TOPODIST; }), std::back_inserter(re));
+  }
   for (auto& each : re) {
     TopoFeature* fadj = each.second;
     if (f != fadj && f->adjacent(*(fadj->get_Polygon2()))){
@@ -1224,7 +2517,10 @@ void Map3d::collect_adjacent_features(TopoFeature* f) {
 }
 
 void Map3d::stitch_lifted_features() {
-  std::vector<int> ringis, pis;
+  if (_threads > 1) {
+    this->stitch_lifted_features_parallel();
+    return;
+  }
   for (auto& f : _lsFeatures) {
     if (f->get_class() != BRIDGE) {
       //-- gather all rings
@@ -1237,54 +2533,178 @@ void Map3d::stitch_lifted_features() {
       int ringi = -1;
       for (Ring2& ring : therings) {
         ringi++;
-        //-- 1. store all touching top level (adjacent + incident)
-        std::vector<TopoFeature*>* lstouching = f->get_adjacent_features();
-        //-- 2. build the node-column for each vertex
         for (int i = 0; i < ring.size(); i++) {
           std::vector< std::tuple<TopoFeature*, int, int> > star;
-          bool toprocess = false;
-          for (auto& fadj : *lstouching) {
-            ringis.clear();
-            pis.clear();
-            if (fadj->has_point2(ring[i], ringis, pis) == true) {
-              for (int k = 0; k < ringis.size(); k++) {
-                toprocess = true;
-                star.push_back(std::make_tuple(fadj, ringis[k], pis[k]));
-              }
-            }
-          }
-          if (toprocess == true) {
-            this->stitch_one_vertex(f, ringi, i, star);
-          }
-          else if (f->get_class() == BUILDING) {
-            Point2 tmp = f->get_point2(ringi, i);
-            std::string key_bucket = gen_key_bucket(&tmp);
-            int z = dynamic_cast<Building*>(f)->get_height_base();
-            _nc_building_walls[key_bucket].push_back(z);
-            z = f->get_vertex_elevation(ringi, i);
-            _nc_building_walls[key_bucket].push_back(z);
-          }
+          this->collect_vertex_star(f, ring[i], star);
+          this->stitch_vertex(f, ringi, i, star, _nc, _nc_building_walls);
+        }
+      }
+    }
+  }
+}
+
+//-- Parallel version of stitch_lifted_features() that gives exactly the same result.
+//-- Stitching a vertex only reads and writes the elevations of the vertices in its star
+//-- and the node-column entries of its key_bucket. The visits are grouped with a
+//-- union-find on these resources; groups are independent and are stitched in parallel,
+//-- while the visits inside one group keep the serial order. Each thread writes to its
+//-- own NodeColumns, these are merged afterwards since no key is shared by two groups.
+void Map3d::stitch_lifted_features_parallel() {
+  //-- 1. list the vertices to visit in the serial order, and give every vertex an id
+  std::vector< std::tuple<TopoFeature*, int, int> > visits;
+  std::unordered_map<TopoFeature*, std::vector<std::size_t> > ringoffsets;
+  std::size_t nvertices = 0;
+  for (auto& f : _lsFeatures) {
+    Polygon2* poly = f->get_Polygon2();
+    std::vector<std::size_t>& offsets = ringoffsets[f];
+    offsets.push_back(nvertices);
+    nvertices += poly->outer().size();
+    for (Ring2& iring : poly->inners()) {
+      offsets.push_back(nvertices);
+      nvertices += iring.size();
+    }
+    if (f->get_class() != BRIDGE) {
+      for (int ringi = 0; ringi < offsets.size(); ringi++) {
+        int ringsize = (ringi == 0) ? poly->outer().size() : poly->inners()[ringi - 1].size();
+        for (int i = 0; i < ringsize; i++) {
+          visits.push_back(std::make_tuple(f, ringi, i));
         }
       }
     }
   }
+
+  //-- 2. collect the star and the key_bucket of each vertex, read-only
+  std::vector< std::vector< std::tuple<TopoFeature*, int, int> > > stars(visits.size());
+  std::vector<std::string> keys(visits.size());
+  parallel_for(visits.size(), _threads, [&](std::size_t vi, int threadid) {
+    TopoFeature* f = std::get<0>(visits[vi]);
+    Point2 p = f->get_point2(std::get<1>(visits[vi]), std::get<2>(visits[vi]));
+    keys[vi] = gen_key_bucket(&p);
+    this->collect_vertex_star(f, p, stars[vi]);
+  });
+
+  //-- 3. union-find on the vertex ids and the key_buckets (ids after the vertices)
+  std::vector<std::size_t> parent(nvertices);
+  for (std::size_t i = 0; i < nvertices; i++) {
+    parent[i] = i;
+  }
+  auto findroot = [&parent](std::size_t i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  auto unite = [&parent, &findroot](std::size_t a, std::size_t b) {
+    a = findroot(a);
+    b = findroot(b);
+    if (a != b) {
+      parent[std::max(a, b)] = std::min(a, b);
+    }
+  };
+  std::unordered_map<std::string, std::size_t> keyids;
+  for (std::size_t vi = 0; vi < visits.size(); vi++) {
+    auto it = keyids.find(keys[vi]);
+    std::size_t keyid;
+    if (it == keyids.end()) {
+      keyid = parent.size();
+      keyids[keys[vi]] = keyid;
+      parent.push_back(keyid);
+    }
+    else {
+      keyid = it->second;
+    }
+    TopoFeature* f = std::get<0>(visits[vi]);
+    std::size_t vid = ringoffsets[f][std::get<1>(visits[vi])] + std::get<2>(visits[vi]);
+    unite(vid, keyid);
+    for (auto& s : stars[vi]) {
+      unite(vid, ringoffsets[std::get<0>(s)][std::get<1>(s)] + std::get<2>(s));
+    }
+  }
+
+  //-- 4. group the visits, the serial order is kept within a group
+  std::vector< std::vector<std::size_t> > groups;
+  std::unordered_map<std::size_t, std::size_t> groupids;
+  for (std::size_t vi = 0; vi < visits.size(); vi++) {
+    std::size_t root = findroot(keyids[keys[vi]]);
+    auto it = groupids.find(root);
+    if (it == groupids.end()) {
+      groupids[root] = groups.size();
+      groups.push_back(std::vector<std::size_t>(1, vi));
+    }
+    else {
+      groups[it->second].push_back(vi);
+    }
+  }
+
+  //-- 5. stitch the groups in blocks, each thread in its own NodeColumns
+  const std::size_t blocksize = 256;
+  std::vector<NodeColumn> ncs(_threads);
+  std::vector<NodeColumn> ncbws(_threads);
+  parallel_for((groups.size() + blocksize - 1) / blocksize, _threads, [&](std::size_t bi, int threadid) {
+    std::size_t end = std::min(groups.size(), (bi + 1) * blocksize);
+    for (std::size_t gi = bi * blocksize; gi < end; gi++) {
+      for (auto vi : groups[gi]) {
+        this->stitch_vertex(std::get<0>(visits[vi]), std::get<1>(visits[vi]), std::get<2>(visits[vi]), stars[vi], ncs[threadid], ncbws[threadid]);
+      }
+    }
+  });
+
+  //-- 6. merge the NodeColumns, keys are unique to a group
+  for (int t = 0; t < _threads; t++) {
+    for (auto& each : ncs[t]) {
+      _nc[each.first] = std::move(each.second);
+    }
+    for (auto& each : ncbws[t]) {
+      _nc_building_walls[each.first] = std::move(each.second);
+    }
+  }
+}
+
+//-- store all touching top level (adjacent + incident) vertices at location p
+void Map3d::collect_vertex_star(TopoFeature* f, const Point2& p, std::vector< std::tuple<TopoFeature*, int, int> >& star) {
+  std::vector<int> ringis, pis;
+  for (auto& fadj : *(f->get_adjacent_features())) {
+    ringis.clear();
+    pis.clear();
+    if (fadj->has_point2(p, ringis, pis) == true) {
+      for (int k = 0; k < ringis.size(); k++) {
+        star.push_back(std::make_tuple(fadj, ringis[k], pis[k]));
+      }
+    }
+  }
+}
+
+//-- build the node-column for a vertex
+void Map3d::stitch_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star, NodeColumn& nc, NodeColumn& ncbw) {
+  if (star.empty() == false) {
+    this->stitch_one_vertex(f, ringi, pi, star, nc, ncbw);
+  }
+  else if (f->get_class() == BUILDING) {
+    Point2 tmp = f->get_point2(ringi, pi);
+    std::string key_bucket = gen_key_bucket(&tmp);
+    int z = dynamic_cast<Building*>(f)->get_height_base();
+    ncbw[key_bucket].push_back(z);
+    z = f->get_vertex_elevation(ringi, pi);
+    ncbw[key_bucket].push_back(z);
+  }
 }
 
-void Map3d::stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star) {
+void Map3d::stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star, NodeColumn& nc, NodeColumn& ncbw) {
   //-- get p and key_bucket once and check if nc location is empty
   Point2 p = f->get_point2(ringi, pi);
   std::string key_bucket = gen_key_bucket(&p);
-  if (_nc.find(key_bucket) == _nc.end() && _nc_building_walls.find(key_bucket) == _nc_building_walls.end()) {
+  if (nc.find(key_bucket) == nc.end() && ncbw.find(key_bucket) == ncbw.end()) {
     //-- degree of vertex == 2
     if (star.size() == 1) {
       if (std::get<0>(star[0])->get_class() != BRIDGE) {
         TopoFeature* fadj = std::get<0>(star[0]);
         //-- if not building or both soft, then average.
         if (f->get_class() != BUILDING && fadj->get_class() != BUILDING && (f->is_hard() == false && fadj->is_hard() == false)) {
-          stitch_average(f, ringi, pi, fadj, std::get<1>(star[0]), std::get<2>(star[0]));
+          stitch_average(f, ringi, pi, fadj, std::get<1>(star[0]), std::get<2>(star[0]), nc);
         }
         else {
-          stitch_jumpedge(f, ringi, pi, fadj, std::get<1>(star[0]), std::get<2>(star[0]));
+          stitch_jumpedge(f, ringi, pi, fadj, std::get<1>(star[0]), std::get<2>(star[0]), nc, ncbw);
         }
       }
     }
@@ -1352,13 +2772,13 @@ void Map3d::stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< st
         int tmph = -99999;
         for (auto i : buildings) {
           int hfloor = dynamic_cast<Building*>(std::get<1>(zstar[i]))->get_height_base();
-          if (std::find(_nc_building_walls[key_bucket].begin(), _nc_building_walls[key_bucket].end(), hfloor) == _nc_building_walls[key_bucket].end()) {
-            _nc_building_walls[key_bucket].push_back(hfloor);
+          if (std::find(ncbw[key_bucket].begin(), ncbw[key_bucket].end(), hfloor) == ncbw[key_bucket].end()) {
+            ncbw[key_bucket].push_back(hfloor);
           }
 
           int hroof = dynamic_cast<Building*>(std::get<1>(zstar[i]))->get_height();
-          if (std::find(_nc_building_walls[key_bucket].begin(), _nc_building_walls[key_bucket].end(), hroof) == _nc_building_walls[key_bucket].end()) {
-            _nc_building_walls[key_bucket].push_back(hroof);
+          if (std::find(ncbw[key_bucket].begin(), ncbw[key_bucket].end(), hroof) == ncbw[key_bucket].end()) {
+            ncbw[key_bucket].push_back(hroof);
           }
         }
         // add vw to water since it might be lower then the building floor
@@ -1457,7 +2877,7 @@ void Map3d::stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< st
           std::get<1>(each)->set_vertex_elevation(std::get<2>(each), std::get<3>(each), h);
         }
         if (h != tmph) { //-- not to repeat the same height
-          _nc[key_bucket].push_back(h);
+          nc[key_bucket].push_back(h);
           tmph = h;
         }
       }
@@ -1465,7 +2885,7 @@ void Map3d::stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< st
   }
 }
 
-void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2) {
+void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2, NodeColumn& nc, NodeColumn& ncbw) {
   Point2 p = f1->get_point2(ringi1, pi1);
   std::string key_bucket = gen_key_bucket(&p);
   int f1z = f1->get_vertex_elevation(ringi1, pi1);
@@ -1476,13 +2896,13 @@ void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f
     if (f1->get_class() == BUILDING && f2->get_class() == BUILDING) {
       int f1base = dynamic_cast<Building*>(f1)->get_height_base();
       int f2base = dynamic_cast<Building*>(f2)->get_height_base();
-      _nc_building_walls[key_bucket].push_back(f1base);
+      ncbw[key_bucket].push_back(f1base);
       if (f1base != f2base) {
-        _nc_building_walls[key_bucket].push_back(f2base);
+        ncbw[key_bucket].push_back(f2base);
       }
-      _nc_building_walls[key_bucket].push_back(f1z);
+      ncbw[key_bucket].push_back(f1z);
       if (f1z != f2z) {
-        _nc_building_walls[key_bucket].push_back(f2z);
+        ncbw[key_bucket].push_back(f2z);
       }
     }
     else if (f1->get_class() == BUILDING) {
@@ -1492,12 +2912,12 @@ void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f
       }
       else {
         //- keep water flat, add the water height and the building base height to the nc
-        _nc[key_bucket].push_back(f2z);
-        _nc[key_bucket].push_back(f1base);
+        nc[key_bucket].push_back(f2z);
+        nc[key_bucket].push_back(f1base);
       }
       //- expect a building to always be heighest adjacent feature
-      _nc_building_walls[key_bucket].push_back(f1base);
-      _nc_building_walls[key_bucket].push_back(f1z);
+      ncbw[key_bucket].push_back(f1base);
+      ncbw[key_bucket].push_back(f1z);
     }
     else { //-- f2 is Building
       int f2base = dynamic_cast<Building*>(f2)->get_height_base();
@@ -1506,12 +2926,12 @@ void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f
       }
       else {
         //- keep water flat, add the water height and the building base height to the nc
-        _nc[key_bucket].push_back(f1z);
-        _nc[key_bucket].push_back(f2base);
+        nc[key_bucket].push_back(f1z);
+        nc[key_bucket].push_back(f2base);
       }
       //- expect a building to always be heighest adjacent feature
-      _nc_building_walls[key_bucket].push_back(f2base);
-      _nc_building_walls[key_bucket].push_back(f2z);
+      ncbw[key_bucket].push_back(f2base);
+      ncbw[key_bucket].push_back(f2z);
     }
   }
   //-- no Buildings involved
@@ -1552,19 +2972,19 @@ void Map3d::stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f
         else if (f2z > f1z) {
           f2->add_vertical_wall();
         }
-        _nc[key_bucket].push_back(f1z);
-        _nc[key_bucket].push_back(f2z);
+        nc[key_bucket].push_back(f1z);
+        nc[key_bucket].push_back(f2z);
       }
     }
   }
 }
 
-void Map3d::stitch_average(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2) {
+void Map3d::stitch_average(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2, NodeColumn& nc) {
   int avgz = (f1->get_vertex_elevation(ringi1, pi1) + f2->get_vertex_elevation(ringi2, pi2)) / 2;
   f1->set_vertex_elevation(ringi1, pi1, avgz);
   f2->set_vertex_elevation(ringi2, pi2, avgz);
   Point2 p = f1->get_point2(ringi1, pi1);
-  _nc[gen_key_bucket(&p)].push_back(avgz);
+  nc[gen_key_bucket(&p)].push_back(avgz);
 }
 
 void Map3d::stitch_bridges() {
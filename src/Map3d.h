@@ -32,6 +32,7 @@
 #include "definitions.h"
 #include "geomtools.h"
 #include "io.h"
+#include "parallel.h"
 #include "TopoFeature.h"
 #include "Building.h"
 #include "Terrain.h"
@@ -50,7 +51,15 @@ public:
   ~Map3d();
 
   bool add_polygons_files(std::vector<PolygonFile> &files);
+  bool get_polygons_extent(std::vector<PolygonFile> &files, Box2& extent);
   bool add_las_file(PointFile pointFile);
+  void save_checkpoint(std::ostream& of);
+  bool save_checkpoint(std::string filename);
+  bool load_checkpoint(const char* p, const char* end);
+  bool load_checkpoint(std::string filename);
+  void thin_checkpoint_lidar_points();
+  void save_polygon_cache(std::ostream& of);
+  bool load_polygon_cache(const char* p, const char* end);
 
   void stitch_lifted_features();
   bool construct_rtree();
@@ -58,27 +67,33 @@ public:
   bool construct_CDT();
   void add_elevation_point(liblas::Point const& laspt);
   void cleanup_elevations();
+  unsigned long remove_features_outside_tile();
 
   unsigned long get_num_polygons();
   const std::vector<TopoFeature*>&  get_polygons3d();
   Box2 get_bbox();
   liblas::Bounds<double> get_bounds();
 
-  void get_citygml(std::wostream& of);
+  bool get_citygml(std::string filename);
   void get_citygml_multifile(std::string);
-  void create_citygml_header(std::wostream& of);
-  void get_citygml_imgeo(std::wostream& of);
+  void create_citygml_header(TextWriter& of);
+  bool get_citygml_imgeo(std::string filename);
   bool get_cityjson(std::string filename);
+  bool get_cityjsonseq(std::string filename);
+  bool get_outputs(const std::vector<std::pair<std::string, std::string> >& outputs);
   void get_citygml_imgeo_multifile(std::string ofname);
-  void create_citygml_imgeo_header(std::wostream& of);
+  void create_citygml_imgeo_header(TextWriter& of);
   bool get_pdok_output(std::string filename);
   bool get_pdok_citygml_output(std::string filename);
   bool get_gdal_output(std::string filename, std::string drivername, bool multi);
   void get_csv_buildings(std::wostream& of);
   void get_csv_buildings_multiple_heights(std::wostream& of);
   void get_csv_buildings_all_elevation_points(std::wostream& of);
-  void get_obj_per_feature(std::wostream& of);
-  void get_obj_per_class(std::wostream& of);
+  bool get_obj_per_feature(std::string filename);
+  bool get_obj_per_class(std::string filename);
+  bool get_obj_multifile(std::string ofname, bool perfeature);
+  bool get_glb(std::string filename);
+  bool get_3dtiles(std::string dirname);
   bool get_shapefile2d(std::string filename);
 
   void set_building_heightref_roof(float heightref);
@@ -91,6 +106,8 @@ public:
   void set_forest_simplification(int simplification);
   void set_terrain_simplification_tinsimp(double tinsimp_threshold);
   void set_forest_simplification_tinsimp(double tinsimp_threshold);
+  void set_terrain_simplification_tinsimp_method(TinSimpMethod method);
+  void set_forest_simplification_tinsimp_method(TinSimpMethod method);
   void set_terrain_innerbuffer(float innerbuffer);
   void set_forest_innerbuffer(float innerbuffer);
   void set_water_heightref(float heightref);
@@ -104,6 +121,19 @@ public:
   void set_building_radius_vertex_elevation(float radius);
   void set_threshold_jump_edges(float threshold);
   void set_requested_extent(double xmin, double ymin, double xmax, double ymax);
+  void set_tile(const Box2& tiling, double tilesize, int col, int row);
+  void set_threads(int threads);
+  void set_cdt_split_points(int maxpoints);
+  void set_cdt_split_area(double maxarea);
+  void set_fast_triangulation(bool fast);
+  void set_cdt_validation(bool validate);
+  void set_lift_gap_interpolation(bool interpolate);
+  void set_checkpoint_save(bool save);
+  void set_polygon_cache(std::string filename);
+  void set_cityjson_transform(bool transform);
+  void set_obj_tile_size(double size);
+  void set_tileset_max_features(int max);
+  void set_tileset_epsg(int epsg);
 
   void add_allowed_las_class(AllowedLASTopo c, int i);
   void add_allowed_las_class_within(AllowedLASTopo c, int i);
@@ -121,6 +151,8 @@ private:
   int         _forest_simplification;
   double      _terrain_simplification_tinsimp;
   double      _forest_simplification_tinsimp;
+  TinSimpMethod _terrain_simplification_tinsimp_method;
+  TinSimpMethod _forest_simplification_tinsimp_method;
   float       _terrain_innerbuffer;
   float       _forest_innerbuffer;
   float       _water_heightref;
@@ -133,8 +165,24 @@ private:
   float       _radius_vertex_elevation;
   float       _building_radius_vertex_elevation;
   int         _threshold_jump_edges; //-- in cm/integer
+  int         _threads;
+  int         _cdt_split_points;
+  double      _cdt_split_area;
+  bool        _fast_triangulation;
+  bool        _cdt_validation;
+  bool        _lift_gap_interpolation;
+  bool        _checkpoint_save;
+  std::string _polygon_cache;
+  bool        _cityjson_transform;
+  double      _obj_tile_size;
+  int         _tileset_max_features;
+  int         _tileset_epsg;
   Box2        _bbox;
   Box2        _requestedExtent;
+  Box2        _tilingExtent;
+  double      _tile_size;
+  int         _tile_col;
+  int         _tile_row;
 
   //-- storing the LAS allowed for each TopoFeature
   std::array<std::set<int>,NUM_ALLOWEDLASTOPO> _las_classes_allowed;
@@ -145,8 +193,7 @@ private:
   std::unordered_map<std::string, int>                _bridge_stitches;
   std::vector<TopoFeature*>                           _lsFeatures;
   std::vector<std::string>                            _allowed_layers;
-  bgi::rtree< PairIndexed, bgi::rstar<16> >           _rtree;
-  bgi::rtree< PairIndexed, bgi::rstar<16> >           _rtree_buildings;
+  std::array<bgi::rtree< PairIndexed, bgi::rstar<16> >, NUM_TOPOCLASS> _rtrees; //-- one per TopoClass
 
 #if GDAL_VERSION_MAJOR < 2
   bool extract_and_add_polygon(OGRDataSource* dataSource, PolygonFile* file);
@@ -156,11 +203,33 @@ private:
   void close_gdal_resources(GDALDriver* driver, std::unordered_map<std::string, OGRLayer*> layers);
 #endif
   void extract_feature(OGRFeature * f, std::string layerName, const char * idfield, const char * heightfield, std::string layertype, bool multiple_heights);
-  void stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star);
-  void stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2);
-  void stitch_average(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2);
+  void add_feature(Polygon2* p2, std::string layername, AttributeMap& attributes, std::string id, std::string layertype, bool toplevel);
+  std::string get_polygon_cache_fingerprint(std::vector<PolygonFile>& files);
+  bool save_polygon_cache(std::string filename, const std::string& fingerprint);
+  bool load_polygon_cache(std::string filename, const std::string& fingerprint);
+  void write_polygon_cache(std::ostream& of, const std::string& fingerprint);
+  bool read_polygon_cache(const char* begin, const char* end, const std::string& fingerprint, const std::string& filename);
+  void stitch_lifted_features_parallel();
+  void collect_vertex_star(TopoFeature* f, const Point2& p, std::vector< std::tuple<TopoFeature*, int, int> >& star);
+  void stitch_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star, NodeColumn& nc, NodeColumn& ncbw);
+  void stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star, NodeColumn& nc, NodeColumn& ncbw);
+  void stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2, NodeColumn& nc, NodeColumn& ncbw);
+  void stitch_average(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2, NodeColumn& nc);
   void stitch_bridges();
   void collect_adjacent_features(TopoFeature* f);
+  bool is_in_tile(TopoFeature* f);
+  bool is_las_class_allowed(TopoClass tc, int c, bool& within);
+  void write_checkpoint_settings(std::ostream& of);
+  bool read_checkpoint_settings(const char*& p, const char* end);
+  void thin_lidar_points();
+  void get_cityjson_translate(double translate[3]);
+  void create_cityjson_header(std::ostream& of, const double translate[3]);
+  void create_cityjson_footer(std::ostream& of, const VertexPool& vertices, const double translate[3]);
+  void create_cityjsonseq_header(std::ostream& of, const double translate[3]);
+  void get_cityjsonseq_feature(std::ostream& of, TopoFeature* f, VertexPool& vertices, const long long offset[3]);
+  bool get_obj(std::string filename, const std::vector<TopoFeature*>& features, bool ids);
+  void get_obj_feature(TopoFeature* p, VertexPool& vertices, std::string& fs, bool ids);
+  void get_glb_feature(TopoFeature* p, GLBMesh& mesh);
 };
 
 #endif
@@ -32,8 +32,8 @@ float Road::_heightref;
 bool  Road::_filter_outliers;
 bool  Road::_flatten;
 
-Road::Road(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref, bool filter_outliers, bool flatten)
-  : Boundary3D(wkt, layername, attributes, pid) {
+Road::Road(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref, bool filter_outliers, bool flatten)
+  : Boundary3D(p2, layername, attributes, pid) {
   _heightref = heightref;
   _filter_outliers = filter_outliers;
   _flatten = flatten;
@@ -67,18 +67,15 @@ bool Road::lift() {
   return true;
 }
 
-void Road::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "Road";
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Road::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"Road\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Road::get_citygml(std::wostream& of) {
+void Road::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<tra:Road gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -94,7 +91,7 @@ void Road::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Road::get_citygml_imgeo(std::wostream& of) {
+void Road::get_citygml_imgeo(TextWriter& of) {
   bool auxiliary = _layername == "auxiliarytrafficarea";
   bool spoor = _layername == "spoor";
   of << "<cityObjectMember>";
@@ -30,8 +30,8 @@
 
 float Separation::_heightref;
 
-Separation::Separation(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Boundary3D(wkt, layername, attributes, pid) {
+Separation::Separation(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref)
+  : Boundary3D(p2, layername, attributes, pid) {
   _heightref = heightref;
 }
 
@@ -61,18 +61,15 @@ bool Separation::lift() {
   return true;
 }
 
-void Separation::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "GenericCityObject";
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Separation::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"GenericCityObject\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Separation::get_citygml(std::wostream& of) {
+void Separation::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<gen:GenericCityObject gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -88,7 +85,7 @@ void Separation::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Separation::get_citygml_imgeo(std::wostream& of) {
+void Separation::get_citygml_imgeo(TextWriter& of) {
   bool kunstwerkdeel = _layername == "kunstwerkdeel";
   bool overigbouwwerk = _layername == "overigbouwwerk";
   of << "<cityObjectMember>";
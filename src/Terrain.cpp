@@ -28,8 +28,8 @@
 
 #include "Terrain.h"
 
-Terrain::Terrain(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer)
-  : TIN(wkt, layername, attributes, pid, simplification, simplification_tinsimp, innerbuffer) {}
+Terrain::Terrain(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer, TinSimpMethod simplification_tinsimp_method)
+  : TIN(p2, layername, attributes, pid, simplification, simplification_tinsimp, innerbuffer, simplification_tinsimp_method) {}
 
 TopoClass Terrain::get_class() {
   return TERRAIN;
@@ -57,18 +57,15 @@ bool Terrain::lift() {
   return true;
 }
 
-void Terrain::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "LandUse";
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Terrain::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"LandUse\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Terrain::get_citygml(std::wostream& of) {
+void Terrain::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<lu:LandUse gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -84,7 +81,7 @@ void Terrain::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Terrain::get_citygml_imgeo(std::wostream& of) {
+void Terrain::get_citygml_imgeo(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<imgeo:OnbegroeidTerreindeel gml:id=\"" << this->get_id() << "\">";
   get_imgeo_object_info(of, this->get_id());
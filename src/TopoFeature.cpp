@@ -27,15 +27,20 @@
 */
 
 #include "TopoFeature.h"
+#include "parallel.h"
+#include "checkpoint.h"
 
-TopoFeature::TopoFeature(char *wkt, std::string layername, AttributeMap attributes, std::string pid) {
+//-- static variables
+bool TopoFeature::_fast_triangulation = true;
+bool TopoFeature::_cdt_validate = true;
+bool TopoFeature::_lift_gap_interpolation = false;
+
+TopoFeature::TopoFeature(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid) {
   _id = pid;
   _toplevel = true;
   _bVerticalWalls = false;
-  _p2 = new Polygon2();
-  bg::read_wkt(wkt, *_p2);
-  bg::unique(*_p2); //-- remove duplicate vertices
-  bg::correct(*_p2); //-- correct the orientation of the polygons!
+  _p2 = p2;
+  _bbox2d = bg::return_envelope<Box2>(*_p2); //-- the polygon does not change, the rtrees use it often
 
   _adjFeatures = new std::vector<TopoFeature*>;
   _p2z.resize(bg::num_interior_rings(*_p2) + 1);
@@ -51,11 +56,12 @@ TopoFeature::TopoFeature(char *wkt, std::string layername, AttributeMap attribut
 }
 
 TopoFeature::~TopoFeature() {
-  // TODO: clear memory properly
+  delete _p2;
+  delete _adjFeatures;
 }
 
-Box2 TopoFeature::get_bbox2d() {
-  return bg::return_envelope<Box2>(*_p2);
+const Box2& TopoFeature::get_bbox2d() {
+  return _bbox2d;
 }
 
 std::string TopoFeature::get_id() {
@@ -67,7 +73,28 @@ std::string  TopoFeature::get_layername() {
 }
 
 bool TopoFeature::buildCDT() {
-  return getCDT(_p2, _p2z, _vertices, _triangles);
+  //-- without interior points ear clipping is enough, the CDT takes what it cannot handle
+  if (_fast_triangulation && getEarClipping(_p2, _p2z, _vertices, _triangles))
+    return true;
+  return getCDT(_p2, _p2z, _vertices, _triangles, std::vector<Point3>(), 0, TINSIMP_GREEDY, nullptr, _cdt_validate);
+}
+
+void TopoFeature::set_triangulation(bool fast, bool validate) {
+  _fast_triangulation = fast;
+  _cdt_validate = validate;
+}
+
+std::size_t TopoFeature::get_number_lidar_points() {
+  return 0;
+}
+
+void TopoFeature::clear_triangulation() {
+  _vertices.clear();
+  _triangles.clear();
+}
+
+std::size_t TopoFeature::get_number_triangles() {
+  return _triangles.size();
 }
 
 bool TopoFeature::get_top_level() {
@@ -82,98 +109,40 @@ Polygon2* TopoFeature::get_Polygon2() {
   return _p2;
 }
 
-void TopoFeature::get_cityjson_geom(nlohmann::json& g, std::unordered_map<std::string,unsigned long> &dPts, std::string primitive) {
-  g["type"] = primitive;
-  g["lod"] = 1;
-  g["boundaries"];
-  std::vector<std::vector<std::vector<unsigned long>>> shelli;
-  for (auto& t : _triangles) {
-    unsigned long a, b, c;
-    auto it = dPts.find(_vertices[t.v0].second);
-    if (it == dPts.end()) {
-      a = dPts.size();
-      dPts[_vertices[t.v0].second] = a;
-    }
-    else
-      a = it->second;
-    it = dPts.find(_vertices[t.v1].second);
-    if (it == dPts.end()) {
-      b = dPts.size();
-      dPts[_vertices[t.v1].second] = b;
-    }
-    else
-      b = it->second;
-    it = dPts.find(_vertices[t.v2].second);
-    if (it == dPts.end()) {
-      c = dPts.size();
-      dPts[_vertices[t.v2].second] = c;
-    }
-    else
-      c = it->second;
-    if ((a != b) && (a != c) && (b != c))
-      shelli.push_back({{a, b, c}});
-  }
-  for (auto& t : _triangles_vw) {
-    unsigned long a, b, c;
-    auto it = dPts.find(_vertices_vw[t.v0].second);
-    if (it == dPts.end()) {
-      a = dPts.size();
-      dPts[_vertices_vw[t.v0].second] = a;
-    }
-    else
-      a = it->second;
-    it = dPts.find(_vertices_vw[t.v1].second);
-    if (it == dPts.end()) {
-      b = dPts.size();
-      dPts[_vertices_vw[t.v1].second] = b;
-    }
-    else
-      b = it->second;
-    it = dPts.find(_vertices_vw[t.v2].second);
-    if (it == dPts.end()) {
-      c = dPts.size();
-      dPts[_vertices_vw[t.v2].second] = c;
+//-- the triangles as surfaces [[a,b,c]] of a CityJSON boundary, degenerate
+//-- triangles (after the vertices are snapped) are skipped
+void TopoFeature::get_cityjson_surfaces(std::ostream& of, VertexPool& vertices, bool& first) {
+  for (int vw = 0; vw < 2; vw++) {
+    std::vector< std::pair<Point3, std::string> >& verts = (vw == 0) ? _vertices : _vertices_vw;
+    for (auto& t : (vw == 0) ? _triangles : _triangles_vw) {
+      unsigned long a = vertices.add(verts[t.v0].first.get<0>(), verts[t.v0].first.get<1>(), verts[t.v0].first.get<2>());
+      unsigned long b = vertices.add(verts[t.v1].first.get<0>(), verts[t.v1].first.get<1>(), verts[t.v1].first.get<2>());
+      unsigned long c = vertices.add(verts[t.v2].first.get<0>(), verts[t.v2].first.get<1>(), verts[t.v2].first.get<2>());
+      if ((a != b) && (a != c) && (b != c)) {
+        of << (first ? "[[" : ",[[") << a << "," << b << "," << c << "]]";
+        first = false;
+      }
     }
-    else
-      c = it->second;
-    if ((a != b) && (a != c) && (b != c)) 
-      shelli.push_back({{a, b, c}});
   }
-  if (primitive == "MultiSurface")
-    g["boundaries"] = shelli;
-  else
-    g["boundaries"].push_back(shelli);
 }
 
-void TopoFeature::get_obj(std::unordered_map< std::string, unsigned long > &dPts, std::string mtl, std::string &fs) {
+//-- the lod is a number in CityJSON 0.8 and a string from CityJSON 1.0 (CityJSONSeq)
+void TopoFeature::get_cityjson_geom(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"MultiSurface\",\"lod\":" << (lod_string ? "\"1\"" : "1") << ",\"boundaries\":[";
+  bool first = true;
+  get_cityjson_surfaces(of, vertices, first);
+  of << "]}";
+}
+
+//-- the faces refer to the vertices by their id in the pool
+void TopoFeature::get_obj(VertexPool& vertices, std::string mtl, std::string &fs) {
   fs += mtl; fs += "\n";
   for (auto& t : _triangles) {
-    unsigned long a, b, c;
-    auto it = dPts.find(_vertices[t.v0].second);
-    if (it == dPts.end()) {
-      // first get the size + 1 and then store the size in dPts due to unspecified order of execution
-      a = dPts.size() + 1;
-      dPts[_vertices[t.v0].second] = a;
-    }
-    else
-      a = it->second;
-    it = dPts.find(_vertices[t.v1].second);
-    if (it == dPts.end()) {
-      b = dPts.size() + 1;
-      dPts[_vertices[t.v1].second] = b;
-    }
-    else
-      b = it->second;
-    it = dPts.find(_vertices[t.v2].second);
-    if (it == dPts.end()) {
-      c = dPts.size() + 1;
-      dPts[_vertices[t.v2].second] = c;
-    }
-    else
-      c = it->second;
-
+    unsigned long a = vertices.add(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), _vertices[t.v0].first.get<2>());
+    unsigned long b = vertices.add(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), _vertices[t.v1].first.get<2>());
+    unsigned long c = vertices.add(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), _vertices[t.v2].first.get<2>());
     if ((a != b) && (a != c) && (b != c)) {
-      fs += "f "; fs += std::to_string(a); fs += " "; fs += std::to_string(b); fs += " "; fs += std::to_string(c); fs += "\n";
+      write_obj_face(fs, a, b, c);
     }
   }
 
@@ -181,41 +150,45 @@ void TopoFeature::get_obj(std::unordered_map< std::string, unsigned long > &dPts
   if (_triangles_vw.size() > 0) {
     fs += mtl; fs += "Wall"; fs += "\n";
     for (auto& t : _triangles_vw) {
-      unsigned long a, b, c;
-      auto it = dPts.find(_vertices_vw[t.v0].second);
-      if (it == dPts.end()) {
-        a = dPts.size() + 1;
-        dPts[_vertices_vw[t.v0].second] = a;
-      }
-      else
-        a = it->second;
-      it = dPts.find(_vertices_vw[t.v1].second);
-      if (it == dPts.end()) {
-        b = dPts.size() + 1;
-        dPts[_vertices_vw[t.v1].second] = b;
-      }
-      else
-        b = it->second;
-      it = dPts.find(_vertices_vw[t.v2].second);
-      if (it == dPts.end()) {
-        c = dPts.size() + 1;
-        dPts[_vertices_vw[t.v2].second] = c;
-      }
-      else
-        c = it->second;
-
+      unsigned long a = vertices.add(_vertices_vw[t.v0].first.get<0>(), _vertices_vw[t.v0].first.get<1>(), _vertices_vw[t.v0].first.get<2>());
+      unsigned long b = vertices.add(_vertices_vw[t.v1].first.get<0>(), _vertices_vw[t.v1].first.get<1>(), _vertices_vw[t.v1].first.get<2>());
+      unsigned long c = vertices.add(_vertices_vw[t.v2].first.get<0>(), _vertices_vw[t.v2].first.get<1>(), _vertices_vw[t.v2].first.get<2>());
       if ((a != b) && (a != c) && (b != c)) {
-        fs += "f "; fs += std::to_string(a); fs += " "; fs += std::to_string(b); fs += " "; fs += std::to_string(c); fs += "\n";
+        write_obj_face(fs, a, b, c);
       }
     }
   }
 }
 
+void TopoFeature::get_glb(GLBMesh& mesh, std::string mtl) {
+  mesh.set_material(mtl);
+  for (auto& t : _triangles) {
+    unsigned long a = mesh.add_vertex(_vertices[t.v0].first.get<0>(), _vertices[t.v0].first.get<1>(), _vertices[t.v0].first.get<2>());
+    unsigned long b = mesh.add_vertex(_vertices[t.v1].first.get<0>(), _vertices[t.v1].first.get<1>(), _vertices[t.v1].first.get<2>());
+    unsigned long c = mesh.add_vertex(_vertices[t.v2].first.get<0>(), _vertices[t.v2].first.get<1>(), _vertices[t.v2].first.get<2>());
+    mesh.add_triangle(a, b, c);
+  }
+  get_glb_walls(mesh, mtl);
+}
+
+//-- the walls have the material of the class with "Wall", as in the OBJ
+void TopoFeature::get_glb_walls(GLBMesh& mesh, std::string mtl) {
+  if (_triangles_vw.size() > 0) {
+    mesh.set_material(mtl + "Wall");
+    for (auto& t : _triangles_vw) {
+      unsigned long a = mesh.add_vertex(_vertices_vw[t.v0].first.get<0>(), _vertices_vw[t.v0].first.get<1>(), _vertices_vw[t.v0].first.get<2>());
+      unsigned long b = mesh.add_vertex(_vertices_vw[t.v1].first.get<0>(), _vertices_vw[t.v1].first.get<1>(), _vertices_vw[t.v1].first.get<2>());
+      unsigned long c = mesh.add_vertex(_vertices_vw[t.v2].first.get<0>(), _vertices_vw[t.v2].first.get<1>(), _vertices_vw[t.v2].first.get<2>());
+      mesh.add_triangle(a, b, c);
+    }
+  }
+}
+
 AttributeMap &TopoFeature::get_attributes() {
   return _attributes;
 }
 
-void TopoFeature::get_imgeo_object_info(std::wostream& of, std::string id) {
+void TopoFeature::get_imgeo_object_info(TextWriter& of, std::string id) {
   std::string attribute;
   if (get_attribute("creationDate", attribute)) {
     of << "<imgeo:creationDate>" << attribute << "</imgeo:creationDate>";
@@ -266,15 +239,24 @@ void TopoFeature::get_imgeo_object_info(std::wostream& of, std::string id) {
     }
 }
 
-void TopoFeature::get_cityjson_attributes(nlohmann::json& f, const AttributeMap& attributes) {
+//-- the members of the "attributes" object, returns false when there are none
+bool TopoFeature::get_cityjson_attributes(std::ostream& of, const AttributeMap& attributes) {
+  bool first = true;
   for (auto& attribute : attributes) {
     // add attributes except gml_id
-    if (attribute.first.compare("gml_id") != 0) 
-      f["attributes"][std::get<0>(attribute)] = attribute.second.second;
+    if (attribute.first.compare("gml_id") != 0) {
+      if (!first)
+        of << ",";
+      write_json_string(of, attribute.first);
+      of << ":";
+      write_json_string(of, attribute.second.second);
+      first = false;
+    }
   }
+  return !first;
 }
 
-void TopoFeature::get_citygml_attributes(std::wostream& of, const AttributeMap& attributes) {
+void TopoFeature::get_citygml_attributes(TextWriter& of, const AttributeMap& attributes) {
   for (auto& attribute : attributes) {
     // add attributes except gml_id
     if (attribute.first.compare("gml_id") != 0) {
@@ -384,6 +366,14 @@ bool TopoFeature::writeAttribute(OGRFeature* feature, OGRFeatureDefn* featureDef
 }
 
 void TopoFeature::fix_bowtie() {
+  std::vector<AdjacentSegment> segments;
+  this->collect_adjacent_segments(segments);
+  this->fix_bowtie(segments);
+}
+
+//-- find for each segment ab of the polygon the adjacent polygon having segment ba,
+//-- only reads the geometry so it can run for all features concurrently
+void TopoFeature::collect_adjacent_segments(std::vector<AdjacentSegment>& segments) {
   //-- gather all rings
   std::vector<Ring2> therings;
   therings.push_back(_p2->outer());
@@ -391,9 +381,7 @@ void TopoFeature::fix_bowtie() {
     therings.push_back(iring);
 
   //-- process each vertex of the polygon separately
-  std::vector<int> anc, bnc;
   Point2 a, b;
-  TopoFeature* fadj;
   int ringi = -1;
   for (Ring2& ring : therings) {
     ringi++;
@@ -411,65 +399,81 @@ void TopoFeature::fix_bowtie() {
         bi = ai + 1;
       }
       //-- find the adjacent polygon to segment ab (fadj)
-      fadj = nullptr;
-      int adj_a_ringi = 0;
-      int adj_a_pi = 0;
-      int adj_b_ringi = 0;
-      int adj_b_pi = 0;
+      AdjacentSegment s;
+      s.ringi = ringi;
+      s.ai = ai;
+      s.bi = bi;
+      s.fadj = nullptr;
+      s.adj_a_ringi = 0;
+      s.adj_a_pi = 0;
+      s.adj_b_ringi = 0;
+      s.adj_b_pi = 0;
       for (auto& adj : *(_adjFeatures)) {
-        if (adj->has_segment(b, a, adj_b_ringi, adj_b_pi, adj_a_ringi, adj_a_pi) == true) {
-          // if (adj->has_segment(b, a) == true) {
-          fadj = adj;
+        if (adj->has_segment(b, a, s.adj_b_ringi, s.adj_b_pi, s.adj_a_ringi, s.adj_a_pi) == true) {
+          s.fadj = adj;
           break;
         }
       }
-      if (fadj == nullptr)
-        continue;
-      //-- check height differences: f > fadj for *both* Points a and b
-      int az = this->get_vertex_elevation(ringi, ai);
-      int bz = this->get_vertex_elevation(ringi, bi);
-      int fadj_az = fadj->get_vertex_elevation(adj_a_ringi, adj_a_pi);
-      int fadj_bz = fadj->get_vertex_elevation(adj_b_ringi, adj_b_pi);
+      if (s.fadj != nullptr)
+        segments.push_back(s);
+    }
+  }
+}
 
-      //-- Fix bow-ties
-      if (((az > fadj_az) && (bz < fadj_bz)) || ((az < fadj_az) && (bz > fadj_bz))) {
-        if (this->is_hard() && fadj->is_hard() == false) {
-          //- this is hard, snap the smallest height of the soft feature to this
-          if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
+void TopoFeature::fix_bowtie(const std::vector<AdjacentSegment>& segments) {
+  for (auto& s : segments) {
+    TopoFeature* fadj = s.fadj;
+    int ringi = s.ringi;
+    int ai = s.ai;
+    int bi = s.bi;
+    int adj_a_ringi = s.adj_a_ringi;
+    int adj_a_pi = s.adj_a_pi;
+    int adj_b_ringi = s.adj_b_ringi;
+    int adj_b_pi = s.adj_b_pi;
+    //-- check height differences: f > fadj for *both* Points a and b
+    int az = this->get_vertex_elevation(ringi, ai);
+    int bz = this->get_vertex_elevation(ringi, bi);
+    int fadj_az = fadj->get_vertex_elevation(adj_a_ringi, adj_a_pi);
+    int fadj_bz = fadj->get_vertex_elevation(adj_b_ringi, adj_b_pi);
+
+    //-- Fix bow-ties
+    if (((az > fadj_az) && (bz < fadj_bz)) || ((az < fadj_az) && (bz > fadj_bz))) {
+      if (this->is_hard() && fadj->is_hard() == false) {
+        //- this is hard, snap the smallest height of the soft feature to this
+        if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
+          fadj->set_vertex_elevation(adj_a_ringi, adj_a_pi, az);
+        }
+        else {
+          fadj->set_vertex_elevation(adj_b_ringi, adj_b_pi, bz);
+        }
+      }
+      else if (this->is_hard() == false && fadj->is_hard()) {
+        //- this is soft, snap the smallest height to the hard feature
+        if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
+          this->set_vertex_elevation(ringi, ai, fadj_az);
+        }
+        else {
+          this->set_vertex_elevation(ringi, bi, fadj_bz);
+        }
+      }
+      else {
+        if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
+          //- snap a to lowest
+          if (az < fadj_az) {
             fadj->set_vertex_elevation(adj_a_ringi, adj_a_pi, az);
           }
-          else {
-            fadj->set_vertex_elevation(adj_b_ringi, adj_b_pi, bz);
-          }
-        }
-        else if (this->is_hard() == false && fadj->is_hard()) {
-          //- this is soft, snap the smallest height to the hard feature
-          if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
+          else
+          {
             this->set_vertex_elevation(ringi, ai, fadj_az);
           }
-          else {
-            this->set_vertex_elevation(ringi, bi, fadj_bz);
-          }
         }
         else {
-          if (abs(az - fadj_az) < abs(bz - fadj_bz)) {
-            //- snap a to lowest
-            if (az < fadj_az) {
-              fadj->set_vertex_elevation(adj_a_ringi, adj_a_pi, az);
-            }
-            else
-            {
-              this->set_vertex_elevation(ringi, ai, fadj_az);
-            }
+          //- snap b to lowest
+          if (bz < fadj_bz) {
+            fadj->set_vertex_elevation(adj_b_ringi, adj_b_pi, bz);
           }
           else {
-            //- snap b to lowest
-            if (bz < fadj_bz) {
-              fadj->set_vertex_elevation(adj_b_ringi, adj_b_pi, bz);
-            }
-            else {
-              this->set_vertex_elevation(ringi, bi, fadj_bz);
-            }
+            this->set_vertex_elevation(ringi, bi, fadj_bz);
           }
         }
       }
@@ -910,7 +914,34 @@ void TopoFeature::cleanup_elevations() {
   _p2z.shrink_to_fit();
 }
 
-void TopoFeature::get_triangle_as_gml_surfacemember(std::wostream& of, Triangle& t, bool verticalwall) {
+//-- the elevations assigned to each vertex, per ring
+void TopoFeature::write_checkpoint(std::ostream& of) {
+  write_binary(of, std::uint32_t(_lidarelevs.size()));
+  for (auto& ring : _lidarelevs) {
+    write_binary(of, std::uint32_t(ring.size()));
+    for (auto& elevs : ring)
+      write_binary_vector(of, elevs);
+  }
+}
+
+//-- fails when the rings differ from the polygon, ie the checkpoint was made with other polygons
+bool TopoFeature::read_checkpoint(const char*& p, const char* end) {
+  std::uint32_t nrings;
+  if (!read_binary(p, end, nrings) || nrings != _lidarelevs.size())
+    return false;
+  for (auto& ring : _lidarelevs) {
+    std::uint32_t npts;
+    if (!read_binary(p, end, npts) || npts != ring.size())
+      return false;
+    for (auto& elevs : ring) {
+      if (!read_binary_vector(p, end, elevs))
+        return false;
+    }
+  }
+  return true;
+}
+
+void TopoFeature::get_triangle_as_gml_surfacemember(TextWriter& of, Triangle& t, bool verticalwall) {
   of << "<gml:surfaceMember>";
   of << "<gml:Polygon>";
   of << "<gml:exterior>";
@@ -935,29 +966,25 @@ void TopoFeature::get_triangle_as_gml_surfacemember(std::wostream& of, Triangle&
   of << "</gml:surfaceMember>";
 }
 
-void TopoFeature::get_floor_triangle_as_gml_surfacemember(std::wostream& of, Triangle& t, int baseheight) {
+void TopoFeature::get_floor_triangle_as_gml_surfacemember(TextWriter& of, Triangle& t, int baseheight) {
   of << "<gml:surfaceMember>";
   of << "<gml:Polygon>";
   of << "<gml:exterior>";
   of << "<gml:LinearRing>";
 
-  std::stringstream ss;
-  ss << std::fixed << std::setprecision(3);
   // replace z of the vertices with baseheight
-  ss << "<gml:posList>"
+  of << "<gml:posList>"
     << _vertices[t.v0].second.substr(0, _vertices[t.v0].second.find_last_of(" ") + 1) << std::setprecision(2) << z_to_float(baseheight) << std::setprecision(3) << " "
     << _vertices[t.v2].second.substr(0, _vertices[t.v2].second.find_last_of(" ") + 1) << std::setprecision(2) << z_to_float(baseheight) << std::setprecision(3) << " "
     << _vertices[t.v1].second.substr(0, _vertices[t.v1].second.find_last_of(" ") + 1) << std::setprecision(2) << z_to_float(baseheight) << std::setprecision(3) << " "
     << _vertices[t.v0].second.substr(0, _vertices[t.v0].second.find_last_of(" ") + 1) << std::setprecision(2) << z_to_float(baseheight) << std::setprecision(3) << "</gml:posList>";
-
-  of << ss.str();
   of << "</gml:LinearRing>";
   of << "</gml:exterior>";
   of << "</gml:Polygon>";
   of << "</gml:surfaceMember>";
 }
 
-void TopoFeature::get_triangle_as_gml_triangle(std::wostream& of, Triangle& t, bool verticalwall) {
+void TopoFeature::get_triangle_as_gml_triangle(TextWriter& of, Triangle& t, bool verticalwall) {
   of << "<gml:Triangle>";
   of << "<gml:exterior>";
   of << "<gml:LinearRing>";
@@ -1047,48 +1074,74 @@ void TopoFeature::lift_each_boundary_vertices(float percentile) {
 
   if (hasHeight) {// Skip setting heights if all heights are -9999
     //-- some vertices will have no values (no lidar point within tolerance thus)
-    //-- assign them the closest height in its ring
+    //-- assign them the height of the closest vertex in its ring that has one (the next one
+    //-- on ties), or interpolate between the previous and next ones with the distance along
+    //-- the ring. Two passes around the ring give for each vertex its previous and next vertex
+    //-- with a height; rings are cyclic so the search wraps around.
     ringi = -1;
     for (Ring2& ring : rings) {
       ringi++;
-      for (int i = 0; i < ring.size(); i++) {
-        if (_p2z[ringi][i] == -9999) {
-          // find closest previous or next vertex which does have a height and use it
-          int next = -9999;
-          int nextdistance = ring.size();
-          int prev = -9999;
-          int prevdistance = ring.size();
-          for (int nexti = i; nexti < ring.size(); nexti++) {
-            if (_p2z[ringi][nexti] != -9999) {
-              next = _p2z[ringi][nexti];
-              nextdistance = nexti - i;
-              break;
-            }
-          }
-          for (int previ = i; previ > 0; previ--) {
-            if (_p2z[ringi][previ] != -9999) {
-              prev = _p2z[ringi][previ];
-              prevdistance = i- previ;
-              break;
-            }
-          }
-          if (nextdistance <= prevdistance) {
-            _p2z[ringi][i] = next;
-          }
-          else if (prevdistance < nextdistance) {
-            _p2z[ringi][i] = prev;
+      std::vector<int>& z = _p2z[ringi];
+      int n = int(ring.size());
+      std::vector<int> prev(n, -1), next(n, -1);
+      int last = -1;
+      for (int k = 0; k < 2 * n; k++) {
+        int i = k % n;
+        if (z[i] != -9999)
+          last = i;
+        else if (k >= n)
+          prev[i] = last;
+      }
+      if (last == -1)
+        continue; //-- no height in this ring
+      last = -1;
+      for (int k = 2 * n - 1; k >= 0; k--) {
+        int i = k % n;
+        if (z[i] != -9999)
+          last = i;
+        else if (k < n)
+          next[i] = last;
+      }
+      //-- cumulative length along the ring, for the interpolation
+      std::vector<double> cumlength;
+      double ringlength = 0.0;
+      if (_lift_gap_interpolation) {
+        cumlength.resize(n);
+        for (int i = 0; i < n; i++) {
+          cumlength[i] = ringlength;
+          ringlength += distance(ring[i], ring[(i + 1) % n]);
+        }
+      }
+      std::vector<int> filled(z);
+      for (int i = 0; i < n; i++) {
+        if (z[i] != -9999)
+          continue;
+        int prevdistance = (i - prev[i] + n) % n;
+        int nextdistance = (next[i] - i + n) % n;
+        if (_lift_gap_interpolation && prev[i] != next[i]) {
+          double dprev = std::fmod(cumlength[i] - cumlength[prev[i]] + ringlength, ringlength);
+          double dnext = std::fmod(cumlength[next[i]] - cumlength[i] + ringlength, ringlength);
+          if (dprev + dnext > 0) {
+            filled[i] = int(std::round(z[prev[i]] + (z[next[i]] - z[prev[i]]) * dprev / (dprev + dnext)));
+            continue;
           }
         }
+        filled[i] = (nextdistance <= prevdistance) ? z[next[i]] : z[prev[i]];
       }
+      z.swap(filled);
     }
   }
 }
 
+void TopoFeature::set_lift_gap_interpolation(bool interpolate) {
+  _lift_gap_interpolation = interpolate;
+}
+
 //-------------------------------
 //-------------------------------
 
-Flat::Flat(char* wkt, std::string layername, AttributeMap attributes, std::string pid)
-  : TopoFeature(wkt, layername, attributes, pid) {}
+Flat::Flat(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid)
+  : TopoFeature(p2, layername, attributes, pid) {}
 
 int Flat::get_number_vertices() {
   // return int(2 * _vertices.size());
@@ -1128,11 +1181,20 @@ void Flat::cleanup_elevations() {
   TopoFeature::cleanup_elevations();
 }
 
+void Flat::write_checkpoint(std::ostream& of) {
+  TopoFeature::write_checkpoint(of);
+  write_binary_vector(of, _zvaluesinside);
+}
+
+bool Flat::read_checkpoint(const char*& p, const char* end) {
+  return (TopoFeature::read_checkpoint(p, end) && read_binary_vector(p, end, _zvaluesinside));
+}
+
 //-------------------------------
 //-------------------------------
 
-Boundary3D::Boundary3D(char* wkt, std::string layername, AttributeMap attributes, std::string pid)
-  : TopoFeature(wkt, layername, attributes, pid) {
+Boundary3D::Boundary3D(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid)
+  : TopoFeature(p2, layername, attributes, pid) {
 }
 
 int Boundary3D::get_number_vertices() {
@@ -1178,64 +1240,73 @@ void Boundary3D::detect_outliers(bool flatten){
     // itterate only if >6 points in the ring or the LS will not work
     if (ring.size() > 6) {
       // find spikes in roads (due to misclassified lidar points) and fix by averaging between previous and next vertex.
-      std::vector<int> idx;
       std::vector<double> x, y, z, coeffs;
       for (int i = 0; i < ring.size(); i++) {
-        idx.push_back(i);
         x.push_back(ring[i].x());
         y.push_back(ring[i].y());
         z.push_back(_p2z[ringi][i]);
       }
 
-      std::vector<double> xtmp = x, ytmp = y, ztmp = z;
-
+      // the outliers are removed one by one from the fit, which is downdated instead of refitted
+      // from scratch. An exact refit is done when the decision could depend on the round-off
+      // (maximum residual close to the threshold or to the second largest one) and for the fit
+      // whose coefficients are used below, so the results are the same as refitting every time.
+      polyfit3d_downdate<double> fit(x, y, z);
       int niter = _p2z[ringi].size() - 6;
       std::vector<int> indices;
       double se = 0;
       for (int i = 0; i < niter; i++) {
-        // Fit the model
-        std::vector<double> correctedvalues;
-        polyfit3d<double>(xtmp, ytmp, ztmp, coeffs, correctedvalues);
-        std::vector<double> residuals, absResiduals;
-
-        double sum = 0;
-        for (int j = 0; j < correctedvalues.size(); j++) {
-          absResiduals.push_back(abs(ztmp[j] - correctedvalues[j]));
+        bool exact = (i == 0 || i == niter - 1);
+        double max, max2;
+        int imax;
+        while (true) {
+          // Fit the model
+          fit.fit(coeffs, exact);
+          max = -1;
+          max2 = -1;
+          imax = 0;
+          double sum = 0;
+          for (int j = 0; j < z.size(); j++) {
+            if (fit.removed(j))
+              continue;
+            double res = abs(z[j] - fit.value(coeffs, j));
+            if (res > max) {
+              max2 = max;
+              max = res;
+              imax = j;
+            }
+            else if (res > max2) {
+              max2 = res;
+            }
+            if (i == 0) {
+              sum += z[j] - fit.value(coeffs, j);
+            }
+          }
           if (i == 0) {
-            double z = ztmp[j] - correctedvalues[j];
-            residuals.push_back(z);
-            sum += z;
+            int n = z.size();
+            double mean = sum / n;
+
+            double sq_sum = 0;
+            for (int j = 0; j < n; j++) {
+              double res = z[j] - fit.value(coeffs, j);
+              sq_sum += (res - mean) * (res - mean);
+            }
+
+            // Calculate standard deviation and 2 sigma
+            double stdev = sqrt(sq_sum / (n - 1));
+            se = 1.96 * stdev;
           }
-        }
-        if (i == 0) {
-          int n = residuals.size();
-          double mean = sum / n;
-
-          double sq_sum = 0;
-          std::for_each(residuals.begin(), residuals.end(), [&](const double res) {
-            sq_sum += (res - mean) * (res - mean);
-          });
-
-          // Calculate standard deviation and 2 sigma
-          double stdev = sqrt(sq_sum / (n - 1));
-          se = 1.96 * stdev;
+          double tol = 1e-6 * (1 + max);
+          if (exact || (max > se + tol && max - max2 > tol))
+            break;
+          exact = true;
         }
 
-        // Calculate the maximum residual
-        auto max = std::max_element(absResiduals.begin(), absResiduals.end());
         // remove outlier if larger then 2*standard deviation
-        if (*max > se) {
-          int imax = max - absResiduals.begin();
-          int vtx = idx[imax];
-
+        if (max > se) {
           // store the index of the vertex marked as an outlier
-          indices.push_back(vtx);
-
-          // remove the outlier from idx, xtmp, xtmp and xtmp arrays for next iteration
-          idx.erase(idx.begin() + imax);
-          xtmp.erase(xtmp.begin() + imax);
-          ytmp.erase(ytmp.begin() + imax);
-          ztmp.erase(ztmp.begin() + imax);
+          indices.push_back(imax);
+          fit.remove(imax);
         }
         else {
           break;
@@ -1262,10 +1333,11 @@ void Boundary3D::detect_outliers(bool flatten){
 //-------------------------------
 //-------------------------------
 
-TIN::TIN(char* wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer)
-  : TopoFeature(wkt, layername, attributes, pid) {
+TIN::TIN(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, int simplification, double simplification_tinsimp, float innerbuffer, TinSimpMethod simplification_tinsimp_method)
+  : TopoFeature(p2, layername, attributes, pid) {
   _simplification = simplification;
   _simplification_tinsimp = simplification_tinsimp;
+  _simplification_tinsimp_method = simplification_tinsimp_method;
   _innerbuffer = innerbuffer;
 }
 
@@ -1274,11 +1346,22 @@ int TIN::get_number_vertices() {
 }
 
 bool TIN::add_elevation_point(Point2& p, double z, float radius, int lasclass, bool within) {
-  bool toadd = false;
   // if within then a point must lay within the polygon, otherwise add
   if (!within || (within && point_in_polygon(p))) {
     assign_elevation_to_vertex(p, z, radius);
   }
+  //-- for a checkpoint keep all points, the thinning is done after it is written or read
+  if (_defer_thinning) {
+    if (point_in_polygon(p)) {
+      _lidarpts.push_back(Point3(p.x(), p.y(), z));
+    }
+    return true;
+  }
+  return add_lidar_point(p, z);
+}
+
+bool TIN::add_lidar_point(const Point2& p, double z) {
+  bool toadd = false;
   if (_simplification <= 1)
     toadd = true;
   else {
@@ -1301,6 +1384,249 @@ void TIN::cleanup_elevations() {
   TopoFeature::cleanup_elevations();
 }
 
+//-- apply the simplification and innerbuffer to the points kept with set_defer_thinning
+void TIN::thin_lidar_points() {
+  std::vector<Point3> pts;
+  pts.swap(_lidarpts);
+  for (auto& pt : pts) {
+    add_lidar_point(Point2(pt.get<0>(), pt.get<1>()), pt.get<2>());
+  }
+}
+
+void TIN::write_checkpoint(std::ostream& of) {
+  TopoFeature::write_checkpoint(of);
+  std::vector<double> coords;
+  coords.reserve(_lidarpts.size() * 3);
+  for (auto& pt : _lidarpts) {
+    coords.push_back(pt.get<0>());
+    coords.push_back(pt.get<1>());
+    coords.push_back(pt.get<2>());
+  }
+  write_binary_vector(of, coords);
+}
+
+bool TIN::read_checkpoint(const char*& p, const char* end) {
+  std::vector<double> coords;
+  if (!TopoFeature::read_checkpoint(p, end) || !read_binary_vector(p, end, coords) || coords.size() % 3 != 0)
+    return false;
+  _lidarpts.clear();
+  _lidarpts.reserve(coords.size() / 3);
+  for (std::size_t i = 0; i < coords.size(); i += 3) {
+    _lidarpts.push_back(Point3(coords[i], coords[i + 1], coords[i + 2]));
+  }
+  return true;
+}
+
+//-- static variables
+std::size_t TIN::_cdt_split_points = 0;
+double      TIN::_cdt_split_area = 0.0;
+int         TIN::_cdt_split_threads = 1;
+bool        TIN::_defer_thinning = false;
+
+void TIN::set_defer_thinning(bool defer) {
+  _defer_thinning = defer;
+}
+
+void TIN::set_cdt_split(std::size_t maxpoints, double maxarea, int threads) {
+  _cdt_split_points = maxpoints;
+  _cdt_split_area = maxarea;
+  _cdt_split_threads = threads;
+}
+
+//-- the number of strips in which the TIN is cut, 1 when it is within the point and
+//-- area budgets of cdt_split
+std::size_t TIN::get_cdt_strips() {
+  std::size_t nstrips = 1;
+  if (_cdt_split_points > 0 && _lidarpts.size() > _cdt_split_points)
+    nstrips = (_lidarpts.size() + _cdt_split_points - 1) / _cdt_split_points;
+  if (_cdt_split_area > 0) {
+    double area = bg::area(*_p2);
+    if (area > _cdt_split_area)
+      nstrips = std::max(nstrips, std::size_t(std::ceil(area / _cdt_split_area)));
+  }
+  return nstrips;
+}
+
 bool TIN::buildCDT() {
-  return getCDT(_p2, _p2z, _vertices, _triangles, _lidarpts, _simplification_tinsimp);
+  _tinsimp_stats = TinSimpStats();
+  if (_lidarpts.empty())
+    return TopoFeature::buildCDT();
+  //-- polygons above the point or area budget are cut in strips triangulated separately
+  std::size_t nstrips = get_cdt_strips();
+  if (nstrips > 1)
+    return buildCDT_split(nstrips);
+  return getCDT(_p2, _p2z, _vertices, _triangles, _lidarpts, _simplification_tinsimp, _simplification_tinsimp_method, &_tinsimp_stats, _cdt_validate);
+}
+
+//-- Triangulates the TIN in strips cut across the longest side of its bbox, in parallel,
+//-- and merges their meshes. The seams are constrained edges between the vertices of
+//-- the rings and seam points, which are lidar points close to the seam (one per
+//-- sample interval along it), so no vertex is added to the boundary shared with the
+//-- adjacent features and the seam points are vertices of the TIN without
+//-- simplification as well. The strips on both sides of a seam have the same edges,
+//-- their meshes are joined on these vertices. See splitCDT().
+bool TIN::buildCDT_split(std::size_t nstrips) {
+  Box2 bbox = bg::return_envelope<Box2>(*_p2);
+  int axis = ((bbox.max_corner().x() - bbox.min_corner().x()) >= (bbox.max_corner().y() - bbox.min_corner().y())) ? 0 : 1;
+  auto along = [axis](const Point3& p) { return (axis == 0) ? bg::get<0>(p) : bg::get<1>(p); };
+  auto across = [axis](const Point3& p) { return (axis == 0) ? bg::get<1>(p) : bg::get<0>(p); };
+  double lo = (axis == 0) ? bbox.min_corner().x() : bbox.min_corner().y();
+  double hi = (axis == 0) ? bbox.max_corner().x() : bbox.max_corner().y();
+  double olo = (axis == 0) ? bbox.min_corner().y() : bbox.min_corner().x();
+  double ohi = (axis == 0) ? bbox.max_corner().y() : bbox.max_corner().x();
+
+  //-- spacing of the seam points, about twice the average spacing of the lidar points
+  double spacing = 2.0 * std::sqrt(bg::area(*_p2) / std::max(_lidarpts.size(), std::size_t(1)));
+  spacing = std::min(std::max(spacing, 0.5), 10.0);
+
+  //-- seams at the quantiles of the lidar points so every strip gets about as many points,
+  //-- or at equal intervals when the area is what is over the budget; seams too close to
+  //-- each other are dropped
+  std::vector<double> candidates;
+  if (_cdt_split_points > 0 && _lidarpts.size() > _cdt_split_points) {
+    std::vector<double> c;
+    c.reserve(_lidarpts.size());
+    for (auto& pt : _lidarpts)
+      c.push_back(along(pt));
+    std::sort(c.begin(), c.end());
+    for (std::size_t k = 1; k < nstrips; k++)
+      candidates.push_back(c[k * c.size() / nstrips]);
+  }
+  else {
+    for (std::size_t k = 1; k < nstrips; k++)
+      candidates.push_back(lo + (hi - lo) * k / nstrips);
+  }
+  std::vector<double> seams;
+  for (double s : candidates) {
+    double prev = seams.empty() ? lo : seams.back();
+    if ((s - prev) >= spacing && (hi - s) >= spacing)
+      seams.push_back(s);
+  }
+  if (seams.empty())
+    return getCDT(_p2, _p2z, _vertices, _triangles, _lidarpts, _simplification_tinsimp, _simplification_tinsimp_method, &_tinsimp_stats, _cdt_validate);
+
+  //-- the seam points: in each interval of the spacing along a seam, the lidar point the
+  //-- closest to it, if it is within half the spacing
+  std::size_t nbins = std::size_t((ohi - olo) / spacing) + 1;
+  std::vector< std::vector<long> > closest(seams.size(), std::vector<long>(nbins, -1));
+  for (std::size_t i = 0; i < _lidarpts.size(); i++) {
+    double c = along(_lidarpts[i]);
+    std::size_t si = std::upper_bound(seams.begin(), seams.end(), c) - seams.begin();
+    std::size_t ni = (si < seams.size()) ? si : si - 1;
+    if (si > 0 && si < seams.size() && (c - seams[si - 1]) < (seams[si] - c))
+      ni = si - 1;
+    double d = std::abs(c - seams[ni]);
+    if (d > spacing / 2)
+      continue;
+    std::size_t bin = std::min(nbins - 1, std::size_t((across(_lidarpts[i]) - olo) / spacing));
+    long& best = closest[ni][bin];
+    if (best == -1 || d < std::abs(along(_lidarpts[best]) - seams[ni]))
+      best = long(i);
+  }
+  std::vector<Point3> seampts;
+  for (auto& seam : closest)
+    for (long i : seam)
+      if (i != -1)
+        seampts.push_back(_lidarpts[i]);
+
+  std::vector<CDTPart> parts;
+  splitCDT(_p2, _p2z, axis, seams, seampts, _lidarpts, parts);
+
+  //-- the strips run in parallel, unless the TIN is triangulated by a thread of the pool
+  //-- of Map3d::construct_CDT (the TINs to split are triangulated after the others)
+  std::size_t n = parts.size();
+  std::vector< std::vector< std::pair<Point3, std::string> > > svertices(n);
+  std::vector< std::vector<Triangle> > striangles(n);
+  std::vector<TinSimpStats> sstats(n);
+  std::vector<char> sok(n, 1);
+  parallel_for(n, _cdt_split_threads, [&](std::size_t si, int) {
+    if (!getCDT(parts[si], svertices[si], striangles[si], _simplification_tinsimp, _simplification_tinsimp_method, &sstats[si], _cdt_validate))
+      sok[si] = 0;
+    std::vector<Point3>().swap(parts[si].lidarpts);
+  });
+
+  //-- join the meshes on their shared vertices (the rings and the seams)
+  std::unordered_map<std::string, int> ids;
+  bool ok = true;
+  for (std::size_t si = 0; si < n; si++) {
+    ok = ok && sok[si];
+    std::vector<int> remap(svertices[si].size());
+    for (std::size_t i = 0; i < svertices[si].size(); i++) {
+      auto it = ids.find(svertices[si][i].second);
+      if (it == ids.end()) {
+        it = ids.insert(std::make_pair(svertices[si][i].second, int(_vertices.size()))).first;
+        _vertices.push_back(svertices[si][i]);
+      }
+      remap[i] = it->second;
+    }
+    for (auto& t : striangles[si]) {
+      Triangle tr;
+      tr.v0 = remap[t.v0];
+      tr.v1 = remap[t.v1];
+      tr.v2 = remap[t.v2];
+      _triangles.push_back(tr);
+    }
+    _tinsimp_stats.candidates += sstats[si].candidates;
+    _tinsimp_stats.inserted += sstats[si].inserted;
+    _tinsimp_stats.iterations += sstats[si].iterations;
+    _tinsimp_stats.updates += sstats[si].updates;
+  }
+  return ok;
+}
+
+//-- the TIN simplified again with the tinsimp of the CDT, for the coarse levels
+//-- of the 3D Tiles. The LiDAR points and the heights of the boundary are gone
+//-- by then (cleanup_elevations), so the vertices of the TIN are the points and
+//-- give back the heights of the rings: the boundary is unchanged and stays
+//-- stitched to the adjacent features. On failure the TIN is used as it is.
+void TIN::get_glb_simplified(GLBMesh& mesh, std::string mtl, double threshold) {
+  std::unordered_map<std::string, int> heights;
+  std::vector<Point3> pts;
+  pts.reserve(_vertices.size());
+  for (auto& v : _vertices) {
+    Point2 p(v.first.get<0>(), v.first.get<1>());
+    heights[gen_key_bucket(&p)] = int(std::round(v.first.get<2>() * 100));
+    pts.push_back(v.first);
+  }
+  std::vector< std::vector<int> > z;
+  std::vector<Ring2*> rings;
+  rings.push_back(&(_p2->outer()));
+  for (Ring2& iring : _p2->inners())
+    rings.push_back(&iring);
+  for (Ring2* ring : rings) {
+    z.push_back(std::vector<int>());
+    for (auto& p : *ring) {
+      auto it = heights.find(gen_key_bucket(&p));
+      if (it == heights.end()) {
+        TopoFeature::get_glb(mesh, mtl);
+        return;
+      }
+      z.back().push_back(it->second);
+    }
+  }
+  std::vector< std::pair<Point3, std::string> > vertices;
+  std::vector<Triangle> triangles;
+  try {
+    getCDT(_p2, z, vertices, triangles, pts, std::max(threshold, _simplification_tinsimp), _simplification_tinsimp_method, nullptr, false);
+  }
+  catch (std::exception&) {
+    TopoFeature::get_glb(mesh, mtl);
+    return;
+  }
+  mesh.set_material(mtl);
+  for (auto& t : triangles) {
+    unsigned long a = mesh.add_vertex(vertices[t.v0].first.get<0>(), vertices[t.v0].first.get<1>(), vertices[t.v0].first.get<2>());
+    unsigned long b = mesh.add_vertex(vertices[t.v1].first.get<0>(), vertices[t.v1].first.get<1>(), vertices[t.v1].first.get<2>());
+    unsigned long c = mesh.add_vertex(vertices[t.v2].first.get<0>(), vertices[t.v2].first.get<1>(), vertices[t.v2].first.get<2>());
+    mesh.add_triangle(a, b, c);
+  }
+  get_glb_walls(mesh, mtl);
+}
+
+const TinSimpStats& TIN::get_tinsimp_stats() {
+  return _tinsimp_stats;
+}
+
+std::size_t TIN::get_number_lidar_points() {
+  return _lidarpts.size();
 }
@@ -31,15 +31,33 @@
 
 #include "definitions.h"
 #include "geomtools.h"
+#include <atomic>
+#include "glb.h"
 #include "io.h"
 #include "polyfit.hpp"
-#include "nlohmann-json/json.hpp"
+#include "textwriter.h"
+#include "vertexpool.h"
 #include "ptinpoly.h"
 
+class TopoFeature;
+
+//-- segment ab of a polygon ring and the matching segment ba of the adjacent polygon
+typedef struct AdjacentSegment {
+  int ringi;
+  int ai;
+  int bi;
+  TopoFeature* fadj;
+  int adj_a_ringi;
+  int adj_a_pi;
+  int adj_b_ringi;
+  int adj_b_pi;
+} AdjacentSegment;
+
 class TopoFeature {
 public:
-  TopoFeature(char *wkt, std::string layername, AttributeMap attributes, std::string pid);
-  ~TopoFeature();
+  //-- takes ownership of p2, which is already corrected (see Map3d::add_feature)
+  TopoFeature(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid);
+  virtual ~TopoFeature();
 
   virtual bool          lift() = 0;
   virtual bool          buildCDT();
@@ -48,19 +66,26 @@ public:
   virtual TopoClass     get_class() = 0;
   virtual bool          is_hard() = 0;
   virtual std::string   get_mtl() = 0;
-  virtual void          get_citygml(std::wostream& of) = 0;
-  virtual void          get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long>& dPts) = 0;
-  virtual void          get_citygml_imgeo(std::wostream& of) = 0;
+  virtual void          get_citygml(TextWriter& of) = 0;
+  virtual void          get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) = 0;
+  virtual void          get_citygml_imgeo(TextWriter& of) = 0;
   virtual bool          get_shape(OGRLayer*, bool writeAttributes, const AttributeMap& extraAttributes = AttributeMap()) = 0;
   virtual void          cleanup_elevations() = 0;
+  virtual std::size_t   get_number_lidar_points();
+  virtual void          write_checkpoint(std::ostream& of);
+  virtual bool          read_checkpoint(const char*& p, const char* end);
 
   std::string  get_id();
   void         construct_vertical_walls(const NodeColumn& nc);
   void         fix_bowtie();
+  void         fix_bowtie(const std::vector<AdjacentSegment>& segments);
+  void         collect_adjacent_segments(std::vector<AdjacentSegment>& segments);
+  void         clear_triangulation();
+  std::size_t  get_number_triangles();
   void         add_adjacent_feature(TopoFeature* adjFeature);
   std::vector<TopoFeature*>* get_adjacent_features();
   Polygon2*    get_Polygon2();
-  Box2         get_bbox2d();
+  const Box2&  get_bbox2d();
   std::string  get_layername();
   Point2       get_point2(int ringi, int pi);
   bool         has_point2(const Point2& p, std::vector<int>& ringis, std::vector<int>& pis);
@@ -76,17 +101,24 @@ public:
   bool         get_top_level();
   bool         get_multipolygon_features(OGRLayer* layer, std::string className, bool writeAttributes, const AttributeMap& extraAttributes = AttributeMap());
   bool         writeAttribute(OGRFeature* feature, OGRFeatureDefn* featureDefn, std::string name, std::string value);
-  void         get_obj(std::unordered_map< std::string, unsigned long >& dPts, std::string mtl, std::string& fs);
+  void         get_obj(VertexPool& vertices, std::string mtl, std::string& fs);
+  void         get_glb(GLBMesh& mesh, std::string mtl);
   AttributeMap& get_attributes();
-  void         get_imgeo_object_info(std::wostream& of, std::string id);
-  void         get_citygml_attributes(std::wostream& of, const AttributeMap& attributes);
-  void         get_cityjson_attributes(nlohmann::json& f, const AttributeMap& attributes);
+  void         get_imgeo_object_info(TextWriter& of, std::string id);
+  void         get_citygml_attributes(TextWriter& of, const AttributeMap& attributes);
+  bool         get_cityjson_attributes(std::ostream& of, const AttributeMap& attributes);
+  static void  set_triangulation(bool fast, bool validate);
+  static void  set_lift_gap_interpolation(bool interpolate);
 protected:
+  static bool                       _fast_triangulation;
+  static bool                       _cdt_validate;
+  static bool                       _lift_gap_interpolation;
   Polygon2*                         _p2;
+  Box2                              _bbox2d;
   std::vector< std::vector<int> >   _p2z;
   std::vector<TopoFeature*>*        _adjFeatures;
   std::string                       _id;
-  bool                              _bVerticalWalls;
+  std::atomic<bool>                 _bVerticalWalls; //-- set concurrently by parallel stitching
   bool                              _toplevel;
   std::string                       _layername;
   AttributeMap                      _attributes;
@@ -101,13 +133,15 @@ protected:
   bool    assign_elevation_to_vertex(const Point2& p, double z, float radius);
   bool    within_range(const Point2& p, double radius);
   bool    point_in_polygon(const Point2& p);
+  void    get_glb_walls(GLBMesh& mesh, std::string mtl);
   void    lift_each_boundary_vertices(float percentile);
   void    lift_all_boundary_vertices_same_height(int height);
 
-  void get_cityjson_geom(nlohmann::json& g, std::unordered_map<std::string, unsigned long>& dPts, std::string primitive = "MultiSurface");
-  void get_triangle_as_gml_surfacemember(std::wostream& of, Triangle& t, bool verticalwall = false);
-  void get_floor_triangle_as_gml_surfacemember(std::wostream& of, Triangle& t, int baseheight);
-  void get_triangle_as_gml_triangle(std::wostream& of, Triangle& t, bool verticalwall = false);
+  void get_cityjson_geom(std::ostream& of, VertexPool& vertices, bool lod_string);
+  void get_cityjson_surfaces(std::ostream& of, VertexPool& vertices, bool& first);
+  void get_triangle_as_gml_surfacemember(TextWriter& of, Triangle& t, bool verticalwall = false);
+  void get_floor_triangle_as_gml_surfacemember(TextWriter& of, Triangle& t, int baseheight);
+  void get_triangle_as_gml_triangle(TextWriter& of, Triangle& t, bool verticalwall = false);
   bool get_attribute(std::string attributeName, std::string &attribute, std::string defaultValue = "");
 };
 
@@ -115,16 +149,18 @@ protected:
 
 class Flat: public TopoFeature {
 public:
-  Flat(char* wkt, std::string layername, AttributeMap attributes, std::string pid);
+  Flat(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid);
   int                 get_number_vertices();
   bool                add_elevation_point(Point2& p, double z, float radius, int lasclass, bool within);
   int                 get_height();
   virtual TopoClass   get_class() = 0;
   virtual bool        is_hard() = 0;
   virtual bool        lift() = 0;
-  virtual void        get_citygml(std::wostream& of) = 0;
-  virtual void        get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long>& dPts) = 0;
+  virtual void        get_citygml(TextWriter& of) = 0;
+  virtual void        get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) = 0;
   virtual void        cleanup_elevations() = 0;
+  void                write_checkpoint(std::ostream& of);
+  bool                read_checkpoint(const char*& p, const char* end);
 protected:
   std::vector<int>    _zvaluesinside;
   int                  _height_top;
@@ -135,14 +171,14 @@ protected:
 
 class Boundary3D: public TopoFeature {
 public:
-  Boundary3D(char* wkt, std::string layername, AttributeMap attributes, std::string pid);
+  Boundary3D(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid);
   int                  get_number_vertices();
   bool                 add_elevation_point(Point2& p, double z, float radius, int lasclass, bool within);
   virtual TopoClass    get_class() = 0;
   virtual bool         is_hard() = 0;
   virtual bool         lift() = 0;
-  virtual void         get_citygml(std::wostream& of) = 0;
-  virtual void         get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long>& dPts) = 0;
+  virtual void         get_citygml(TextWriter& of) = 0;
+  virtual void         get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) = 0;
   virtual void         cleanup_elevations() = 0;
   void                 detect_outliers(bool replace_all);
 protected:
@@ -154,21 +190,39 @@ protected:
 
 class TIN: public TopoFeature {
 public:
-  TIN(char* wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification = 0, double simplification_tinsimp = 0, float innerbuffer = 0);
+  TIN(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, int simplification = 0, double simplification_tinsimp = 0, float innerbuffer = 0, TinSimpMethod simplification_tinsimp_method = TINSIMP_GREEDY);
   int                 get_number_vertices();
   bool                add_elevation_point(Point2& p, double z, float radius, int lasclass, bool within);
   virtual TopoClass   get_class() = 0;
   virtual bool        is_hard() = 0;
   virtual bool        lift() = 0;
-  virtual void        get_citygml(std::wostream& of) = 0;
-  virtual void        get_cityjson(nlohmann::json& j, std::unordered_map<std::string, unsigned long>& dPts) = 0;
+  virtual void        get_citygml(TextWriter& of) = 0;
+  virtual void        get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) = 0;
   virtual void        cleanup_elevations() = 0;
   bool                buildCDT();
+  std::size_t         get_cdt_strips();
+  std::size_t         get_number_lidar_points();
+  const TinSimpStats& get_tinsimp_stats();
+  void                get_glb_simplified(GLBMesh& mesh, std::string mtl, double threshold);
+  static void         set_cdt_split(std::size_t maxpoints, double maxarea, int threads);
+  static void         set_defer_thinning(bool defer);
+  void                thin_lidar_points();
+  void                write_checkpoint(std::ostream& of);
+  bool                read_checkpoint(const char*& p, const char* end);
 protected:
   int                 _simplification;
   double              _simplification_tinsimp;
+  TinSimpMethod       _simplification_tinsimp_method;
   float               _innerbuffer;
   std::vector<Point3> _lidarpts;
+  TinSimpStats        _tinsimp_stats;
+  static std::size_t  _cdt_split_points;
+  static double       _cdt_split_area;
+  static int          _cdt_split_threads;
+  static bool         _defer_thinning;
+
+  bool                buildCDT_split(std::size_t nstrips);
+  bool                add_lidar_point(const Point2& p, double z);
 };
 
 #endif 
@@ -30,8 +30,8 @@
 
 float Water::_heightref;
 
-Water::Water(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Flat(wkt, layername, attributes, pid) {
+Water::Water(Polygon2* p2, std::string layername, AttributeMap attributes, std::string pid, float heightref)
+  : Flat(p2, layername, attributes, pid) {
   _heightref = heightref;
 }
 
@@ -60,18 +60,15 @@ bool Water::lift() {
   return true;
 }
 
-void Water::get_cityjson(nlohmann::json& j, std::unordered_map<std::string,unsigned long> &dPts) {
-  nlohmann::json f;
-  f["type"] = "WaterBody";
-  f["attributes"];
-  get_cityjson_attributes(f, _attributes);
-  nlohmann::json g;
-  this->get_cityjson_geom(g, dPts);
-  f["geometry"].push_back(g);
-  j["CityObjects"][this->get_id()] = f;
+void Water::get_cityjson(std::ostream& of, VertexPool& vertices, bool lod_string) {
+  of << "{\"type\":\"WaterBody\",\"attributes\":{";
+  get_cityjson_attributes(of, _attributes);
+  of << "},\"geometry\":[";
+  this->get_cityjson_geom(of, vertices, lod_string);
+  of << "]}";
 }
 
-void Water::get_citygml(std::wostream& of) {
+void Water::get_citygml(TextWriter& of) {
   of << "<cityObjectMember>";
   of << "<wtr:WaterBody gml:id=\"" << this->get_id() << "\">";
   get_citygml_attributes(of, _attributes);
@@ -87,7 +84,7 @@ void Water::get_citygml(std::wostream& of) {
   of << "</cityObjectMember>";
 }
 
-void Water::get_citygml_imgeo(std::wostream& of) {
+void Water::get_citygml_imgeo(TextWriter& of) {
   bool ondersteunend = _layername == "ondersteunendwaterdeel";
   of << "<cityObjectMember>";
   if (ondersteunend) {
@@ -0,0 +1,167 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- Compares the rtrees of Map3d::construct_rtree before and after packing:
+//-- R*-tree built by inserting one by one versus bulk-loaded (STR packing),
+//-- for the two queries 3dfier does: the boxes around the LiDAR points and
+//-- the adjacent features for the stitching.
+//--
+//-- usage: 3dfier-benchmark-rtree [number of features] [number of points]
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+typedef bg::model::d2::point_xy<double> Point2;
+typedef bg::model::box<Point2> Box2;
+typedef std::pair<Box2, std::size_t> PairIndexed;
+typedef bgi::rtree< PairIndexed, bgi::rstar<16> > RTree;
+
+const double TOPODIST = 0.001;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//-- a city-like partition: a grid of parcels of random width, so that
+//-- neighbouring boxes share their borders as the polygons of 3dfier do
+std::vector<PairIndexed> make_features(std::size_t n, std::mt19937& gen) {
+  std::uniform_real_distribution<double> width(5.0, 25.0);
+  std::size_t ncols = std::size_t(std::sqrt(double(n)));
+  std::vector<PairIndexed> features;
+  double y = 0.0;
+  while (features.size() < n) {
+    double h = width(gen);
+    double x = 0.0;
+    for (std::size_t c = 0; c < ncols && features.size() < n; c++) {
+      double w = width(gen);
+      features.push_back(std::make_pair(Box2(Point2(x, y), Point2(x + w, y + h)), features.size()));
+      x += w;
+    }
+    y += h;
+  }
+  return features;
+}
+
+std::size_t query_points(const RTree& rtree, const std::vector<Point2>& points, double radius) {
+  std::size_t found = 0;
+  std::vector<PairIndexed> re;
+  for (auto& p : points) {
+    re.clear();
+    Box2 querybox(Point2(p.x() - radius, p.y() - radius), Point2(p.x() + radius, p.y() + radius));
+    rtree.query(bgi::intersects(querybox), std::back_inserter(re));
+    found += re.size();
+  }
+  return found;
+}
+
+std::size_t query_adjacent(const RTree& rtree, const std::vector<PairIndexed>& features, bool scan) {
+  std::size_t found = 0;
+  std::vector<PairIndexed> re;
+  for (auto& f : features) {
+    re.clear();
+    const Box2& b = f.first;
+    auto near = bgi::satisfies([&](PairIndexed const& v) {return bg::distance(v.first, b) < TOPODIST; });
+    if (scan) {
+      rtree.query(near, std::back_inserter(re));
+    }
+    else {
+      Box2 querybox(Point2(b.min_corner().x() - TOPODIST, b.min_corner().y() - TOPODIST),
+        Point2(b.max_corner().x() + TOPODIST, b.max_corner().y() + TOPODIST));
+      rtree.query(bgi::intersects(querybox) && near, std::back_inserter(re));
+    }
+    found += re.size();
+  }
+  return found;
+}
+
+int main(int argc, const char* argv[]) {
+  std::size_t nfeatures = (argc > 1) ? std::stoul(argv[1]) : 200000;
+  std::size_t npoints = (argc > 2) ? std::stoul(argv[2]) : 2000000;
+  std::mt19937 gen(42);
+  std::vector<PairIndexed> features = make_features(nfeatures, gen);
+  Box2 extent;
+  bg::assign_inverse(extent);
+  for (auto& f : features) {
+    bg::expand(extent, f.first);
+  }
+  std::uniform_real_distribution<double> px(extent.min_corner().x(), extent.max_corner().x());
+  std::uniform_real_distribution<double> py(extent.min_corner().y(), extent.max_corner().y());
+  std::vector<Point2> points;
+  points.reserve(npoints);
+  for (std::size_t i = 0; i < npoints; i++) {
+    points.push_back(Point2(px(gen), py(gen)));
+  }
+  //-- the adjacency scan of the whole tree is quadratic, only time a sample of it
+  std::vector<PairIndexed> sample(features.begin(), features.begin() + std::min<std::size_t>(features.size(), 2000));
+  std::clog << features.size() << " features, " << points.size() << " points\n";
+
+  auto start = std::chrono::steady_clock::now();
+  RTree inserted;
+  for (auto& f : features) {
+    inserted.insert(f);
+  }
+  double tinsert = seconds_since(start);
+  start = std::chrono::steady_clock::now();
+  RTree packed(features.begin(), features.end());
+  double tpack = seconds_since(start);
+  std::clog << "build      inserted: " << tinsert << " s   packed: " << tpack << " s\n";
+
+  start = std::chrono::steady_clock::now();
+  std::size_t n1 = query_points(inserted, points, 1.0);
+  double t1 = seconds_since(start);
+  start = std::chrono::steady_clock::now();
+  std::size_t n2 = query_points(packed, points, 1.0);
+  double t2 = seconds_since(start);
+  std::clog << "points     inserted: " << npoints / t1 << " q/s   packed: " << npoints / t2 << " q/s\n";
+
+  start = std::chrono::steady_clock::now();
+  std::size_t n3 = query_adjacent(inserted, sample, true);
+  double t3 = seconds_since(start);
+  start = std::chrono::steady_clock::now();
+  std::size_t n4 = query_adjacent(packed, sample, false);
+  double t4 = seconds_since(start);
+  std::clog << "adjacent   inserted+scan: " << sample.size() / t3 << " q/s   packed+box: " << sample.size() / t4 << " q/s\n";
+
+  if (n1 != n2 || n3 != n4) {
+    std::cerr << "ERROR: the trees return different results.\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- Compares the two engines of the TIN simplification, greedy insertion
+//-- (TINSIMP_GREEDY) and batched refinement (TINSIMP_BATCH), on the Terrain and
+//-- Forest polygons of the example data (example_data/testarea_config.yml): the
+//-- time of construct_CDT(), the points inserted, the rounds and the triangles,
+//-- for a few values of simplification_tinsimp. The polygons and the LAS files
+//-- are read once, every run lifts them again from an in-memory checkpoint as the
+//-- lifting_options variants do.
+//--
+//-- Within one TIN the rounds of the batch engine are serial, the triangulation
+//-- is not thread-safe (CGAL locates with the random generator of the
+//-- triangulation). The threads are used over the features and, for a TIN above
+//-- cdt_split_points, over its strips; run with threads and cdt_split_points to
+//-- see how the engines scale.
+//--
+//-- usage: 3dfier-benchmark-tinsimp [example_data folder] [threads] [cdt_split_points]
+
+#include "../Map3d.h"
+#include "boost/locale.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void set_options(Map3d& map3d, int threads, int splitpoints, double threshold, TinSimpMethod method) {
+  map3d.set_threads(threads);
+  map3d.set_cdt_split_points(splitpoints);
+  map3d.set_terrain_simplification(0);
+  map3d.set_forest_simplification(0);
+  map3d.set_terrain_simplification_tinsimp(threshold);
+  map3d.set_forest_simplification_tinsimp(threshold);
+  map3d.set_terrain_simplification_tinsimp_method(method);
+  map3d.set_forest_simplification_tinsimp_method(method);
+  for (int c : { 2, 9 }) {
+    map3d.add_allowed_las_class(LAS_TERRAIN, c);
+    map3d.add_allowed_las_class(LAS_FOREST, c);
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  std::string folder = (argc > 1) ? argv[1] : "example_data";
+  int threads = (argc > 2) ? std::stoi(argv[2]) : 1;
+  int splitpoints = (argc > 3) ? std::stoi(argv[3]) : 0;
+  boost::locale::generator gen;
+  std::locale loc = gen("en_US.UTF-8");
+  std::locale::global(loc);
+  std::clog.imbue(loc);
+#if GDAL_VERSION_MAJOR < 2
+  if (OGRSFDriverRegistrar::GetRegistrar()->GetDriverCount() == 0)
+    OGRRegisterAll();
+#else
+  if (GDALGetDriverCount() == 0)
+    GDALAllRegister();
+#endif
+
+  std::vector<PolygonFile> polygonFiles;
+  for (auto& layer : { std::make_pair("bgt_onbegroeidterreindeel", "Terrain"), std::make_pair("bgt_begroeidterreindeel", "Forest") }) {
+    PolygonFile file;
+    file.filename = folder + "/bgt/" + layer.first + ".sqlite";
+    file.idfield = "gml_id";
+    file.heightfield = "relatievehoogteligging";
+    file.handle_multiple_heights = false;
+    file.layers.emplace_back(std::string(), layer.second);
+    polygonFiles.push_back(file);
+  }
+
+  //-- read the polygons and the points once
+  std::string polygons, assigned;
+  {
+    Map3d map3d;
+    set_options(map3d, threads, splitpoints, 0.1, TINSIMP_GREEDY);
+    if (!map3d.add_polygons_files(polygonFiles)) {
+      std::cerr << "ERROR: cannot read the polygons in " << folder << "/bgt\n";
+      return EXIT_FAILURE;
+    }
+    map3d.construct_rtree();
+    map3d.set_checkpoint_save(true);
+    for (std::string name : { "ahn3_cropped_1.laz", "ahn3_cropped_2.laz" }) {
+      PointFile file;
+      file.filename = folder + "/ahn3/" + name;
+      file.lasomits = { 0, 1 };
+      if (!map3d.add_las_file(file)) {
+        std::cerr << "ERROR: cannot read " << file.filename << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    std::ostringstream pss, css;
+    map3d.save_polygon_cache(pss);
+    map3d.save_checkpoint(css);
+    polygons = pss.str();
+    assigned = css.str();
+  }
+
+  std::cout << "threads " << threads << ", cdt_split_points " << splitpoints << "\n";
+  std::cout << "threshold  engine    time (s)  inserted  rounds  triangles\n";
+  for (double threshold : { 0.05, 0.1, 0.3, 1.0 }) {
+    for (TinSimpMethod method : { TINSIMP_GREEDY, TINSIMP_BATCH }) {
+      Map3d map3d;
+      set_options(map3d, threads, splitpoints, threshold, method);
+      if (!map3d.load_polygon_cache(polygons.data(), polygons.data() + polygons.size())) {
+        return EXIT_FAILURE;
+      }
+      map3d.construct_rtree();
+      if (!map3d.load_checkpoint(assigned.data(), assigned.data() + assigned.size())) {
+        return EXIT_FAILURE;
+      }
+      map3d.threeDfy();
+      auto start = std::chrono::steady_clock::now();
+      map3d.construct_CDT();
+      double t = seconds_since(start);
+      TinSimpStats stats;
+      std::size_t ntriangles = 0;
+      for (auto& f : map3d.get_polygons3d()) {
+        const TinSimpStats& s = dynamic_cast<TIN*>(f)->get_tinsimp_stats();
+        stats.inserted += s.inserted;
+        stats.iterations += s.iterations;
+        ntriangles += f->get_number_triangles();
+      }
+      std::cout << threshold << "\t   " << (method == TINSIMP_GREEDY ? "greedy" : "batch ") << "    "
+        << t << "\t" << stats.inserted << "\t" << stats.iterations << "\t" << ntriangles << "\n";
+    }
+  }
+  return EXIT_SUCCESS;
+}
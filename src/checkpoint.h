@@ -0,0 +1,121 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef __3DFIER__Checkpoint__
+#define __3DFIER__Checkpoint__
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//-- helpers for the binary checkpoint files of Map3d. Values are written in the
+//-- byte order of the machine; the reading side works on a memory-mapped file
+//-- and advances the pointer p, failing when it would read past end.
+
+template <typename T>
+inline void write_binary(std::ostream& of, const T& v) {
+  of.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+inline bool read_binary(const char*& p, const char* end, T& v) {
+  if (std::size_t(end - p) < sizeof(T))
+    return false;
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+template <typename T>
+inline void write_binary_vector(std::ostream& of, const std::vector<T>& v) {
+  write_binary(of, std::uint64_t(v.size()));
+  if (!v.empty())
+    of.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+}
+
+template <typename T>
+inline bool read_binary_vector(const char*& p, const char* end, std::vector<T>& v) {
+  std::uint64_t n;
+  if (!read_binary(p, end, n) || std::uint64_t(end - p) / sizeof(T) < n)
+    return false;
+  v.resize(std::size_t(n));
+  if (n > 0)
+    std::memcpy(v.data(), p, std::size_t(n) * sizeof(T));
+  p += std::size_t(n) * sizeof(T);
+  return true;
+}
+
+inline void write_binary_string(std::ostream& of, const std::string& s) {
+  write_binary(of, std::uint32_t(s.size()));
+  of.write(s.data(), s.size());
+}
+
+inline bool read_binary_string(const char*& p, const char* end, std::string& s) {
+  std::uint32_t n;
+  if (!read_binary(p, end, n) || std::size_t(end - p) < n)
+    return false;
+  s.assign(p, n);
+  p += n;
+  return true;
+}
+
+//-- flat arrays are padded to 8 bytes from the start of the file so that a
+//-- memory-mapped file can be used in place, without copying them
+inline void write_binary_padding(std::ostream& of) {
+  static const char zeros[8] = { 0 };
+  std::streamoff pos = of.tellp();
+  if (pos % 8 != 0)
+    of.write(zeros, 8 - pos % 8);
+}
+
+inline bool skip_binary_padding(const char*& p, const char* begin, const char* end) {
+  std::size_t pad = (8 - std::size_t(p - begin) % 8) % 8;
+  if (std::size_t(end - p) < pad)
+    return false;
+  p += pad;
+  return true;
+}
+
+template <typename T>
+inline void write_binary_array(std::ostream& of, const std::vector<T>& v) {
+  write_binary_padding(of);
+  write_binary_vector(of, v);
+}
+
+template <typename T>
+inline bool view_binary_array(const char*& p, const char* begin, const char* end, const T*& data, std::uint64_t& n) {
+  if (!skip_binary_padding(p, begin, end) || !read_binary(p, end, n) || std::uint64_t(end - p) / sizeof(T) < n)
+    return false;
+  data = reinterpret_cast<const T*>(p);
+  p += std::size_t(n) * sizeof(T);
+  return true;
+}
+
+#endif
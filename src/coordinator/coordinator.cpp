@@ -0,0 +1,489 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- 3dfier-coordinator: runs 3dfier in N processes, each with --shard i/N, on the
+//-- same machine and merges the tiles they write into one file per output.
+//-- The vertices shared by tiles (the seams) are written once in the merged file.
+
+#include "../vertexpool.h"
+#include "nlohmann-json/json.hpp"
+#include <ogrsf_frmts.h>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+std::vector<std::string> get_tile_files(std::string ofname);
+bool merge_obj(const std::vector<std::string>& files, std::string ofname);
+bool merge_cityjson(const std::vector<std::string>& files, std::string ofname);
+bool merge_cityjsonseq(const std::vector<std::string>& files, std::string ofname);
+bool merge_gdal(const std::vector<std::string>& files, std::string ofname, std::string drivername);
+void remap_boundaries(nlohmann::json& j, const std::vector<unsigned long>& remap);
+
+int main(int argc, const char * argv[]) {
+  //-- the outputs that can be merged, the others can be produced with 3dfier --shard directly
+  std::map<std::string, std::string> outputs;
+  outputs["OBJ"] = "";
+  outputs["CityJSON"] = "";
+  outputs["CityJSONSeq"] = "";
+  outputs["GPKG"] = "";
+  std::string f_yaml;
+  std::string exe3dfier;
+  int workers = std::max(1, int(std::thread::hardware_concurrency()));
+  bool keepshards = false;
+  try {
+    namespace po = boost::program_options;
+    po::options_description pomain("Allowed options");
+    pomain.add_options()
+      ("help", "View all options")
+      ("workers", po::value<int>(&workers), "Number of 3dfier processes (default: number of cores)")
+      ("3dfier", po::value<std::string>(&exe3dfier), "Path of the 3dfier executable (default: next to this one)")
+      ("keep-shards", "Keep the tile outputs and logs of the processes")
+      ("OBJ", po::value<std::string>(&outputs["OBJ"]), "Output ")
+      ("CityJSON", po::value<std::string>(&outputs["CityJSON"]), "Output ")
+      ("CityJSONSeq", po::value<std::string>(&outputs["CityJSONSeq"]), "Output ")
+      ("GPKG", po::value<std::string>(&outputs["GPKG"]), "Output ")
+      ;
+    po::options_description pohidden("Hidden options");
+    pohidden.add_options()
+      ("yaml", po::value<std::string>(&f_yaml), "Input config YAML file")
+      ;
+    po::positional_options_description popos;
+    popos.add("yaml", -1);
+
+    po::options_description poall;
+    poall.add(pomain).add(pohidden);
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).
+      options(poall).positional(popos).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << "Usage: 3dfier-coordinator config.yml --workers 8 --CityJSON myoutput.json" << std::endl;
+      std::cout << pomain << std::endl;
+      return EXIT_SUCCESS;
+    }
+    if (vm.count("yaml") == 0) {
+      std::cerr << "ERROR: one YAML config file must be specified." << std::endl;
+      std::cout << std::endl << pomain << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (boost::filesystem::exists(f_yaml) == false) {
+      std::cerr << "ERROR: YAML file " << f_yaml << " doesn't exist." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (workers < 1 || workers > 1024) {
+      std::cerr << "ERROR: workers must be between 1 and 1024." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (vm.count("keep-shards"))
+      keepshards = true;
+  }
+  catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  if (exe3dfier.empty()) {
+    boost::filesystem::path p = boost::filesystem::system_complete(argv[0]).parent_path() / "3dfier";
+    exe3dfier = p.string();
+  }
+
+  std::string args;
+  boost::filesystem::path logdir;
+  for (auto& output : outputs) {
+    if (output.second == "")
+      continue;
+    boost::filesystem::path p = boost::filesystem::absolute(output.second);
+    output.second = p.string();
+    logdir = p.parent_path();
+    args += " --" + output.first + " \"" + output.second + "\"";
+    //-- tiles left by a previous run would end up in the merged output
+    for (auto& f : get_tile_files(output.second))
+      boost::filesystem::remove(f);
+  }
+  if (args.empty()) {
+    std::cerr << "ERROR: no output specified." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //-- one thread per process, each waits for its 3dfier to finish
+  std::clog << "Running " << workers << " 3dfier processes\n";
+  std::vector<int> results(workers, 0);
+  std::vector<std::string> logs(workers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workers; i++) {
+    logs[i] = (logdir / ("3dfier_shard_" + std::to_string(i) + ".log")).string();
+    std::string cmd = "\"" + exe3dfier + "\" \"" + f_yaml + "\" --shard " + std::to_string(i) + "/" + std::to_string(workers) +
+      args + " > \"" + logs[i] + "\" 2>&1";
+    threads.emplace_back([&results, i, cmd]() {
+      results[i] = std::system(cmd.c_str());
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  bool wentgood = true;
+  for (int i = 0; i < workers; i++) {
+    if (results[i] != 0) {
+      std::cerr << "ERROR: shard " << i << "/" << workers << " failed, see " << logs[i] << std::endl;
+      wentgood = false;
+    }
+  }
+  if (!wentgood) {
+    return EXIT_FAILURE;
+  }
+
+  //-- merge the tiles of each output
+  for (auto& output : outputs) {
+    if (output.second == "")
+      continue;
+    std::vector<std::string> files = get_tile_files(output.second);
+    std::clog << output.first << " output: merging " << files.size() << " tiles in " << output.second << std::endl;
+    if (output.first == "OBJ")
+      wentgood = merge_obj(files, output.second);
+    else if (output.first == "CityJSON")
+      wentgood = merge_cityjson(files, output.second);
+    else if (output.first == "CityJSONSeq")
+      wentgood = merge_cityjsonseq(files, output.second);
+    else if (output.first == "GPKG")
+      wentgood = merge_gdal(files, output.second, "GPKG");
+    if (!wentgood) {
+      std::cerr << "ERROR: Merging the tiles failed for " << output.first << ". Aborting.\n";
+      return EXIT_FAILURE;
+    }
+    if (!keepshards) {
+      for (auto& f : files)
+        boost::filesystem::remove(f);
+    }
+  }
+  if (!keepshards) {
+    for (auto& l : logs)
+      boost::filesystem::remove(l);
+  }
+  return EXIT_SUCCESS;
+}
+
+//-- the files written by 3dfier for the tiles of an output: out.obj -> out_2_3.obj,
+//-- sorted by row and column so the merged output does not depend on the shards
+std::vector<std::string> get_tile_files(std::string ofname) {
+  boost::filesystem::path p(ofname);
+  std::regex special("[.^$|()\\[\\]{}*+?\\\\]");
+  std::regex re(std::regex_replace(p.stem().string(), special, "\\$&") + "_([0-9]+)_([0-9]+)" +
+    std::regex_replace(p.extension().string(), special, "\\$&"));
+  std::vector< std::tuple<int, int, std::string> > tiles;
+  boost::filesystem::path dir = p.parent_path();
+  if (dir.empty())
+    dir = boost::filesystem::current_path();
+  if (!boost::filesystem::is_directory(dir))
+    return std::vector<std::string>();
+  for (boost::filesystem::directory_iterator it(dir); it != boost::filesystem::directory_iterator(); ++it) {
+    std::smatch m;
+    std::string name = it->path().filename().string();
+    if (boost::filesystem::is_regular_file(*it) && std::regex_match(name, m, re))
+      tiles.emplace_back(std::stoi(m[2]), std::stoi(m[1]), it->path().string());
+  }
+  std::sort(tiles.begin(), tiles.end());
+  std::vector<std::string> files;
+  for (auto& t : tiles)
+    files.push_back(std::get<2>(t));
+  return files;
+}
+
+//-- two passes over the tiles: first the vertices, deduplicated on their text as
+//-- 3dfier writes them, then the faces with their indices remapped
+bool merge_obj(const std::vector<std::string>& files, std::string ofname) {
+  std::ofstream of(ofname);
+  if (!of.good()) {
+    std::cerr << "ERROR: cannot write " << ofname << std::endl;
+    return false;
+  }
+  of << "mtllib ./3dfier.mtl" << "\n";
+  std::unordered_map<std::string, unsigned long> dPts;
+  std::vector< std::vector<unsigned long> > remap(files.size());
+  std::string line;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    std::ifstream in(files[i]);
+    if (!in.good()) {
+      std::cerr << "ERROR: cannot open file " << files[i] << std::endl;
+      return false;
+    }
+    while (std::getline(in, line)) {
+      if (line.compare(0, 2, "v ") != 0)
+        continue;
+      std::string key = line.substr(2);
+      auto it = dPts.find(key);
+      if (it == dPts.end()) {
+        unsigned long id = (unsigned long)dPts.size() + 1;
+        it = dPts.insert(std::make_pair(key, id)).first;
+        of << line << "\n";
+      }
+      remap[i].push_back(it->second);
+    }
+  }
+  std::clog << "\t" << dPts.size() << " vertices\n";
+  dPts.clear();
+  for (std::size_t i = 0; i < files.size(); i++) {
+    std::ifstream in(files[i]);
+    while (std::getline(in, line)) {
+      if (line.empty() || line.compare(0, 2, "v ") == 0 || line.compare(0, 7, "mtllib ") == 0)
+        continue;
+      if (line.compare(0, 2, "f ") == 0) {
+        std::vector<std::string> ids;
+        std::string face = line.substr(2);
+        boost::split(ids, face, boost::is_any_of(" "), boost::token_compress_on);
+        of << "f";
+        for (auto& id : ids) {
+          if (id.empty())
+            continue;
+          unsigned long v = std::stoul(id);
+          if (v == 0 || v > remap[i].size()) {
+            std::cerr << "ERROR: invalid face in " << files[i] << ": " << line << std::endl;
+            return false;
+          }
+          of << " " << remap[i][v - 1];
+        }
+        of << "\n";
+      }
+      else {
+        of << line << "\n";
+      }
+    }
+  }
+  return true;
+}
+
+void remap_boundaries(nlohmann::json& j, const std::vector<unsigned long>& remap) {
+  if (j.is_array()) {
+    for (auto& e : j)
+      remap_boundaries(e, remap);
+  }
+  else if (j.is_number_integer()) {
+    j = remap[j.get<unsigned long>()];
+  }
+}
+
+//-- the tiles are read one at a time and their CityObjects written as they
+//-- come, only the vertices of all tiles are kept (deduplicated in a
+//-- VertexPool) to be written at the end with the metadata, as 3dfier does
+bool merge_cityjson(const std::vector<std::string>& files, std::string ofname) {
+  if (files.empty()) {
+    std::cerr << "ERROR: no tiles to merge in " << ofname << std::endl;
+    return false;
+  }
+  std::ofstream o(ofname);
+  nlohmann::json header;
+  nlohmann::json metadata;
+  VertexPool vertices;
+  std::vector<double> extent;
+  bool first = true;
+  for (auto& file : files) {
+    nlohmann::json jt;
+    try {
+      std::ifstream in(file);
+      in >> jt;
+    }
+    catch (std::exception& e) {
+      std::cerr << "ERROR: cannot read " << file << ": " << e.what() << std::endl;
+      return false;
+    }
+    if (header.is_null()) {
+      header["type"] = jt["type"];
+      header["version"] = jt["version"];
+      if (jt.count("transform") > 0)
+        header["transform"] = jt["transform"];
+      metadata = jt["metadata"];
+      std::string h = header.dump();
+      h.pop_back();
+      o << h << ",\"CityObjects\":{";
+    }
+    //-- the tiles share the transform of the tiling extent, so the integer vertices can be merged as they are
+    if (jt.count("transform") != header.count("transform") || (jt.count("transform") > 0 && jt["transform"] != header["transform"])) {
+      std::cerr << "ERROR: " << file << " has another transform than the first tile.\n";
+      return false;
+    }
+    if (jt["metadata"]["geographicalExtent"].size() == 6) {
+      std::vector<double> e = jt["metadata"]["geographicalExtent"].get< std::vector<double> >();
+      if (extent.empty())
+        extent = e;
+      for (int i = 0; i < 3; i++) {
+        extent[i] = std::min(extent[i], e[i]);
+        extent[i + 3] = std::max(extent[i + 3], e[i + 3]);
+      }
+    }
+    //-- without a transform the coordinates have the precision of VertexPool (mm for x-y, cm for z)
+    std::vector<unsigned long> remap;
+    remap.reserve(jt["vertices"].size());
+    for (auto& v : jt["vertices"]) {
+      if (header.count("transform") > 0) {
+        VertexPool::Vertex vi = { { v[0].get<long long>(), v[1].get<long long>(), v[2].get<long long>() } };
+        remap.push_back(vertices.add(vi));
+      }
+      else
+        remap.push_back(vertices.add(v[0].get<double>(), v[1].get<double>(), v[2].get<double>()));
+    }
+    for (auto it = jt["CityObjects"].begin(); it != jt["CityObjects"].end(); ++it) {
+      nlohmann::json& co = it.value();
+      for (auto& g : co["geometry"])
+        remap_boundaries(g["boundaries"], remap);
+      o << (first ? "" : ",") << nlohmann::json(it.key()).dump() << ":" << co.dump();
+      first = false;
+    }
+  }
+  o << "},\"vertices\":[";
+  first = true;
+  for (auto& v : vertices.vertices()) {
+    o << (first ? "[" : ",[");
+    if (header.count("transform") > 0)
+      o << v[0] << "," << v[1] << "," << v[2];
+    else {
+      write_fixed(o, v[0], 3);
+      o << ",";
+      write_fixed(o, v[1], 3);
+      o << ",";
+      write_fixed(o, v[2], 2);
+    }
+    o << "]";
+    first = false;
+  }
+  if (!extent.empty())
+    metadata["geographicalExtent"] = extent;
+  o << "],\"metadata\":" << metadata.dump() << "}" << std::endl;
+  std::clog << "\t" << vertices.size() << " vertices\n";
+  return o.good();
+}
+
+//-- the features of a CityJSONSeq have their own vertices, the lines of the
+//-- tiles are copied as they are after the header of the first tile (the tiles
+//-- share the transform)
+bool merge_cityjsonseq(const std::vector<std::string>& files, std::string ofname) {
+  nlohmann::json header;
+  for (auto& file : files) {
+    std::ifstream in(file);
+    std::string line;
+    nlohmann::json h;
+    try {
+      std::getline(in, line);
+      h = nlohmann::json::parse(line);
+    }
+    catch (std::exception& e) {
+      std::cerr << "ERROR: cannot read " << file << ": " << e.what() << std::endl;
+      return false;
+    }
+    if (header.is_null()) {
+      header = h;
+    }
+    else if (h["transform"] != header["transform"]) {
+      std::cerr << "ERROR: " << file << " has another transform than the first tile.\n";
+      return false;
+    }
+  }
+  if (header.is_null()) {
+    std::cerr << "ERROR: no tiles to merge in " << ofname << std::endl;
+    return false;
+  }
+  std::ofstream o(ofname, std::ios::out | std::ios::binary);
+  o << header.dump() << "\n";
+  unsigned long nfeatures = 0;
+  for (auto& file : files) {
+    std::ifstream in(file);
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+      if (!line.empty()) {
+        o << line << "\n";
+        nfeatures++;
+      }
+    }
+  }
+  std::clog << "\t" << nfeatures << " features\n";
+  return true;
+}
+
+//-- the layers of the tiles are appended to the layers with the same name
+bool merge_gdal(const std::vector<std::string>& files, std::string ofname, std::string drivername) {
+#if GDAL_VERSION_MAJOR < 2
+  std::cerr << "ERROR: merging " << drivername << " requires GDAL 2 or newer." << std::endl;
+  return false;
+#else
+  if (GDALGetDriverCount() == 0)
+    GDALAllRegister();
+  GDALDriver* driver = GetGDALDriverManager()->GetDriverByName(drivername.c_str());
+  if (driver == NULL) {
+    std::cerr << "ERROR: GDAL driver " << drivername << " not found." << std::endl;
+    return false;
+  }
+  GDALDataset* dataSource = driver->Create(ofname.c_str(), 0, 0, 0, GDT_Unknown, NULL);
+  if (dataSource == NULL) {
+    std::cerr << "ERROR: cannot write " << ofname << std::endl;
+    return false;
+  }
+  bool wentgood = true;
+  for (auto& file : files) {
+    GDALDataset* tile = (GDALDataset*)GDALOpenEx(file.c_str(), GDAL_OF_READONLY | GDAL_OF_VECTOR, NULL, NULL, NULL);
+    if (tile == NULL) {
+      std::cerr << "ERROR: cannot open file " << file << std::endl;
+      wentgood = false;
+      break;
+    }
+    for (int i = 0; i < tile->GetLayerCount(); i++) {
+      OGRLayer* src = tile->GetLayer(i);
+      OGRLayer* dst = dataSource->GetLayerByName(src->GetName());
+      if (dst == NULL) {
+        dst = dataSource->CopyLayer(src, src->GetName());
+        if (dst == NULL) {
+          wentgood = false;
+        }
+        continue;
+      }
+      dst->StartTransaction();
+      src->ResetReading();
+      OGRFeature* f;
+      while ((f = src->GetNextFeature()) != NULL) {
+        OGRFeature* nf = OGRFeature::CreateFeature(dst->GetLayerDefn());
+        nf->SetFrom(f);
+        if (dst->CreateFeature(nf) != OGRERR_NONE)
+          wentgood = false;
+        OGRFeature::DestroyFeature(nf);
+        OGRFeature::DestroyFeature(f);
+      }
+      dst->CommitTransaction();
+    }
+    GDALClose(tile);
+    if (!wentgood)
+      break;
+  }
+  GDALClose(dataSource);
+  return wentgood;
+#endif
+}
@@ -57,7 +57,8 @@ typedef enum {
    ROAD            = 3,
    TERRAIN         = 4,
    FOREST          = 5,
-   SEPARATION      = 6
+   SEPARATION      = 6,
+   NUM_TOPOCLASS   = 7
 } TopoClass;
 
 typedef enum {
@@ -35,23 +35,10 @@
 #include <CGAL/Triangulation_face_base_with_info_2.h>
 #include <CGAL/Polygon_2.h>
 
+#include <CGAL/spatial_sort.h>
+
 #include <vector>
-#include <unordered_set>
-#include <boost/heap/fibonacci_heap.hpp>
-
-// fibonacci heap for greedy insertion code
-struct point_error {
-  point_error(int i, double e) : index(i), error(e){}
-  int index;
-  double error;
-  
-  bool operator<(point_error const & rhs) const
-  {
-    return error < rhs.error;
-  }
-};
-typedef boost::heap::fibonacci_heap<point_error> Heap;
-typedef Heap::handle_type heap_handle;
+#include <algorithm>
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel			K;
 typedef CGAL::Projection_traits_xy_3<K>								Gt;
@@ -63,8 +50,7 @@ struct FaceInfo2
   bool in_domain() {
     return nesting_level % 2 == 1;
   }
-  std::vector<heap_handle>* points_inside = nullptr;
-  CGAL::Plane_3<K>* plane = nullptr;
+  int facedata = -1; //-- index in the FaceData pool of greedy_insert, or part of splitCDT
 };
 typedef CGAL::Triangulation_face_base_with_info_2<FaceInfo2, Gt>	Fbb;
 typedef CGAL::Constrained_triangulation_face_base_2<Gt, Fbb>		Fb;
@@ -74,23 +60,8 @@ typedef CGAL::Constrained_Delaunay_triangulation_2<Gt, Tds, Itag>	CDT;
 typedef CDT::Point													Point;
 typedef CGAL::Polygon_2<Gt>											Polygon_2;
 
-struct PointXYHash {
-  std::size_t operator()(Point const& p) const noexcept {
-    std::size_t h1 = std::hash<double>{}(p.x());
-    std::size_t h2 = std::hash<double>{}(p.y());
-    return h1 ^ (h2 << 1);
-  }
-};
-struct PointXYEqual {
-  bool operator()(Point const& p1, Point const& p2) const noexcept {
-    auto ex = p1.x() == p2.x();
-    auto ey = p1.y() == p2.y();
-    return ex && ey;
-  }
-};
-
-inline double compute_error(Point &p, CDT::Face_handle &face);
-void greedy_insert(CDT &T, const std::vector<Point3> &pts, double threshold);
+void greedy_insert(CDT &T, const std::vector<Point3> &pts, double threshold, TinSimpStats* stats);
+void batch_insert(CDT &T, const std::vector<Point3> &pts, double threshold, TinSimpStats* stats);
 
 void mark_domains(CDT& ct,
   CDT::Face_handle start,
@@ -99,11 +70,13 @@ void mark_domains(CDT& ct,
   if (start->info().nesting_level != -1) {
     return;
   }
-  std::list<CDT::Face_handle> queue;
+  //-- flood fill up to the constrained edges, the visiting order does not matter
+  thread_local std::vector<CDT::Face_handle> queue;
+  queue.clear();
   queue.push_back(start);
   while (!queue.empty()) {
-    CDT::Face_handle fh = queue.front();
-    queue.pop_front();
+    CDT::Face_handle fh = queue.back();
+    queue.pop_back();
     if (fh->info().nesting_level == -1) {
       fh->info().nesting_level = index;
       for (int i = 0; i < 3; i++) {
@@ -140,39 +113,30 @@ void mark_domains(CDT& cdt) {
   }
 }
 
-bool getCDT(Polygon2* pgn,
-  const std::vector< std::vector<int> > &z,
+//-- adds the lidar points to a CDT with its constraints, with the tinsimp or all of
+//-- them, and returns the vertices and the triangles inside the constrained domain
+void triangulate_domain(CDT &cdt,
   std::vector< std::pair<Point3, std::string> > &vertices,
   std::vector<Triangle> &triangles,
   const std::vector<Point3> &lidarpts,
-  double tinsimp_threshold) {
-  CDT cdt;
-
-  //-- gather all rings
-  std::vector<Ring2> rings;
-  rings.push_back(pgn->outer());
-  for (Ring2& iring : pgn->inners())
-    rings.push_back(iring);
-
-  Polygon_2 poly;
-  int ringi = -1;
-  for (Ring2& ring : rings) {
-    ringi++;
-    for (int i = 0; i < ring.size(); i++) {
-      poly.push_back(Point(bg::get<0>(ring[i]), bg::get<1>(ring[i]), z_to_float(z[ringi][i])));
-    }
-    cdt.insert_constraint(poly.vertices_begin(), poly.vertices_end(), true);
-    poly.clear();
-  }
-
+  double tinsimp_threshold,
+  TinSimpMethod tinsimp_method,
+  TinSimpStats* stats,
+  bool validate) {
   //-- add the lidar points to the CDT, if any
   if (lidarpts.size() > 0) {
-    if (tinsimp_threshold != 0)
-      greedy_insert(cdt, lidarpts, tinsimp_threshold);
+    if (tinsimp_threshold != 0 && tinsimp_method == TINSIMP_BATCH)
+      batch_insert(cdt, lidarpts, tinsimp_threshold, stats);
+    else if (tinsimp_threshold != 0)
+      greedy_insert(cdt, lidarpts, tinsimp_threshold, stats);
     else {
+      //-- range insertion: spatial sort and insertion with the previous vertex as locate hint
+      std::vector<Point> cpts;
+      cpts.reserve(lidarpts.size());
       for (auto &pt : lidarpts) {
-        cdt.insert(Point(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt)));
+        cpts.push_back(Point(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt)));
       }
+      cdt.insert(cpts.begin(), cpts.end());
     }
   }
 
@@ -180,11 +144,12 @@ bool getCDT(Polygon2* pgn,
   mark_domains(cdt);
 
   unsigned index = 0;
-  int count = 0;
 
-  if (!cdt.is_valid()) {
+  if (validate && !cdt.is_valid()) {
     throw std::runtime_error("CDT is invalid.");
   }
+  vertices.reserve(vertices.size() + cdt.number_of_vertices());
+  triangles.reserve(triangles.size() + cdt.number_of_faces());
   for (CDT::Finite_vertices_iterator vit = cdt.finite_vertices_begin();
     vit != cdt.finite_vertices_end(); ++vit) {
     Point3 p = Point3(vit->point().x(), vit->point().y(), vit->point().z());
@@ -200,9 +165,403 @@ bool getCDT(Polygon2* pgn,
       t.v1 = fit->vertex(1)->id();
       t.v2 = fit->vertex(2)->id();
       triangles.push_back(t);
-      count++;
     }
   }
+}
+
+//-- the rings of a polygon with their z as the points and constrained edges of a CDT
+void get_ring_constraints(Polygon2* pgn,
+  const std::vector< std::vector<int> > &z,
+  std::vector<Point> &cpts,
+  std::vector< std::pair<std::size_t, std::size_t> > &cedges) {
+  std::vector<Ring2*> rings;
+  rings.push_back(&(pgn->outer()));
+  for (Ring2& iring : pgn->inners())
+    rings.push_back(&iring);
+  cpts.clear();
+  cedges.clear();
+  int ringi = -1;
+  for (Ring2* ring : rings) {
+    ringi++;
+    std::size_t first = cpts.size();
+    for (int i = 0; i < ring->size(); i++) {
+      cpts.push_back(Point(bg::get<0>((*ring)[i]), bg::get<1>((*ring)[i]), z_to_float(z[ringi][i])));
+      cedges.push_back(std::make_pair(first + i, (i + 1 < ring->size()) ? first + i + 1 : first));
+    }
+  }
+}
+
+bool getCDT(Polygon2* pgn,
+  const std::vector< std::vector<int> > &z,
+  std::vector< std::pair<Point3, std::string> > &vertices,
+  std::vector<Triangle> &triangles,
+  const std::vector<Point3> &lidarpts,
+  double tinsimp_threshold,
+  TinSimpMethod tinsimp_method,
+  TinSimpStats* stats,
+  bool validate) {
+  CDT cdt;
+
+  //-- scratch buffers, reused for all the features triangulated by the same thread
+  thread_local std::vector<Point> cpts;
+  thread_local std::vector< std::pair<std::size_t, std::size_t> > cedges;
+
+  //-- insert all rings as constraints at once, CGAL spatially sorts the vertices
+  //-- before inserting them and then adds the constrained edges by index
+  get_ring_constraints(pgn, z, cpts, cedges);
+  cdt.insert_constraints(cpts.begin(), cpts.end(), cedges.begin(), cedges.end());
+
+  triangulate_domain(cdt, vertices, triangles, lidarpts, tinsimp_threshold, tinsimp_method, stats, validate);
+  return true;
+}
+
+//-- Cuts a polygon in parts along seams across the axis (0 for x, 1 for y) with a coarse
+//-- CDT of its rings and of the seam points: each triangle of the coarse CDT goes to the
+//-- strip of its centroid, and the edges between two strips form the seams. These
+//-- edges only join vertices of the rings and seam points, so the parts add no vertex
+//-- to the rings. The lidar points are given to the part in which they are; those on a
+//-- vertex or an edge of the coarse CDT are dropped, a seam must stay the same on both
+//-- sides.
+void splitCDT(Polygon2* pgn,
+  const std::vector< std::vector<int> > &z,
+  int axis,
+  const std::vector<double> &seams,
+  const std::vector<Point3> &seampts,
+  const std::vector<Point3> &lidarpts,
+  std::vector<CDTPart> &parts) {
+  CDT cdt;
+  std::vector<Point> cpts;
+  std::vector< std::pair<std::size_t, std::size_t> > cedges;
+  get_ring_constraints(pgn, z, cpts, cedges);
+  cdt.insert_constraints(cpts.begin(), cpts.end(), cedges.begin(), cedges.end());
+  CDT::Face_handle hint;
+  CDT::Locate_type lt;
+  int li;
+  for (auto& pt : seampts) {
+    Point p(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt));
+    CDT::Face_handle face = cdt.locate(p, lt, li, hint);
+    if (cdt.is_infinite(face) || lt == CDT::VERTEX || (lt == CDT::EDGE && cdt.is_constrained(CDT::Edge(face, li))))
+      continue;
+    hint = cdt.insert(p, face)->face();
+  }
+  mark_domains(cdt);
+
+  //-- the part of each face (-1 outside the domain), kept in the facedata of its info
+  parts.assign(seams.size() + 1, CDTPart());
+  for (CDT::All_faces_iterator fit = cdt.all_faces_begin(); fit != cdt.all_faces_end(); ++fit) {
+    fit->info().facedata = -1;
+    if (cdt.is_infinite(fit) || !fit->info().in_domain())
+      continue;
+    double c = 0.0;
+    for (int i = 0; i < 3; i++)
+      c += (axis == 0) ? fit->vertex(i)->point().x() : fit->vertex(i)->point().y();
+    fit->info().facedata = int(std::upper_bound(seams.begin(), seams.end(), c / 3) - seams.begin());
+  }
+
+  //-- the constrained edges of each part: the edges of the rings and of the seams
+  unsigned index = 0;
+  for (CDT::Finite_vertices_iterator vit = cdt.finite_vertices_begin(); vit != cdt.finite_vertices_end(); ++vit)
+    vit->id() = index++;
+  std::vector<std::size_t> local(index);
+  std::vector<std::size_t> stamp(index, 0);
+  for (std::size_t pi = 0; pi < parts.size(); pi++) {
+    CDTPart& part = parts[pi];
+    auto get_vertex = [&](CDT::Vertex_handle v) {
+      if (stamp[v->id()] != pi + 1) {
+        stamp[v->id()] = pi + 1;
+        local[v->id()] = part.vertices.size();
+        part.vertices.push_back(Point3(v->point().x(), v->point().y(), v->point().z()));
+      }
+      return local[v->id()];
+    };
+    for (CDT::Finite_faces_iterator fit = cdt.finite_faces_begin(); fit != cdt.finite_faces_end(); ++fit) {
+      if (fit->info().facedata != int(pi))
+        continue;
+      for (int i = 0; i < 3; i++) {
+        CDT::Face_handle n = fit->neighbor(i);
+        bool border = (n->info().facedata != int(pi));
+        //-- a constrained edge inside the part (rings touching) is seen from both sides
+        if (!border && cdt.is_constrained(CDT::Edge(fit, i)) && &*n < &*fit)
+          border = true;
+        if (border)
+          part.edges.push_back(std::make_pair(get_vertex(fit->vertex(cdt.ccw(i))), get_vertex(fit->vertex(cdt.cw(i)))));
+      }
+    }
+  }
+
+  for (auto& pt : lidarpts) {
+    Point p(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt));
+    CDT::Face_handle face = cdt.locate(p, lt, li, hint);
+    if (cdt.is_infinite(face) || lt != CDT::FACE || face->info().facedata == -1)
+      continue;
+    hint = face;
+    parts[face->info().facedata].lidarpts.push_back(pt);
+  }
+
+  for (CDT::All_faces_iterator fit = cdt.all_faces_begin(); fit != cdt.all_faces_end(); ++fit) {
+    fit->info().facedata = -1;
+  }
+}
+
+bool getCDT(const CDTPart &part,
+  std::vector< std::pair<Point3, std::string> > &vertices,
+  std::vector<Triangle> &triangles,
+  double tinsimp_threshold,
+  TinSimpMethod tinsimp_method,
+  TinSimpStats* stats,
+  bool validate) {
+  CDT cdt;
+  std::vector<Point> cpts;
+  cpts.reserve(part.vertices.size());
+  for (auto& pt : part.vertices)
+    cpts.push_back(Point(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt)));
+  cdt.insert_constraints(cpts.begin(), cpts.end(), part.edges.begin(), part.edges.end());
+  triangulate_domain(cdt, vertices, triangles, part.lidarpts, tinsimp_threshold, tinsimp_method, stats, validate);
+  return true;
+}
+
+//-- Ear clipping of a polygon without interior points, the holes are first bridged to the
+//-- outer ring. Returns false, leaving the output untouched, for inputs it cannot handle
+//-- (too many vertices, duplicate vertices, no ear found, result not covering the polygon)
+//-- so the caller can use the CDT instead.
+bool getEarClipping(Polygon2* pgn,
+  const std::vector< std::vector<int> > &z,
+  std::vector< std::pair<Point3, std::string> > &vertices,
+  std::vector<Triangle> &triangles) {
+  const std::size_t maxvertices = 1000;
+  //-- gather all rings
+  std::vector<Ring2*> rings;
+  rings.push_back(&(pgn->outer()));
+  for (Ring2& iring : pgn->inners())
+    rings.push_back(&iring);
+
+  std::vector<Point2> pts;
+  std::vector< std::vector<int> > ringids;
+  for (Ring2* ring : rings) {
+    if (ring->size() < 3)
+      return false;
+    ringids.push_back(std::vector<int>());
+    for (auto& p : *ring) {
+      ringids.back().push_back(int(pts.size()));
+      pts.push_back(p);
+    }
+  }
+  if (pts.size() > maxvertices)
+    return false;
+  //-- touching rings or repeated vertices are left to the CDT
+  std::vector<int> sorted(pts.size());
+  for (int i = 0; i < int(pts.size()); i++)
+    sorted[i] = i;
+  std::sort(sorted.begin(), sorted.end(), [&pts](int a, int b) {
+    return (pts[a].x() < pts[b].x()) || (pts[a].x() == pts[b].x() && pts[a].y() < pts[b].y());
+  });
+  for (std::size_t i = 1; i < sorted.size(); i++)
+    if (pts[sorted[i]].x() == pts[sorted[i - 1]].x() && pts[sorted[i]].y() == pts[sorted[i - 1]].y())
+      return false;
+
+  auto orient = [](const Point2& a, const Point2& b, const Point2& c) {
+    return (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+  };
+  auto cross = [&pts, &orient](int a, int b, int c) {
+    return orient(pts[a], pts[b], pts[c]);
+  };
+  auto signed_area = [&pts](const std::vector<int>& r) {
+    //-- relative to the first vertex, the coordinates are large
+    double a = 0.0;
+    const Point2& o = pts[r[0]];
+    for (std::size_t i = 0; i < r.size(); i++) {
+      const Point2& p = pts[r[i]];
+      const Point2& q = pts[r[(i + 1) % r.size()]];
+      a += (p.x() - o.x()) * (q.y() - o.y()) - (q.x() - o.x()) * (p.y() - o.y());
+    }
+    return a / 2;
+  };
+  //-- outer ring ccw, holes cw
+  if (signed_area(ringids[0]) < 0)
+    std::reverse(ringids[0].begin(), ringids[0].end());
+  for (std::size_t i = 1; i < ringids.size(); i++)
+    if (signed_area(ringids[i]) > 0)
+      std::reverse(ringids[i].begin(), ringids[i].end());
+
+  //-- bridge the holes to the outer ring, from the rightmost one: a ray from the rightmost
+  //-- vertex M of the hole hits an edge of the outer chain, M is connected to the endpoint
+  //-- of that edge or to the reflex vertex inside the triangle with the smallest angle to the ray
+  std::vector<int> chain = ringids[0];
+  std::vector<std::size_t> holes;
+  for (std::size_t i = 1; i < ringids.size(); i++)
+    holes.push_back(i);
+  auto rightmost = [&pts, &ringids](std::size_t h) {
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < ringids[h].size(); i++)
+      if (pts[ringids[h][i]].x() > pts[ringids[h][best]].x())
+        best = i;
+    return best;
+  };
+  std::sort(holes.begin(), holes.end(), [&](std::size_t a, std::size_t b) {
+    return pts[ringids[a][rightmost(a)]].x() > pts[ringids[b][rightmost(b)]].x();
+  });
+  for (std::size_t h : holes) {
+    std::size_t mi = rightmost(h);
+    const Point2 m = pts[ringids[h][mi]];
+    double bestx = std::numeric_limits<double>::max();
+    int bestp = -1;
+    for (std::size_t i = 0; i < chain.size(); i++) {
+      const Point2& a = pts[chain[i]];
+      const Point2& b = pts[chain[(i + 1) % chain.size()]];
+      //-- edges going up (the interior is on their left) and straddling the ray
+      if (a.y() > m.y() || b.y() < m.y() || a.y() == b.y())
+        continue;
+      double x = a.x() + (m.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y());
+      if (x < m.x() || x >= bestx)
+        continue;
+      bestx = x;
+      if (a.y() == m.y())
+        bestp = int(i);
+      else if (b.y() == m.y())
+        bestp = int((i + 1) % chain.size());
+      else
+        bestp = (a.x() > b.x()) ? int(i) : int((i + 1) % chain.size());
+    }
+    if (bestp == -1)
+      return false;
+    //-- P itself or the reflex vertex inside the triangle (M, I, P) with the smallest angle to the
+    //-- ray; with several copies of a vertex (previous bridges) the one whose interior angle
+    //-- contains M is taken
+    const Point2 p = pts[chain[bestp]];
+    const Point2 ip(bestx, m.y());
+    auto locally_inside = [&](std::size_t i) {
+      const Point2& a = pts[chain[(i + chain.size() - 1) % chain.size()]];
+      const Point2& v = pts[chain[i]];
+      const Point2& b = pts[chain[(i + 1) % chain.size()]];
+      if (orient(a, v, b) > 0)
+        return (orient(a, v, m) > 0 && orient(v, b, m) > 0);
+      return (orient(a, v, m) > 0 || orient(v, b, m) > 0);
+    };
+    double bestangle = std::numeric_limits<double>::max();
+    int candidate = -1;
+    for (std::size_t i = 0; i < chain.size(); i++) {
+      const Point2& v = pts[chain[i]];
+      bool isp = (v.x() == p.x() && v.y() == p.y());
+      if (!isp) {
+        if (v.x() < m.x() || p.y() == m.y())
+          continue;
+        double d1 = orient(m, ip, v);
+        double d2 = orient(ip, p, v);
+        double d3 = orient(p, m, v);
+        if (!((d1 > 0 && d2 > 0 && d3 > 0) || (d1 < 0 && d2 < 0 && d3 < 0)))
+          continue;
+        if (orient(pts[chain[(i + chain.size() - 1) % chain.size()]], v, pts[chain[(i + 1) % chain.size()]]) > 0)
+          continue;
+      }
+      double angle = std::abs(std::atan2(v.y() - m.y(), v.x() - m.x()));
+      if (candidate == -1 || angle < bestangle ||
+          (angle == bestangle && bg::comparable_distance(m, v) < bg::comparable_distance(m, pts[chain[candidate]])) ||
+          (pts[chain[i]].x() == pts[chain[candidate]].x() && pts[chain[i]].y() == pts[chain[candidate]].y() && !locally_inside(candidate) && locally_inside(i))) {
+        bestangle = angle;
+        candidate = int(i);
+      }
+    }
+    bestp = candidate;
+    //-- outer ... P, M, hole ..., M, P ... outer
+    std::vector<int> merged(chain.begin(), chain.begin() + bestp + 1);
+    for (std::size_t i = 0; i <= ringids[h].size(); i++)
+      merged.push_back(ringids[h][(mi + i) % ringids[h].size()]);
+    merged.insert(merged.end(), chain.begin() + bestp, chain.end());
+    chain.swap(merged);
+  }
+
+  //-- clip the ears, the vertices in the chain are in a doubly linked list
+  std::size_t n = chain.size();
+  std::vector<std::size_t> prev(n), next(n);
+  for (std::size_t i = 0; i < n; i++) {
+    prev[i] = (i + n - 1) % n;
+    next[i] = (i + 1) % n;
+  }
+  auto is_ear = [&](std::size_t i) {
+    int a = chain[prev[i]];
+    int b = chain[i];
+    int c = chain[next[i]];
+    if (cross(a, b, c) <= 0)
+      return false;
+    for (std::size_t j = next[next[i]]; j != prev[i]; j = next[j]) {
+      int v = chain[j];
+      if (v == a || v == b || v == c) {
+        //-- another copy of a corner (holes bridged to it), its edges must not enter the triangle
+        int x = (v == a) ? a : ((v == b) ? b : c);
+        int l = (v == a) ? b : ((v == b) ? c : a);
+        int r = (v == a) ? c : ((v == b) ? a : b);
+        for (int d : { chain[prev[j]], chain[next[j]] })
+          if (cross(x, l, d) > 0 && cross(x, r, d) < 0)
+            return false;
+        continue;
+      }
+      if (cross(chain[prev[j]], v, chain[next[j]]) > 0)
+        continue; //-- convex vertices cannot be inside an ear
+      if (cross(a, b, v) >= 0 && cross(b, c, v) >= 0 && cross(c, a, v) >= 0)
+        return false;
+    }
+    return true;
+  };
+  std::vector<Triangle> tris;
+  tris.reserve(n);
+  std::size_t remaining = n;
+  std::size_t cur = 0;
+  std::size_t stop = cur;
+  while (remaining > 3) {
+    if (is_ear(cur)) {
+      Triangle t;
+      t.v0 = chain[prev[cur]];
+      t.v1 = chain[cur];
+      t.v2 = chain[next[cur]];
+      tris.push_back(t);
+      next[prev[cur]] = next[cur];
+      prev[next[cur]] = prev[cur];
+      remaining--;
+      cur = next[cur];
+      stop = cur;
+    }
+    else {
+      cur = next[cur];
+      if (cur == stop)
+        return false;
+    }
+  }
+  if (cross(chain[prev[cur]], chain[cur], chain[next[cur]]) <= 0)
+    return false;
+  Triangle t;
+  t.v0 = chain[prev[cur]];
+  t.v1 = chain[cur];
+  t.v2 = chain[next[cur]];
+  tris.push_back(t);
+
+  //-- the triangles have to cover the polygon exactly
+  if (tris.size() != pts.size() + 2 * holes.size() - 2)
+    return false;
+  double area = 0.0;
+  for (auto& tri : tris)
+    area += cross(tri.v0, tri.v1, tri.v2) / 2;
+  double parea = signed_area(ringids[0]);
+  for (std::size_t i = 1; i < ringids.size(); i++)
+    parea += signed_area(ringids[i]);
+  if (std::abs(area - parea) > 1e-6 * std::abs(parea))
+    return false;
+
+  std::size_t offset = vertices.size();
+  vertices.reserve(offset + pts.size());
+  int ringi = -1;
+  for (Ring2* ring : rings) {
+    ringi++;
+    for (int i = 0; i < ring->size(); i++) {
+      Point3 p = Point3(bg::get<0>((*ring)[i]), bg::get<1>((*ring)[i]), z_to_float(z[ringi][i]));
+      vertices.push_back(std::make_pair(p, gen_key_bucket(&p)));
+    }
+  }
+  for (auto& tri : tris) {
+    tri.v0 += int(offset);
+    tri.v1 += int(offset);
+    tri.v2 += int(offset);
+    triangles.push_back(tri);
+  }
   return true;
 }
 
@@ -238,104 +597,343 @@ double sqr_distance(const Point2 &p1, const Point2 &p2) {
 
 //--- TIN Simplification
 // Greedy insertion/incremental refinement algorithm adapted from "Fast polygonal approximation of terrain and height fields" by Garland, Michael and Heckbert, Paul S.
-inline double compute_error(Point &p, CDT::Face_handle &face) {
-  if(!face->info().plane)
-    face->info().plane = new CGAL::Plane_3<K>(
-      face->vertex(0)->point(),
-      face->vertex(1)->point(),
-      face->vertex(2)->point());
-  if(!face->info().points_inside)
-    face->info().points_inside = new std::vector<heap_handle>();
-
-  auto plane = face->info().plane;
-  auto interpolate = - plane->a()/plane->c() * p.x() - plane->b()/plane->c()*p.y() - plane->d()/plane->c();
-  double error = std::fabs(interpolate - p.z());
-  return error;
+
+//-- plane of a face as z = a*x + b*y + c and the candidate points inside it, the
+//-- FaceData are pooled and recycled when the face is destroyed by an insertion
+struct FaceData {
+  double a, b, c;
+  std::vector<int> points;
+  bool used = false;
+};
+
+//-- indexed max-heap with 4 children per node on the point errors, the position
+//-- of each point in the heap is tracked so its error can be updated in place
+class ErrorHeap {
+public:
+  void reset(std::size_t npts) {
+    _heap.clear();
+    _errors.assign(npts, 0.0);
+    _pos.assign(npts, -1);
+  }
+  bool empty() const { return _heap.empty(); }
+  int top() const { return _heap[0]; }
+  double top_error() const { return _errors[_heap[0]]; }
+  void push(int i, double e) {
+    _errors[i] = e;
+    _pos[i] = int(_heap.size());
+    _heap.push_back(i);
+    sift_up(_pos[i]);
+  }
+  void pop() {
+    remove(_heap[0]);
+  }
+  void remove(int i) {
+    int hi = _pos[i];
+    int last = _heap.back();
+    _heap.pop_back();
+    _pos[i] = -1;
+    if (last != i) {
+      _heap[hi] = last;
+      _pos[last] = hi;
+      sift_down(hi);
+      sift_up(_pos[last]);
+    }
+  }
+  void update(int i, double e) {
+    double old = _errors[i];
+    _errors[i] = e;
+    if (e > old)
+      sift_up(_pos[i]);
+    else
+      sift_down(_pos[i]);
+  }
+private:
+  std::vector<int>    _heap;
+  std::vector<double> _errors;
+  std::vector<int>    _pos;
+  void place(int hi, int i) {
+    _heap[hi] = i;
+    _pos[i] = hi;
+  }
+  void sift_up(int hi) {
+    int i = _heap[hi];
+    while (hi > 0) {
+      int parent = (hi - 1) / 4;
+      if (_errors[_heap[parent]] >= _errors[i])
+        break;
+      place(hi, _heap[parent]);
+      hi = parent;
+    }
+    place(hi, i);
+  }
+  void sift_down(int hi) {
+    int i = _heap[hi];
+    int n = int(_heap.size());
+    while (true) {
+      int first = 4 * hi + 1;
+      if (first >= n)
+        break;
+      int best = first;
+      int last = std::min(first + 4, n);
+      for (int c = first + 1; c < last; c++) {
+        if (_errors[_heap[c]] > _errors[_heap[best]])
+          best = c;
+      }
+      if (_errors[_heap[best]] <= _errors[i])
+        break;
+      place(hi, _heap[best]);
+      hi = best;
+    }
+    place(hi, i);
+  }
+};
+
+//-- get the FaceData of a face, computing its plane if the face has none yet
+inline FaceData& get_facedata(CDT::Face_handle& face, std::vector<FaceData>& pool, std::vector<int>& freeslots) {
+  if (face->info().facedata == -1) {
+    int slot;
+    if (freeslots.empty()) {
+      slot = int(pool.size());
+      pool.push_back(FaceData());
+    }
+    else {
+      slot = freeslots.back();
+      freeslots.pop_back();
+    }
+    face->info().facedata = slot;
+    FaceData& fd = pool[slot];
+    fd.used = true;
+    const Point& p0 = face->vertex(0)->point();
+    const Point& p1 = face->vertex(1)->point();
+    const Point& p2 = face->vertex(2)->point();
+    double x1 = p1.x() - p0.x(), y1 = p1.y() - p0.y(), z1 = p1.z() - p0.z();
+    double x2 = p2.x() - p0.x(), y2 = p2.y() - p0.y(), z2 = p2.z() - p0.z();
+    double det = x1 * y2 - x2 * y1;
+    if (det != 0.0) {
+      fd.a = (z1 * y2 - z2 * y1) / det;
+      fd.b = (x1 * z2 - x2 * z1) / det;
+    }
+    else {
+      fd.a = 0.0;
+      fd.b = 0.0;
+    }
+    fd.c = p0.z() - fd.a * p0.x() - fd.b * p0.y();
+  }
+  return pool[face->info().facedata];
 }
 
-void greedy_insert(CDT &T, const std::vector<Point3> &pts, double threshold) {
-  // assumes all lidar points are inside a triangle
-  Heap heap;
+//-- give the FaceData of a face back to the pool, its points are appended to released
+inline void release_facedata(CDT::Face_handle& face, std::vector<FaceData>& pool, std::vector<int>& freeslots, std::vector<int>& released) {
+  int slot = face->info().facedata;
+  if (slot != -1) {
+    released.insert(released.end(), pool[slot].points.begin(), pool[slot].points.end());
+    pool[slot].points.clear();
+    pool[slot].used = false;
+    freeslots.push_back(slot);
+    face->info().facedata = -1;
+  }
+}
 
-  // Convert all elevation points to CGAL points
-  std::vector<Point> cpts;
+inline double compute_error(const Point& p, const FaceData& fd) {
+  return std::fabs(fd.a * p.x() + fd.b * p.y() + fd.c - p.z());
+}
+
+//-- convert the LiDAR points to CGAL points, remove the duplicates in xy (the first
+//-- one in the input is kept) and sort them spatially so that each locate can start
+//-- from the face of the previous point
+void prepare_candidate_points(const std::vector<Point3> &pts, std::vector<Point> &cpts) {
   cpts.reserve(pts.size());
   for (auto& p : pts) {
     cpts.push_back(Point(bg::get<0>(p), bg::get<1>(p), bg::get<2>(p)));
   }
+  std::stable_sort(cpts.begin(), cpts.end(), [](const Point& p1, const Point& p2) {
+    return (p1.x() < p2.x()) || (p1.x() == p2.x() && p1.y() < p2.y());
+  });
+  cpts.erase(std::unique(cpts.begin(), cpts.end(), [](const Point& p1, const Point& p2) {
+    return p1.x() == p2.x() && p1.y() == p2.y();
+  }), cpts.end());
+  CGAL::spatial_sort(cpts.begin(), cpts.end(), Gt());
+}
+
+void greedy_insert(CDT &T, const std::vector<Point3> &pts, double threshold, TinSimpStats* stats) {
+  // assumes all lidar points are inside a triangle
+  std::vector<Point> cpts;
+  prepare_candidate_points(pts, cpts);
+
+  std::vector<FaceData> pool;
+  std::vector<int> freeslots;
+  ErrorHeap heap;
+  heap.reset(cpts.size());
 
   // compute initial point errors, build heap, store point indices in triangles
-  {
-    std::unordered_set<Point, PointXYHash, PointXYEqual> set;
-    for(int i=0; i<cpts.size(); i++){
-      auto p = cpts[i];
-      // detect and skip duplicate points
-      auto not_duplicate = set.insert(p).second;
-      if(not_duplicate){
-        auto face = T.locate(p);
-        auto e = compute_error(p, face);
-        auto handle = heap.push(point_error(i,e));
-        face->info().points_inside->push_back(handle);
-      }
-    }
+  //-- the points on a vertex of the CDT (e.g. a ring vertex with another z)
+  //-- cannot be inserted and are dropped
+  CDT::Face_handle hint;
+  CDT::Locate_type lt;
+  int li;
+  std::size_t ncandidates = 0;
+  for (int i = 0; i < cpts.size(); i++) {
+    CDT::Face_handle face = T.locate(cpts[i], lt, li, hint);
+    if (T.is_infinite(face) || lt == CDT::VERTEX)
+      continue;
+    hint = face;
+    FaceData& fd = get_facedata(face, pool, freeslots);
+    heap.push(i, compute_error(cpts[i], fd));
+    fd.points.push_back(i);
+    ncandidates++;
   }
-  
+
   // insert points, update errors of affected triangles until threshold error is reached
-  while (!heap.empty() && heap.top().error > threshold){
+  std::vector<CDT::Face_handle> faces;
+  std::vector<int> points_to_update;
+  std::size_t ninserted = 0;
+  std::size_t nupdates = 0;
+  while (!heap.empty() && heap.top_error() > threshold) {
     // get top element (with largest error) from heap
-    auto maxelement = heap.top();
-    auto max_p = cpts[maxelement.index];
+    int maxi = heap.top();
+    const Point& max_p = cpts[maxi];
+    heap.pop();
 
-    // get triangles that will change after inserting this max_p
-    std::vector<CDT::Face_handle> faces;
-    T.get_conflicts ( max_p, std::back_inserter(faces) );
+    // get triangles that will change after inserting this max_p, recycle their data
+    // and collect the points that were inside them
+    faces.clear();
+    T.get_conflicts(max_p, std::back_inserter(faces));
+    if (faces.empty())
+      continue;
+    points_to_update.clear();
+    for (auto& face : faces) {
+      release_facedata(face, pool, freeslots, points_to_update);
+    }
+    points_to_update.erase(std::remove(points_to_update.begin(), points_to_update.end(), maxi), points_to_update.end());
 
     // insert max_p in triangulation
-    auto face_hint = faces[0];
-    auto v = T.insert(max_p, face_hint);
-    face_hint = v->face();
-    
-    // update clear info of triangles that just changed, collect points that were inside these triangles
-    std::vector<heap_handle> points_to_update;
-    for (auto face : faces) {
-      if (face->info().plane){
-        delete face->info().plane;
-        face->info().plane = nullptr;
-      }
-      if (face->info().points_inside) {
-        for (auto h :*face->info().points_inside){
-          if( maxelement.index != (*h).index)
-            points_to_update.push_back(h);
-        }
-        face->info().points_inside->clear();
-      }
-    }
-    
-    // remove the point we just inserted in the triangulation from the heap
-    heap.pop();
+    CDT::Vertex_handle v = T.insert(max_p, faces[0]);
+    hint = v->face();
+    ninserted++;
 
     // update the errors of affected elevation points
-    for (auto curelement : points_to_update){
-      auto p = cpts[(*curelement).index];
-      auto containing_face = T.locate(p, face_hint);
-      const double e = compute_error(p, containing_face);
-      const point_error new_pe = point_error((*curelement).index, e);
-      heap.update(curelement, new_pe);
-      containing_face->info().points_inside->push_back(curelement);
+    for (int i : points_to_update) {
+      CDT::Face_handle face = T.locate(cpts[i], lt, li, hint);
+      if (T.is_infinite(face) || lt == CDT::VERTEX) {
+        heap.remove(i);
+        continue;
+      }
+      hint = face;
+      FaceData& fd = get_facedata(face, pool, freeslots);
+      heap.update(i, compute_error(cpts[i], fd));
+      fd.points.push_back(i);
     }
+    nupdates += points_to_update.size();
+  }
+
+  // reset the face info for the triangles, the pool is freed with this function
+  for (CDT::All_faces_iterator fit = T.all_faces_begin(); fit != T.all_faces_end(); ++fit) {
+    fit->info().facedata = -1;
   }
 
-  //cleanup the stuff I put in face info of triangles
-  for (CDT::Finite_faces_iterator fit = T.finite_faces_begin();
-    fit != T.finite_faces_end(); ++fit) {
-      if (fit->info().plane){
-        delete fit->info().plane;
-        fit->info().plane = nullptr;
+  if (stats != nullptr) {
+    stats->candidates += ncandidates;
+    stats->inserted += ninserted;
+    stats->iterations += ninserted;
+    stats->updates += nupdates;
+  }
+}
+
+// Batched refinement: every round inserts, for each face, the point with the largest
+// error if that error is above the threshold, and then only the points of the destroyed
+// faces are located again. It stops with the same guarantee as greedy_insert (no point
+// further than the threshold from the TIN) but needs no priority queue, and the number
+// of rounds is much smaller than the number of insertions. It usually inserts a few
+// more points than greedy_insert.
+// The rounds run serially: locating and inserting in one CDT is not thread-safe (CGAL
+// locates with the random generator of the triangulation). Large TINs are made parallel
+// by cutting them in strips (TIN::buildCDT_split), each refined by its own thread.
+void batch_insert(CDT &T, const std::vector<Point3> &pts, double threshold, TinSimpStats* stats) {
+  std::vector<Point> cpts;
+  prepare_candidate_points(pts, cpts);
+
+  std::vector<FaceData> pool;
+  std::vector<int> freeslots;
+  std::vector<double> errors(cpts.size(), 0.0);
+  std::vector<char> inserted(cpts.size(), 0);
+  //-- points to locate, their indices are in spatial order
+  std::vector<int> pending(cpts.size());
+  for (int i = 0; i < cpts.size(); i++) {
+    pending[i] = i;
+  }
+  std::vector<int> batch;
+  std::vector<CDT::Face_handle> faces;
+  CDT::Face_handle hint;
+  CDT::Locate_type lt;
+  int li;
+  std::size_t ncandidates = 0;
+  std::size_t ninserted = 0;
+  std::size_t nupdates = 0;
+  std::size_t nrounds = 0;
+  while (true) {
+    //-- assign the pending points to their face and compute their error
+    std::sort(pending.begin(), pending.end());
+    for (int i : pending) {
+      if (inserted[i] == 1)
+        continue;
+      //-- a point on a vertex of the CDT cannot be inserted, it is dropped
+      CDT::Face_handle face = T.locate(cpts[i], lt, li, hint);
+      if (T.is_infinite(face) || lt == CDT::VERTEX)
+        continue;
+      hint = face;
+      FaceData& fd = get_facedata(face, pool, freeslots);
+      errors[i] = compute_error(cpts[i], fd);
+      fd.points.push_back(i);
+      if (nrounds == 0)
+        ncandidates++;
+      else
+        nupdates++;
+    }
+    pending.clear();
+
+    //-- select the worst point of each face
+    batch.clear();
+    for (auto& fd : pool) {
+      if (fd.used == false)
+        continue;
+      int worst = -1;
+      for (int i : fd.points) {
+        if (inserted[i] == 0 && errors[i] > threshold && (worst == -1 || errors[i] > errors[worst]))
+          worst = i;
       }
-      if (fit->info().points_inside) {
-        delete fit->info().points_inside;
-        fit->info().points_inside = nullptr;
+      if (worst != -1)
+        batch.push_back(worst);
+    }
+    if (batch.empty())
+      break;
+    nrounds++;
+
+    //-- insert the batch in spatial order, the faces in conflict give their points back
+    std::sort(batch.begin(), batch.end());
+    for (int bi : batch) {
+      faces.clear();
+      T.get_conflicts(cpts[bi], std::back_inserter(faces));
+      if (faces.empty())
+        continue;
+      for (auto& face : faces) {
+        release_facedata(face, pool, freeslots, pending);
       }
+      CDT::Vertex_handle v = T.insert(cpts[bi], faces[0]);
+      hint = v->face();
+      inserted[bi] = 1;
+      ninserted++;
     }
+  }
+
+  // reset the face info for the triangles, the pool is freed with this function
+  for (CDT::All_faces_iterator fit = T.all_faces_begin(); fit != T.all_faces_end(); ++fit) {
+    fit->info().facedata = -1;
+  }
 
+  if (stats != nullptr) {
+    stats->candidates += ncandidates;
+    stats->inserted += ninserted;
+    stats->iterations += nrounds;
+    stats->updates += nupdates;
+  }
 }
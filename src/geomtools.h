@@ -32,6 +32,28 @@
 #include "definitions.h"
 #include <random>
 
+//-- engines for the TIN simplification of Terrain and Forest
+typedef enum {
+  TINSIMP_GREEDY = 0, //-- greedy insertion of the point with the largest error
+  TINSIMP_BATCH  = 1  //-- rounds inserting the worst point of each triangle
+} TinSimpMethod;
+
+//-- counters of the TIN simplification
+typedef struct TinSimpStats {
+  std::size_t candidates = 0; //-- unique LiDAR points considered
+  std::size_t inserted = 0;   //-- points inserted in the triangulation
+  std::size_t iterations = 0; //-- iterations (greedy) or rounds (batch) of the refinement loop
+  std::size_t updates = 0;    //-- error updates of the remaining points
+} TinSimpStats;
+
+//-- a part of a polygon cut by splitCDT: the vertices of its boundary (of the rings and
+//-- of the seams), its constrained edges as indices in them, and its lidar points
+typedef struct CDTPart {
+  std::vector<Point3>                                vertices;
+  std::vector< std::pair<std::size_t, std::size_t> > edges;
+  std::vector<Point3>                                lidarpts;
+} CDTPart;
+
 std::string gen_key_bucket(const Point2* p);
 std::string gen_key_bucket(const Point3* p);
 std::string gen_key_bucket(const Point3* p, float z);
@@ -43,6 +65,27 @@ bool   getCDT(Polygon2* pgn,
             std::vector< std::pair<Point3, std::string> > &vertices, 
             std::vector<Triangle> &triangles, 
             const std::vector<Point3> &lidarpts = std::vector<Point3>(),
-            double tinsimp_threshold=0);
+            double tinsimp_threshold=0,
+            TinSimpMethod tinsimp_method = TINSIMP_GREEDY,
+            TinSimpStats* stats = nullptr,
+            bool validate = true);
+void   splitCDT(Polygon2* pgn,
+            const std::vector< std::vector<int> > &z,
+            int axis,
+            const std::vector<double> &seams,
+            const std::vector<Point3> &seampts,
+            const std::vector<Point3> &lidarpts,
+            std::vector<CDTPart> &parts);
+bool   getCDT(const CDTPart &part,
+            std::vector< std::pair<Point3, std::string> > &vertices,
+            std::vector<Triangle> &triangles,
+            double tinsimp_threshold = 0,
+            TinSimpMethod tinsimp_method = TINSIMP_GREEDY,
+            TinSimpStats* stats = nullptr,
+            bool validate = true);
+bool   getEarClipping(Polygon2* pgn,
+            const std::vector< std::vector<int> > &z, 
+            std::vector< std::pair<Point3, std::string> > &vertices, 
+            std::vector<Triangle> &triangles);
 
 #endif /* geomtools_h */
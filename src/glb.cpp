@@ -0,0 +1,309 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "glb.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+//-- the diffuse colours of resources/3dfier.mtl
+static const struct {
+  const char* name;
+  float       rgb[3];
+} GLB_MATERIALS[] = {
+  { "Building",   { 0.87f, 0.26f, 0.28f } },
+  { "Terrain",    { 0.90f, 0.90f, 0.75f } },
+  { "Road",       { 0.60f, 0.60f, 0.60f } },
+  { "Water",      { 0.35f, 0.65f, 0.90f } },
+  { "Forest",     { 0.34f, 0.70f, 0.35f } },
+  { "Separation", { 0.32f, 0.16f, 0.40f } },
+  { "Bridge",     { 0.80f, 0.60f, 0.20f } },
+};
+
+//-- the feature ids are floats (glTF has no uint32 vertex attributes), which
+//-- are exact up to 2^24
+static const std::size_t GLB_MAX_FEATURES = std::size_t(1) << 24;
+
+GLBMesh::GLBMesh() : _current(0), _fid(0) {
+  _origin[0] = _origin[1] = _origin[2] = 0;
+}
+
+void GLBMesh::set_origin(const double origin[3]) {
+  _origin[0] = std::llround(origin[0] * 1000.0);
+  _origin[1] = std::llround(origin[1] * 1000.0);
+  _origin[2] = std::llround(origin[2] * 100.0);
+}
+
+void GLBMesh::clear() {
+  _primitives.clear();
+  _ids.clear();
+  _layers.clear();
+  _current = 0;
+  _fid = 0;
+}
+
+void GLBMesh::begin_feature(std::size_t fid) {
+  _fid = fid;
+}
+
+void GLBMesh::set_material(const std::string& name) {
+  _current = get_primitive(name);
+}
+
+std::size_t GLBMesh::get_primitive(const std::string& material) {
+  for (std::size_t i = 0; i < _primitives.size(); i++) {
+    if (_primitives[i].material == material)
+      return i;
+  }
+  Primitive p;
+  p.material = material;
+  p.feature = std::numeric_limits<std::size_t>::max();
+  p.base = 0;
+  _primitives.push_back(p);
+  return _primitives.size() - 1;
+}
+
+//-- (x, y, z) becomes (x, z, -y) for the y-up of glTF
+unsigned long GLBMesh::add_vertex(double x, double y, double z) {
+  Primitive& p = _primitives[_current];
+  if (p.feature != _fid) {
+    p.vertices.clear();
+    p.feature = _fid;
+    p.base = std::uint32_t(p.featureids.size());
+  }
+  VertexPool::Vertex v = { { std::llround(x * 1000.0), std::llround(y * 1000.0), std::llround(z * 100.0) } };
+  std::size_t n = p.vertices.size();
+  unsigned long id = p.vertices.add(v);
+  if (p.vertices.size() > n) {
+    p.positions.push_back(float(double(v[0] - _origin[0]) / 1000.0));
+    p.positions.push_back(float(double(v[2] - _origin[2]) / 100.0));
+    p.positions.push_back(float(-double(v[1] - _origin[1]) / 1000.0));
+    p.featureids.push_back(float(_fid));
+  }
+  return p.base + id;
+}
+
+void GLBMesh::add_triangle(unsigned long a, unsigned long b, unsigned long c) {
+  if ((a != b) && (a != c) && (b != c)) {
+    Primitive& p = _primitives[_current];
+    p.indices.push_back(std::uint32_t(a));
+    p.indices.push_back(std::uint32_t(b));
+    p.indices.push_back(std::uint32_t(c));
+  }
+}
+
+void GLBMesh::add_feature(const std::string& id, const std::string& layer) {
+  _ids.push_back(id);
+  _layers.push_back(layer);
+}
+
+void GLBMesh::append(const GLBMesh& other) {
+  for (auto& o : other._primitives) {
+    Primitive& p = _primitives[get_primitive(o.material)];
+    std::uint32_t offset = std::uint32_t(p.featureids.size());
+    p.positions.insert(p.positions.end(), o.positions.begin(), o.positions.end());
+    p.featureids.insert(p.featureids.end(), o.featureids.begin(), o.featureids.end());
+    for (auto& i : o.indices)
+      p.indices.push_back(i + offset);
+  }
+  _ids.insert(_ids.end(), other._ids.begin(), other._ids.end());
+  _layers.insert(_layers.end(), other._layers.begin(), other._layers.end());
+}
+
+std::size_t GLBMesh::get_number_features() const {
+  return _ids.size();
+}
+
+std::size_t GLBMesh::get_number_triangles() const {
+  std::size_t n = 0;
+  for (auto& p : _primitives)
+    n += p.indices.size() / 3;
+  return n;
+}
+
+bool GLBMesh::get_bounds(double min[3], double max[3]) const {
+  bool found = false;
+  for (auto& p : _primitives) {
+    if (p.indices.empty())
+      continue;
+    for (std::size_t i = 0; i < p.positions.size(); i += 3) {
+      double v[3] = { p.positions[i] + double(_origin[0]) / 1000.0, -p.positions[i + 2] + double(_origin[1]) / 1000.0, p.positions[i + 1] + double(_origin[2]) / 100.0 };
+      for (int j = 0; j < 3; j++) {
+        min[j] = found ? std::min(min[j], v[j]) : v[j];
+        max[j] = found ? std::max(max[j], v[j]) : v[j];
+      }
+      found = true;
+    }
+  }
+  return found;
+}
+
+//-- the binary buffer, its views aligned on 8 bytes as EXT_structural_metadata
+//-- wants them, and their json
+struct GLBBuffer {
+  std::string        bin;
+  std::ostringstream views;
+  int                count = 0;
+
+  int add(const void* data, std::size_t size, int target) {
+    while (bin.size() % 8 != 0)
+      bin += '\0';
+    views << (count > 0 ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << bin.size() << ",\"byteLength\":" << size;
+    if (target != 0)
+      views << ",\"target\":" << target;
+    views << "}";
+    bin.append(static_cast<const char*>(data), size);
+    return count++;
+  }
+
+  //-- the strings one after the other, and the uint32 offset of each one
+  //-- and of the end
+  void add_strings(const std::vector<std::string>& strings, int& values, int& offsets) {
+    std::string s;
+    std::vector<std::uint32_t> o;
+    for (auto& each : strings) {
+      o.push_back(std::uint32_t(s.size()));
+      s += each;
+    }
+    o.push_back(std::uint32_t(s.size()));
+    values = add(s.data(), s.size(), 0);
+    offsets = add(o.data(), o.size() * sizeof(std::uint32_t), 0);
+  }
+};
+
+//-- little-endian, as the buffers are written from memory
+static void write_uint32(std::ostream& of, std::uint32_t v) {
+  of.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+bool GLBMesh::write(const std::string& filename) const {
+  if (_ids.size() > GLB_MAX_FEATURES) {
+    std::cerr << "ERROR: more than " << GLB_MAX_FEATURES << " features in " << filename << std::endl;
+    return false;
+  }
+  GLBBuffer buffer;
+  std::ostringstream accessors, primitives, materials;
+  accessors << std::setprecision(9);
+  int naccessors = 0;
+  int nprimitives = 0;
+  for (auto& p : _primitives) {
+    if (p.indices.empty())
+      continue;
+    std::size_t nvertices = p.featureids.size();
+    float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float max[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+    for (std::size_t i = 0; i < nvertices; i++) {
+      for (int j = 0; j < 3; j++) {
+        min[j] = std::min(min[j], p.positions[3 * i + j]);
+        max[j] = std::max(max[j], p.positions[3 * i + j]);
+      }
+    }
+    int positions = buffer.add(p.positions.data(), p.positions.size() * sizeof(float), 34962);
+    int featureids = buffer.add(p.featureids.data(), p.featureids.size() * sizeof(float), 34962);
+    int indices = buffer.add(p.indices.data(), p.indices.size() * sizeof(std::uint32_t), 34963);
+    accessors << (naccessors > 0 ? "," : "");
+    accessors << "{\"bufferView\":" << positions << ",\"componentType\":5126,\"count\":" << nvertices << ",\"type\":\"VEC3\"";
+    accessors << ",\"min\":[" << min[0] << "," << min[1] << "," << min[2] << "]";
+    accessors << ",\"max\":[" << max[0] << "," << max[1] << "," << max[2] << "]}";
+    accessors << ",{\"bufferView\":" << featureids << ",\"componentType\":5126,\"count\":" << nvertices << ",\"type\":\"SCALAR\"}";
+    accessors << ",{\"bufferView\":" << indices << ",\"componentType\":5125,\"count\":" << p.indices.size() << ",\"type\":\"SCALAR\"}";
+
+    const float grey[3] = { 0.85f, 0.85f, 0.85f };
+    const float* rgb = grey;
+    for (auto& m : GLB_MATERIALS) {
+      if (p.material == m.name)
+        rgb = m.rgb;
+    }
+    materials << (nprimitives > 0 ? "," : "");
+    materials << "{\"name\":\"" << p.material << "\",\"pbrMetallicRoughness\":{\"baseColorFactor\":[";
+    materials << rgb[0] << "," << rgb[1] << "," << rgb[2] << ",1],\"metallicFactor\":0,\"roughnessFactor\":1},\"doubleSided\":true}";
+
+    primitives << (nprimitives > 0 ? "," : "");
+    primitives << "{\"attributes\":{\"POSITION\":" << naccessors << ",\"_FEATURE_ID_0\":" << naccessors + 1 << "}";
+    primitives << ",\"indices\":" << naccessors + 2 << ",\"material\":" << nprimitives << ",\"mode\":4";
+    primitives << ",\"extensions\":{\"EXT_mesh_features\":{\"featureIds\":[{\"featureCount\":" << _ids.size();
+    primitives << ",\"attribute\":0,\"propertyTable\":0}]}}}";
+    naccessors += 3;
+    nprimitives++;
+  }
+
+  std::ostringstream json;
+  json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"3dfier\"}";
+  if (nprimitives > 0) {
+    int idvalues, idoffsets, layervalues, layeroffsets;
+    buffer.add_strings(_ids, idvalues, idoffsets);
+    buffer.add_strings(_layers, layervalues, layeroffsets);
+    json << ",\"extensionsUsed\":[\"EXT_mesh_features\",\"EXT_structural_metadata\"]";
+    json << ",\"extensions\":{\"EXT_structural_metadata\":{\"schema\":{\"id\":\"3dfier\",\"classes\":{\"feature\":{\"properties\":{";
+    json << "\"3df_id\":{\"type\":\"STRING\"},\"layer\":{\"type\":\"STRING\"}}}}}";
+    json << ",\"propertyTables\":[{\"class\":\"feature\",\"count\":" << _ids.size() << ",\"properties\":{";
+    json << "\"3df_id\":{\"values\":" << idvalues << ",\"stringOffsets\":" << idoffsets << ",\"stringOffsetType\":\"UINT32\"}";
+    json << ",\"layer\":{\"values\":" << layervalues << ",\"stringOffsets\":" << layeroffsets << ",\"stringOffsetType\":\"UINT32\"}";
+    json << "}}]}}";
+    json << ",\"scene\":0,\"scenes\":[{\"nodes\":[0]}]";
+    json << ",\"nodes\":[{\"mesh\":0,\"translation\":[" << std::fixed << std::setprecision(3);
+    json << double(_origin[0]) / 1000.0 << "," << double(_origin[2]) / 100.0 << "," << -double(_origin[1]) / 1000.0 << "]}]";
+    json << ",\"meshes\":[{\"primitives\":[" << primitives.str() << "]}]";
+    json << ",\"materials\":[" << materials.str() << "]";
+    json << ",\"accessors\":[" << accessors.str() << "]";
+    json << ",\"bufferViews\":[" << buffer.views.str() << "]";
+    json << ",\"buffers\":[{\"byteLength\":" << buffer.bin.size() << "}]";
+  }
+  json << "}";
+
+  //-- the chunks are padded to 4 bytes, the json with spaces
+  std::string j = json.str();
+  while (j.size() % 4 != 0)
+    j += ' ';
+  std::string& bin = buffer.bin;
+  while (bin.size() % 4 != 0)
+    bin += '\0';
+  std::size_t length = 12 + 8 + j.size() + (bin.empty() ? 0 : 8 + bin.size());
+  if (length > std::numeric_limits<std::uint32_t>::max()) {
+    std::cerr << "ERROR: " << filename << " would be larger than 4 GB" << std::endl;
+    return false;
+  }
+  std::ofstream of(filename, std::ios::binary);
+  of.write("glTF", 4);
+  write_uint32(of, 2);
+  write_uint32(of, std::uint32_t(length));
+  write_uint32(of, std::uint32_t(j.size()));
+  of.write("JSON", 4);
+  of.write(j.data(), j.size());
+  if (!bin.empty()) {
+    write_uint32(of, std::uint32_t(bin.size()));
+    of.write("BIN\0", 4);
+    of.write(bin.data(), bin.size());
+  }
+  of.close();
+  return !of.fail();
+}
@@ -0,0 +1,86 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef __3DFIER__GLB__
+#define __3DFIER__GLB__
+
+#include "vertexpool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//-- the triangles of an output in binary glTF (GLB): one primitive per
+//-- material (the classes, their walls and the building floors) with float32
+//-- positions relative to an origin, uint32 indices and the feature of each
+//-- vertex in the attribute _FEATURE_ID_0 (EXT_mesh_features). The features
+//-- have their id and layer in a property table (EXT_structural_metadata).
+//-- The coordinates are those of VertexPool (mm for x-y, cm for z), the
+//-- vertices are shared only within a feature, and the mesh is y-up as glTF
+//-- wants it, with the origin in the translation of its node.
+class GLBMesh {
+public:
+  GLBMesh();
+
+  void          set_origin(const double origin[3]);
+  void          clear();
+  //-- the triangles added next are of feature fid and of that material
+  void          begin_feature(std::size_t fid);
+  void          set_material(const std::string& name);
+  unsigned long add_vertex(double x, double y, double z);
+  void          add_triangle(unsigned long a, unsigned long b, unsigned long c);
+  //-- the properties of the next feature, fid being the number of features
+  void          add_feature(const std::string& id, const std::string& layer);
+  //-- the primitives of another mesh with the same origin, after those here
+  void          append(const GLBMesh& other);
+  std::size_t   get_number_features() const;
+  std::size_t   get_number_triangles() const;
+  //-- the box of the triangles in the coordinates of the input, z-up
+  bool          get_bounds(double min[3], double max[3]) const;
+  bool          write(const std::string& filename) const;
+
+private:
+  struct Primitive {
+    std::string                material;
+    std::vector<float>         positions;
+    std::vector<float>         featureids;
+    std::vector<std::uint32_t> indices;
+    VertexPool                 vertices; //-- of the current feature
+    std::size_t                feature;
+    std::uint32_t              base;     //-- its first vertex
+  };
+  long long                _origin[3];
+  std::vector<Primitive>   _primitives;
+  std::size_t              _current;
+  std::size_t              _fid;
+  std::vector<std::string> _ids;
+  std::vector<std::string> _layers;
+
+  std::size_t get_primitive(const std::string& material);
+};
+
+#endif
@@ -46,11 +46,11 @@ void printProgressBar(int percent) {
   std::clog << percent << "%     " << std::flush;
 }
 
-void get_xml_header(std::wostream& of) {
+void get_xml_header(TextWriter& of) {
   of << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
 }
 
-void get_citygml_namespaces(std::wostream& of) {
+void get_citygml_namespaces(TextWriter& of) {
   of << "<CityModel xmlns=\"http://www.opengis.net/citygml/2.0\"\n";
   of << "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n";
   of << "xmlns:xAL=\"urn:oasis:names:tc:ciq:xsdschema:xAL:2.0\"\n";
@@ -70,7 +70,7 @@ void get_citygml_namespaces(std::wostream& of) {
   of << "xsi:schemaLocation=\"http://www.opengis.net/citygml/2.0 ./CityGML_2.0/CityGML.xsd\">\n";
 }
 
-void get_citygml_imgeo_namespaces(std::wostream& of) {
+void get_citygml_imgeo_namespaces(TextWriter& of) {
   of << "<CityModel xmlns=\"http://www.opengis.net/citygml/2.0\"\n";
   of << "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n";
   of << "xmlns:xAL=\"urn:oasis:names:tc:ciq:xsdschema:xAL:2.0\"\n";
@@ -91,7 +91,7 @@ void get_citygml_imgeo_namespaces(std::wostream& of) {
   of << "xsi:schemaLocation=\"http://www.opengis.net/citygml/2.0 http://schemas.opengis.net/citygml/2.0/cityGMLBase.xsd http://www.geostandaarden.nl/imgeo/2.1 http://schemas.geonovum.nl/imgeo/2.1/imgeo-2.1.1.xsd\">\n";
 }
 
-void get_polygon_lifted_gml(std::wostream& of, Polygon2* p2, double height, bool reverse) {
+void get_polygon_lifted_gml(TextWriter& of, Polygon2* p2, double height, bool reverse) {
   if (reverse)
     bg::reverse(*p2);
   of << "<gml:surfaceMember>";
@@ -126,7 +126,7 @@ void get_polygon_lifted_gml(std::wostream& of, Polygon2* p2, double height, bool
     bg::reverse(*p2);
 }
 
-void get_extruded_line_gml(std::wostream& of, Point2* a, Point2* b, double high, double low, bool reverse) {
+void get_extruded_line_gml(TextWriter& of, Point2* a, Point2* b, double high, double low, bool reverse) {
   of << "<gml:surfaceMember>";
   of << "<gml:Polygon>";
   of << "<gml:exterior>";
@@ -144,7 +144,7 @@ void get_extruded_line_gml(std::wostream& of, Point2* a, Point2* b, double high,
   of << "</gml:surfaceMember>";
 }
 
-void get_extruded_lod1_block_gml(std::wostream& of, Polygon2* p2, double high, double low, bool building_include_floor) {
+void get_extruded_lod1_block_gml(TextWriter& of, Polygon2* p2, double high, double low, bool building_include_floor) {
   if (building_include_floor) {
     //-- get floor
     get_polygon_lifted_gml(of, p2, low, false);
@@ -199,3 +199,45 @@ std::wostream& operator<< (std::wostream& of, const std::string& str) {
   std::copy(str.begin(), str.end(), std::ostream_iterator<char, wchar_t>(of));
   return of;
 }
+
+//-- a JSON string with the quotes, the characters that must be escaped are escaped
+void write_json_string(std::ostream& of, const std::string& str) {
+  static const char hex[] = "0123456789abcdef";
+  of.put('"');
+  std::size_t start = 0;
+  for (std::size_t i = 0; i < str.size(); i++) {
+    unsigned char c = (unsigned char)str[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    of.write(str.data() + start, i - start);
+    start = i + 1;
+    switch (c) {
+    case '"':  of << "\\\""; break;
+    case '\\': of << "\\\\"; break;
+    case '\n': of << "\\n"; break;
+    case '\r': of << "\\r"; break;
+    case '\t': of << "\\t"; break;
+    default:   of << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+    }
+  }
+  of.write(str.data() + start, str.size() - start);
+  of.put('"');
+}
+
+//-- "f a b c" with the 0-based ids of the vertices, OBJ counts from 1
+void write_obj_face(std::string& fs, unsigned long a, unsigned long b, unsigned long c) {
+  char buf[72];
+  char* p = buf + sizeof(buf);
+  *--p = '\n';
+  unsigned long ids[] = { c + 1, b + 1, a + 1 };
+  for (int i = 0; i < 3; i++) {
+    unsigned long v = ids[i];
+    do {
+      *--p = char('0' + v % 10);
+      v /= 10;
+    } while (v > 0);
+    *--p = ' ';
+  }
+  *--p = 'f';
+  fs.append(p, buf + sizeof(buf) - p);
+}
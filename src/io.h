@@ -30,21 +30,24 @@
 #define INPUT_H
 
 #include "definitions.h"
+#include "textwriter.h"
 #include "TopoFeature.h"
 
 void printProgressBar(int percent);
-void get_xml_header(std::wostream& of);
-void get_citygml_namespaces(std::wostream& of);
-void get_citygml_imgeo_namespaces(std::wostream& of);
+void get_xml_header(TextWriter& of);
+void get_citygml_namespaces(TextWriter& of);
+void get_citygml_imgeo_namespaces(TextWriter& of);
 
-void get_polygon_lifted_gml(std::wostream& of, Polygon2* p2, double height, bool reverse = false);
-void get_extruded_line_gml(std::wostream& of, Point2* a, Point2* b, double high, double low, bool reverse = false);
-void get_extruded_lod1_block_gml(std::wostream& of, Polygon2* p2, double high, double low = 0.0, bool building_include_floor = false);
+void get_polygon_lifted_gml(TextWriter& of, Polygon2* p2, double height, bool reverse = false);
+void get_extruded_line_gml(TextWriter& of, Point2* a, Point2* b, double high, double low, bool reverse = false);
+void get_extruded_lod1_block_gml(TextWriter& of, Polygon2* p2, double high, double low = 0.0, bool building_include_floor = false);
 
 bool  is_string_integer(std::string s, int min = 0, int max = 1e6);
 float z_to_float(int z);
 std::vector<std::string> stringsplit(std::string str, char delimiter);
 std::wostream& operator<< (std::wostream& of, const std::string& str);
+void write_json_string(std::ostream& of, const std::string& str);
+void write_obj_face(std::string& fs, unsigned long a, unsigned long b, unsigned long c);
 
 template<class I, class E, class S>
 struct codecvt : std::codecvt<I, E, S>
@@ -39,9 +39,14 @@
 std::string VERSION = "1.1";
 
 bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures);
+bool validate_lifting_options(YAML::Node n);
 int main(int argc, const char * argv[]);
 std::string print_license();
 void print_duration(std::string message, boost::chrono::time_point<boost::chrono::steady_clock> startTime);
+void set_lifting_options(Map3d& map3d, YAML::Node n);
+void set_map3d_options(Map3d& map3d, YAML::Node& nodes, bool& bStitching);
+std::string add_filename_suffix(std::string filename, std::string suffix);
+std::string get_tile_filename(std::string filename, int col, int row);
 
 int main(int argc, const char * argv[]) {
   auto startTime = boost::chrono::high_resolution_clock::now();
@@ -60,11 +65,16 @@ int main(int argc, const char * argv[]) {
   std::map<std::string, std::string> outputs;
   outputs["OBJ"] = "";
   outputs["OBJ-NoID"] = "";
+  outputs["OBJ-Multifile"] = "";
+  outputs["OBJ-PerFeature"] = "";
+  outputs["GLB"] = "";
+  outputs["3DTiles"] = "";
   outputs["CityGML"] = "";
   outputs["CityGML-Multifile"] = "";
   outputs["CityGML-IMGeo"] = "";
   outputs["CityGML-IMGeo-Multifile"] = "";
   outputs["CityJSON"] = "";
+  outputs["CityJSONSeq"] = "";
   outputs["CSV-BUILDINGS"] = "";
   outputs["CSV-BUILDINGS-MULTIPLE"] = "";
   outputs["CSV-BUILDINGS-ALL-Z"] = "";
@@ -75,7 +85,13 @@ int main(int argc, const char * argv[]) {
   outputs["PostGIS-PDOK"] = "";
   outputs["PostGIS-PDOK-CityGML"] = "";
   outputs["GDAL"] = "";
+  outputs["GPKG"] = "";
   std::string f_yaml;
+  std::string shard;
+  std::string savecheckpoint;
+  std::string loadcheckpoint;
+  int shardindex = 0;
+  int shardcount = 1;
   try {
     namespace po = boost::program_options;
     po::options_description pomain("Allowed options");
@@ -85,11 +101,16 @@ int main(int argc, const char * argv[]) {
       ("license", "View license")
       ("OBJ", po::value<std::string>(&outputs["OBJ"]), "Output ")
       ("OBJ-NoID", po::value<std::string>(&outputs["OBJ-NoID"]), "Output ")
+      ("OBJ-Multifile", po::value<std::string>(&outputs["OBJ-Multifile"]), "Output ")
+      ("OBJ-PerFeature", po::value<std::string>(&outputs["OBJ-PerFeature"]), "Output ")
+      ("GLB", po::value<std::string>(&outputs["GLB"]), "Output ")
+      ("3DTiles", po::value<std::string>(&outputs["3DTiles"]), "Output ")
       ("CityGML", po::value<std::string>(&outputs["CityGML"]), "Output ")
       ("CityGML-Multifile", po::value<std::string>(&outputs["CityGML-Multifile"]), "Output ")
       ("CityGML-IMGeo", po::value<std::string>(&outputs["CityGML-IMGeo"]), "Output ")
       ("CityGML-IMGeo-Multifile", po::value<std::string>(&outputs["CityGML-IMGeo-Multifile"]), "Output ")
       ("CityJSON", po::value<std::string>(&outputs["CityJSON"]), "Output ")
+      ("CityJSONSeq", po::value<std::string>(&outputs["CityJSONSeq"]), "Output ")
       ("CSV-BUILDINGS", po::value<std::string>(&outputs["CSV-BUILDINGS"]), "Output ")
       ("CSV-BUILDINGS-MULTIPLE", po::value<std::string>(&outputs["CSV-BUILDINGS-MULTIPLE"]), "Output ")
       ("CSV-BUILDINGS-ALL-Z", po::value<std::string>(&outputs["CSV-BUILDINGS-ALL-Z"]), "Output ")
@@ -100,6 +121,10 @@ int main(int argc, const char * argv[]) {
       ("PostGIS-PDOK", po::value<std::string>(&outputs["PostGIS-PDOK"]), "Output ")
       ("PostGIS-PDOK-CityGML", po::value<std::string>(&outputs["PostGIS-PDOK-CityGML"]), "Output ")
       ("GDAL", po::value<std::string>(&outputs["GDAL"]), "Output ")
+      ("GPKG", po::value<std::string>(&outputs["GPKG"]), "Output ")
+      ("shard", po::value<std::string>(&shard), "Process only shard i of N of the tiles (i/N, i starting at 0)")
+      ("save-checkpoint", po::value<std::string>(&savecheckpoint), "Write the points assigned to the polygons to this file")
+      ("load-checkpoint", po::value<std::string>(&loadcheckpoint), "Read the points assigned to the polygons from this file instead of the LAS files")
       ;
     po::options_description pohidden("Hidden options");
     pohidden.add_options()
@@ -150,8 +175,23 @@ int main(int argc, const char * argv[]) {
         return EXIT_FAILURE;
       }
     }
+    if (vm.count("shard")) {
+      std::vector<std::string> shard_split = stringsplit(shard, '/');
+      if (shard_split.size() != 2 ||
+        is_string_integer(shard_split[1], 1, 1024) == false ||
+        is_string_integer(shard_split[0], 0, std::stoi(shard_split[1]) - 1) == false) {
+        std::cerr << "ERROR: shard " << shard << " invalid; must be i/N with 0 <= i < N." << std::endl;
+        return EXIT_FAILURE;
+      }
+      shardindex = std::stoi(shard_split[0]);
+      shardcount = std::stoi(shard_split[1]);
+    }
+    if (vm.count("save-checkpoint") && vm.count("load-checkpoint")) {
+      std::cerr << "ERROR: a checkpoint can be either saved or loaded, not both." << std::endl;
+      return EXIT_FAILURE;
+    }
     for (auto& output : vm) {
-      if ((output.first != "yaml") && (output.first.find("PostGIS") == std::string::npos)) {
+      if ((outputs.count(output.first) > 0) && (output.first.find("PostGIS") == std::string::npos)) {
         //-- check paths of the output file
         boost::filesystem::path p(outputs[output.first]);
         try {
@@ -179,183 +219,14 @@ int main(int argc, const char * argv[]) {
    }
    std::clog << "Config file is valid.\n";
 
-  Map3d map3d;
   YAML::Node nodes = YAML::LoadFile(f_yaml);
-  //-- store the lifting options in the Map3d
-  if (nodes["lifting_options"]) {
-    YAML::Node n = nodes["lifting_options"];
-    if (n["Building"]) {
-      if (n["Building"]["roof"]) {
-        if (n["Building"]["roof"]["height"]) {
-          std::string height = n["Building"]["roof"]["height"].as<std::string>();
-          map3d.set_building_heightref_roof(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-        }
-        YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class(LAS_BUILDING_ROOF, it2->as<int>());
-        if (n["Building"]["roof"]["use_LAS_classes_within"]) {
-          tmp = n["Building"]["roof"]["use_LAS_classes_within"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-            map3d.add_allowed_las_class_within(LAS_BUILDING_ROOF, it2->as<int>());
-        }
-      }
-      if (n["Building"]["ground"]) {
-        if (n["Building"]["ground"]["height"]) {
-          std::string height = n["Building"]["ground"]["height"].as<std::string>();
-          map3d.set_building_heightref_ground(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-        }
-        YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class(LAS_BUILDING_GROUND, it2->as<int>());
-        if (n["Building"]["ground"]["use_LAS_classes_within"]) {
-          tmp = n["Building"]["ground"]["use_LAS_classes_within"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-            map3d.add_allowed_las_class_within(LAS_BUILDING_GROUND, it2->as<int>());
-        }
-      }
-      if (n["Building"]["lod"]) {
-        map3d.set_building_lod(n["Building"]["lod"].as<int>());
-      }
-      if (n["Building"]["triangulate"]) {
-        if (n["Building"]["triangulate"].as<std::string>() == "true")
-          map3d.set_building_triangulate(true);
-        else
-          map3d.set_building_triangulate(false);
-      }
-      if (n["Building"]["floor"]) {
-        if (n["Building"]["floor"].as<std::string>() == "true")
-          map3d.set_building_include_floor(true);
-        else
-          map3d.set_building_include_floor(false);
-      }
-      if (n["Building"]["inner_walls"]) {
-        if (n["Building"]["inner_walls"].as<std::string>() == "true")
-          map3d.set_building_inner_walls(true);
-        else
-          map3d.set_building_inner_walls(false);
-      }
-    }
-    if (n["Terrain"]) {
-      if (n["Terrain"]["simplification"])
-        map3d.set_terrain_simplification(n["Terrain"]["simplification"].as<int>());
-      if (n["Terrain"]["simplification_tinsimp"] != 0)
-        map3d.set_terrain_simplification_tinsimp(n["Terrain"]["simplification_tinsimp"].as<double>());
-      if (n["Terrain"]["innerbuffer"])
-        map3d.set_terrain_innerbuffer(n["Terrain"]["innerbuffer"].as<float>());
-      YAML::Node tmp = n["Terrain"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_TERRAIN, it2->as<int>());
-      if (n["Terrain"]["use_LAS_classes_within"]) {
-        tmp = n["Terrain"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_TERRAIN, it2->as<int>());
-      }
-    }
-    if (n["Forest"]) {
-      if (n["Forest"]["simplification"])
-        map3d.set_forest_simplification(n["Forest"]["simplification"].as<int>());
-      if (n["Forest"]["simplification_tinsimp"] != 0)
-        map3d.set_forest_simplification_tinsimp(n["Forest"]["simplification_tinsimp"].as<double>());
-      if (n["Forest"]["innerbuffer"])
-        map3d.set_forest_innerbuffer(n["Forest"]["innerbuffer"].as<float>());
-      YAML::Node tmp = n["Forest"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_FOREST, it2->as<int>());
-      if (n["Forest"]["use_LAS_classes_within"]) {
-        tmp = n["Forest"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_FOREST, it2->as<int>());
-      }
-    }
-    if (n["Water"]) {
-      if (n["Water"]["height"]) {
-        std::string height = n["Water"]["height"].as<std::string>();
-        map3d.set_water_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-      }
-      YAML::Node tmp = n["Water"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_WATER, it2->as<int>());
-      if (n["Water"]["use_LAS_classes_within"]) {
-        tmp = n["Water"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_WATER, it2->as<int>());
-      }
-    }
-    if (n["Road"]) {
-      if (n["Road"]["height"]) {
-        std::string height = n["Road"]["height"].as<std::string>();
-        map3d.set_road_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-      }
-      if (n["Road"]["filter_outliers"]) {
-        if (n["Road"]["filter_outliers"].as<std::string>() == "true")
-          map3d.set_road_filter_outliers(true);
-        else
-          map3d.set_road_filter_outliers(false);
-      }
-      if (n["Road"]["flatten"]) {
-        if (n["Road"]["flatten"].as<std::string>() == "true")
-          map3d.set_road_flatten(true);
-        else
-          map3d.set_road_flatten(false);
-      }
-      YAML::Node tmp = n["Road"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_ROAD, it2->as<int>());
-      if (n["Road"]["use_LAS_classes_within"]) {
-        tmp = n["Road"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_ROAD, it2->as<int>());
-      }
-    }
-    if (n["Separation"]) {
-      if (n["Separation"]["height"]) {
-        std::string height = n["Separation"]["height"].as<std::string>();
-        map3d.set_separation_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-      }
-      YAML::Node tmp = n["Separation"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_SEPARATION, it2->as<int>());
-      if (n["Separation"]["use_LAS_classes_within"]) {
-        tmp = n["Separation"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_SEPARATION, it2->as<int>());
-      }
-    }
-    if (n["Bridge/Overpass"]) {
-      if (n["Bridge/Overpass"]["height"]) {
-        std::string height = n["Bridge/Overpass"]["height"].as<std::string>();
-        map3d.set_bridge_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-      }
-      if (n["Bridge/Overpass"]["flatten"]) {
-        if (n["Bridge/Overpass"]["flatten"].as<std::string>() == "true")
-          map3d.set_bridge_flatten(true);
-        else
-          map3d.set_bridge_flatten(false);
-      }
-      YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes"];
-      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-        map3d.add_allowed_las_class(LAS_BRIDGE, it2->as<int>());
-      if (n["Bridge/Overpass"]["use_LAS_classes_within"]) {
-        tmp = n["Bridge/Overpass"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
-          map3d.add_allowed_las_class_within(LAS_BRIDGE, it2->as<int>());
-      }
-    }
-  }
-
   bool bStitching = true;
-  //-- set al general options
+  Box2 requestedExtent(Point2(0, 0), Point2(0, 0));
+  double tilesize = 0.0;
+  double tilebuffer = 0.0;
+  std::string polygoncache;
   if (nodes["options"]) {
     YAML::Node n = nodes["options"];
-    if (n["radius_vertex_elevation"])
-      map3d.set_radius_vertex_elevation(n["radius_vertex_elevation"].as<float>());
-    if (n["building_radius_vertex_elevation"])
-      map3d.set_building_radius_vertex_elevation(n["building_radius_vertex_elevation"].as<float>());
-    if (n["threshold_jump_edges"])
-      map3d.set_threshold_jump_edges(n["threshold_jump_edges"].as<float>());
-    if (n["stitching"] && n["stitching"].as<std::string>() == "false")
-      bStitching = false;
-
     if (n["extent"]) {
       std::vector<std::string> extent_split = stringsplit(n["extent"].as<std::string>(), ',');
       double xmin, xmax, ymin, ymax;
@@ -375,9 +246,15 @@ int main(int argc, const char * argv[]) {
       }
       else {
         std::clog << "Using extent for polygons: (" << n["extent"].as<std::string>() << ")\n";
-        map3d.set_requested_extent(xmin, ymin, xmax, ymax);
+        requestedExtent = Box2(Point2(xmin, ymin), Point2(xmax, ymax));
       }
     }
+    if (n["tile_size"])
+      tilesize = n["tile_size"].as<double>();
+    if (n["tile_buffer"])
+      tilebuffer = n["tile_buffer"].as<double>();
+    if (n["polygon_cache"])
+      polygoncache = n["polygon_cache"].as<std::string>();
   }
 
   //-- read polygon data configuration
@@ -518,41 +395,6 @@ int main(int argc, const char * argv[]) {
     }
   }
 
-  //-- add the polygons to the map3d
-  if (bPolyData) {
-    bPolyData = map3d.add_polygons_files(polygonFiles);
-  }
-  if (!bPolyData) {
-    std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
-    return EXIT_FAILURE;
-  }
-  std::clog << "\nTotal # of polygons: " << boost::locale::as::number << map3d.get_num_polygons() << std::endl;
-
-  map3d.save_building_variables();
-  //-- spatially index the polygons
-  map3d.construct_rtree();
-
-  //-- print bbox from _rtree
-  Box2 b = map3d.get_bbox();
-  std::clog << std::setprecision(3) << std::fixed;
-  std::clog << "Spatial extent: ("
-    << bg::get<bg::min_corner, 0>(b) << ", "
-    << bg::get<bg::min_corner, 1>(b) << ") ("
-    << bg::get<bg::max_corner, 0>(b) << ", "
-    << bg::get<bg::max_corner, 1>(b) << ")\n";
-
-  //-- add the elevation data to the map3d
-  auto startPoints = boost::chrono::high_resolution_clock::now();
-  for (auto file : elevationFiles) {
-    bool added = map3d.add_las_file(file);
-    if (!added) {
-      std::cerr << "ERROR: corrupt file " << file.filename << std::endl;
-      return EXIT_FAILURE;
-    }
-  }
-  print_duration("All points read in %lld seconds || %02d:%02d:%02d\n", startPoints);
-
-  std::clog << "3dfying all input polygons...\n";
   bool threedfy = true;
   bool cdt = true;
   int outputcount = 0;
@@ -582,116 +424,345 @@ int main(int argc, const char * argv[]) {
       bStitching = false;
     }
   }
-  if (threedfy) {
-    auto startThreeDfy = boost::chrono::high_resolution_clock::now();
-    map3d.threeDfy(bStitching);
-    print_duration("Lifting, stitching and vertical walls done in %lld seconds || %02d:%02d:%02d\n", startThreeDfy);
+
+  //-- with tiling the extent is cut in tiles of tile_size, each tile is processed on its own
+  //-- with the polygons within tile_buffer around it, and only the features of the tile are written
+  Box2 tilingExtent = requestedExtent;
+  int ncols = 1;
+  int nrows = 1;
+  if (tilesize > 0 || shardcount > 1) {
+    if (bg::area(tilingExtent) <= 0) {
+      Map3d map3dextent;
+      if (!bPolyData || !map3dextent.get_polygons_extent(polygonFiles, tilingExtent)) {
+        std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
+        return EXIT_FAILURE;
+      }
+    }
+    //-- sharding without tiling: about 4 tiles per shard so the shards get a similar load
+    if (tilesize <= 0) {
+      tilesize = std::sqrt(bg::area(tilingExtent) / (4 * shardcount));
+    }
+    //-- without a buffer the features on the tile borders have no neighbours to be stitched
+    //-- to and the seams between the shards crack: use a tenth of the tile (at least 100m)
+    if (shardcount > 1 && tilebuffer <= 0) {
+      tilebuffer = std::max(100.0, 0.1 * tilesize);
+      std::clog << "Warning: sharding without tile_buffer, using a buffer of " << tilebuffer << "m; set tile_buffer larger than the polygons crossing the tile borders.\n";
+    }
+    ncols = std::max(1, int(std::ceil((bg::get<bg::max_corner, 0>(tilingExtent) - bg::get<bg::min_corner, 0>(tilingExtent)) / tilesize)));
+    nrows = std::max(1, int(std::ceil((bg::get<bg::max_corner, 1>(tilingExtent) - bg::get<bg::min_corner, 1>(tilingExtent)) / tilesize)));
+    std::clog << "Tiling: " << ncols << " x " << nrows << " tiles of " << tilesize << "m with a buffer of " << tilebuffer << "m\n";
+    if (shardcount > 1) {
+      std::clog << "Shard " << shardindex << "/" << shardcount << ": processing every " << shardcount << "th tile\n";
+    }
   }
-  if (cdt) {
-    auto startCDT = boost::chrono::high_resolution_clock::now();
-    if (!map3d.construct_CDT()) {
-      return EXIT_FAILURE;
+
+  //-- sweep: each variant of the lifting_options is lifted and written on its own. The
+  //-- polygons and the points are read only for the first variant of a tile, the others
+  //-- build their features from the polygons kept in memory (as a polygon cache) and
+  //-- get the points assigned from a checkpoint file, which is memory-mapped
+  std::vector< std::pair<std::string, YAML::Node> > variants;
+  if (nodes["lifting_variants"]) {
+    YAML::Node n = nodes["lifting_variants"];
+    for (auto it = n.begin(); it != n.end(); ++it)
+      variants.emplace_back(it->first.as<std::string>(), it->second);
+    for (auto& output : outputs) {
+      if (output.first.find("PostGIS") != std::string::npos && output.second != "") {
+        std::cerr << "ERROR: lifting_variants cannot be written to " << output.first << ". Aborting.\n";
+        return EXIT_FAILURE;
+      }
     }
-    print_duration("CDT created in %lld seconds || %02d:%02d:%02d\n", startCDT);
   }
-  std::clog << "...3dfying done.\n";
-  map3d.cleanup_elevations();
+  else {
+    variants.emplace_back(std::string(), YAML::Node());
+  }
+  std::string polygons;
+  std::string assigned;
+  boost::filesystem::path tmpcheckpoint;
+  if (variants.size() > 1 && savecheckpoint.empty() && loadcheckpoint.empty()) {
+    tmpcheckpoint = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("3dfier-%%%%-%%%%-%%%%.ckpt");
+  }
+  //-- the temporary checkpoint is removed however main() returns
+  struct RemoveFile {
+    boost::filesystem::path path;
+    ~RemoveFile() {
+      boost::system::error_code ec;
+      if (!path.empty())
+        boost::filesystem::remove(path, ec);
+    }
+  } removetmpcheckpoint = { tmpcheckpoint };
+
+  for (int job = 0; job < ncols * nrows * int(variants.size()); job++) {
+    int tile = job / int(variants.size());
+    std::size_t v = job % variants.size();
+    if (tile % shardcount != shardindex) {
+      continue;
+    }
+    int col = tile % ncols;
+    int row = tile / ncols;
+    Map3d map3d;
+    set_map3d_options(map3d, nodes, bStitching);
+    if (variants[v].second.IsMap()) {
+      set_lifting_options(map3d, variants[v].second);
+    }
+    if (tilesize > 0) {
+      double xmin = bg::get<bg::min_corner, 0>(tilingExtent) + col * tilesize;
+      double ymin = bg::get<bg::min_corner, 1>(tilingExtent) + row * tilesize;
+      //-- the buffer is clipped to the tiling extent so the same polygons are used as without tiling
+      map3d.set_requested_extent(
+        std::max(xmin - tilebuffer, bg::get<bg::min_corner, 0>(tilingExtent)),
+        std::max(ymin - tilebuffer, bg::get<bg::min_corner, 1>(tilingExtent)),
+        std::min(xmin + tilesize + tilebuffer, bg::get<bg::max_corner, 0>(tilingExtent)),
+        std::min(ymin + tilesize + tilebuffer, bg::get<bg::max_corner, 1>(tilingExtent)));
+      map3d.set_tile(tilingExtent, tilesize, col, row);
+      std::clog << "\n===== TILE " << col << "-" << row << " (" << tile + 1 << "/" << ncols * nrows << ") =====\n";
+    }
+    else if (bg::area(requestedExtent) > 0) {
+      map3d.set_requested_extent(bg::get<bg::min_corner, 0>(requestedExtent), bg::get<bg::min_corner, 1>(requestedExtent),
+        bg::get<bg::max_corner, 0>(requestedExtent), bg::get<bg::max_corner, 1>(requestedExtent));
+    }
+
+    if (!variants[v].first.empty()) {
+      std::clog << "\n===== VARIANT " << variants[v].first << " =====\n";
+    }
 
-  //-- iterate over all output
-  for (auto& output : outputs) {
-    auto startFileWriting = boost::chrono::high_resolution_clock::now();
-    std::string format = output.first;
-    if (output.second == "")
+    //-- add the polygons to the map3d
+    if (!polygoncache.empty()) {
+      map3d.set_polygon_cache((tilesize > 0) ? get_tile_filename(polygoncache, col, row) : polygoncache);
+    }
+    if (v > 0) {
+      bPolyData = map3d.load_polygon_cache(polygons.data(), polygons.data() + polygons.size());
+    }
+    else if (bPolyData) {
+      bPolyData = map3d.add_polygons_files(polygonFiles);
+    }
+    if (!bPolyData) {
+      std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
+      return EXIT_FAILURE;
+    }
+    if (v == 0 && variants.size() > 1) {
+      std::ostringstream oss;
+      map3d.save_polygon_cache(oss);
+      polygons = oss.str();
+    }
+    std::clog << "\nTotal # of polygons: " << boost::locale::as::number << map3d.get_num_polygons() << std::endl;
+    if (tilesize > 0 && map3d.get_num_polygons() == 0) {
       continue;
+    }
 
-    bool fileWritten = true;
-    std::wofstream of;
-    std::string ofname = output.second;
-    if (format != "CityGML-Multifile" && format != "CityGML-IMGeo-Multifile" && format != "CityJSON" &&
-      format != "Shapefile" && format != "Shapefile-Multifile" &&
-      format != "PostGIS" && format != "PostGIS-Multi" && format != "PostGIS-PDOK" && format != "PostGIS-PDOK-CityGML" &&
-      format != "GDAL") {
-      of.open(ofname);
-    }
-    if (format == "CityGML") {
-      std::clog << "CityGML output: " << ofname << std::endl;
-      map3d.get_citygml(of);
-    }
-    else if (format == "CityGML-Multifile") {
-      std::clog << "CityGML multiple file output: " << ofname << std::endl;
-      map3d.get_citygml_multifile(ofname);
-    }
-    else if (format == "CityGML-IMGeo") {
-      std::clog << "IMGeo (CityGML ADE) output: " << ofname << std::endl;
-      map3d.get_citygml_imgeo(of);
-    }
-    else if (format == "CityGML-IMGeo-Multifile") {
-      std::clog << "IMGeo (CityGML ADE) multiple file output: " << ofname << std::endl;
-      map3d.get_citygml_imgeo_multifile(ofname);
-    }
-    else if (format == "CityJSON") {
-      std::clog << "CityJSON output: " << ofname << std::endl;
-      fileWritten = map3d.get_cityjson(ofname);
-    }
-    else if (format == "OBJ") {
-      std::clog << "OBJ output: " << ofname << std::endl;
-      map3d.get_obj_per_feature(of);
-    }
-    else if (format == "OBJ-NoID") {
-      std::clog << "OBJ (without IDs) output: " << ofname << std::endl;
-      map3d.get_obj_per_class(of);
-    }
-    else if (format == "CSV-BUILDINGS") {
-      std::clog << "CSV output (only of the buildings): " << ofname << std::endl;
-      map3d.get_csv_buildings(of);
-    }
-    else if (format == "CSV-BUILDINGS-MULTIPLE") {
-      std::clog << "CSV output with multiple heights (only of the buildings): " << ofname << std::endl;
-      map3d.get_csv_buildings_multiple_heights(of);
-    }
-    else if (format == "CSV-BUILDINGS-ALL-Z") {
-      std::clog << "CSV output with all z values (only of the buildings): " << ofname << std::endl;
-      map3d.get_csv_buildings_all_elevation_points(of);
-    }
-    else if (format == "Shapefile") {
-      std::clog << "Shapefile output: " << ofname << std::endl;
-      fileWritten = map3d.get_gdal_output(ofname, "ESRI Shapefile", false);
-    }
-    else if (format == "Shapefile-Multifile") {
-      std::clog << "Shapefile multiple file output: " << ofname << std::endl;
-      fileWritten = map3d.get_gdal_output(ofname, "ESRI Shapefile", true);
-    }
-    else if (format == "PostGIS") {
-      std::clog << "PostGIS output\n";
-      fileWritten = map3d.get_gdal_output(ofname, "PostgreSQL", false);
-    }
-    else if (format == "PostGIS-Multi") {
-      std::clog << "PostGIS multiple table output\n";
-      fileWritten = map3d.get_gdal_output(ofname, "PostgreSQL", true);
-    }
-    else if (format == "PostGIS-PDOK") {
-      std::clog << "PostGIS with IMGeo GML string output\n";
-      fileWritten = map3d.get_pdok_output(ofname);
-    }
-    else if (format == "PostGIS-PDOK-CityGML") {
-      std::clog << "PostGIS with CityGML string output\n";
-      fileWritten = map3d.get_pdok_citygml_output(ofname);
-    }
-    else if (format == "GDAL") { //-- TODO: what is this? a path? how to use?
-      if (nodes["output"] && nodes["output"]["gdal_driver"]) {
-        std::string driver = nodes["output"]["gdal_driver"].as<std::string>();
-        std::clog << "GDAL output using driver '" + driver + "'\n";
-        fileWritten = map3d.get_gdal_output(ofname, driver, false);
-      }
-    }
-    of.close();
+    map3d.save_building_variables();
+    //-- spatially index the polygons
+    map3d.construct_rtree();
 
-    if (fileWritten) {
-      print_duration("Features written in %d seconds || %02d:%02d:%02d\n", startFileWriting);
+    //-- print bbox from _rtree
+    Box2 b = map3d.get_bbox();
+    std::clog << std::setprecision(3) << std::fixed;
+    std::clog << "Spatial extent: ("
+      << bg::get<bg::min_corner, 0>(b) << ", "
+      << bg::get<bg::min_corner, 1>(b) << ") ("
+      << bg::get<bg::max_corner, 0>(b) << ", "
+      << bg::get<bg::max_corner, 1>(b) << ")\n";
+
+    //-- add the elevation data to the map3d, or the points assigned in a previous run
+    auto startPoints = boost::chrono::high_resolution_clock::now();
+    if (!loadcheckpoint.empty()) {
+      std::string filename = (tilesize > 0) ? get_tile_filename(loadcheckpoint, col, row) : loadcheckpoint;
+      if (!map3d.load_checkpoint(filename)) {
+        return EXIT_FAILURE;
+      }
+    }
+    else if (v > 0) {
+      if (!map3d.load_checkpoint(assigned)) {
+        return EXIT_FAILURE;
+      }
     }
     else {
-      std::cerr << "ERROR: Writing features failed for " << format << ". Aborting.\n";
-      return EXIT_FAILURE;
+      map3d.set_checkpoint_save(!savecheckpoint.empty() || variants.size() > 1);
+      for (auto file : elevationFiles) {
+        bool added = map3d.add_las_file(file);
+        if (!added) {
+          std::cerr << "ERROR: corrupt file " << file.filename << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+      if (!savecheckpoint.empty()) {
+        assigned = (tilesize > 0) ? get_tile_filename(savecheckpoint, col, row) : savecheckpoint;
+      }
+      else {
+        assigned = tmpcheckpoint.string();
+      }
+      if (!assigned.empty() && !map3d.save_checkpoint(assigned)) {
+        return EXIT_FAILURE;
+      }
+      map3d.thin_checkpoint_lidar_points();
+    }
+    print_duration("All points read in %lld seconds || %02d:%02d:%02d\n", startPoints);
+
+    std::clog << "3dfying all input polygons...\n";
+    if (threedfy) {
+      auto startThreeDfy = boost::chrono::high_resolution_clock::now();
+      map3d.threeDfy(bStitching);
+      print_duration("Lifting, stitching and vertical walls done in %lld seconds || %02d:%02d:%02d\n", startThreeDfy);
+    }
+    if (cdt) {
+      auto startCDT = boost::chrono::high_resolution_clock::now();
+      if (!map3d.construct_CDT()) {
+        return EXIT_FAILURE;
+      }
+      print_duration("CDT created in %lld seconds || %02d:%02d:%02d\n", startCDT);
+    }
+    std::clog << "...3dfying done.\n";
+    map3d.cleanup_elevations();
+    if (tilesize > 0) {
+      unsigned long removed = map3d.remove_features_outside_tile();
+      std::clog << "Features in tile: " << boost::locale::as::number << map3d.get_num_polygons() << " (" << removed << " in the buffer)\n";
+      if (map3d.get_num_polygons() == 0) {
+        continue;
+      }
+    }
+
+    //-- iterate over all output, the formats written by Map3d::get_outputs()
+    //-- are collected and written together in one pass over the features
+    std::vector<std::pair<std::string, std::string> > onepass;
+    for (auto& output : outputs) {
+      auto startFileWriting = boost::chrono::high_resolution_clock::now();
+      std::string format = output.first;
+      if (output.second == "")
+        continue;
+
+      bool fileWritten = true;
+      std::wofstream of;
+      std::string ofname = output.second;
+      if (!variants[v].first.empty()) {
+        ofname = add_filename_suffix(ofname, variants[v].first);
+      }
+      if (tilesize > 0 && format.find("PostGIS") == std::string::npos) {
+        ofname = get_tile_filename(ofname, col, row);
+      }
+      if (format != "CityGML" && format != "CityGML-Multifile" && format != "CityGML-IMGeo" && format != "CityGML-IMGeo-Multifile" &&
+        format != "CityJSON" && format != "CityJSONSeq" && format != "OBJ" && format != "OBJ-NoID" &&
+        format != "OBJ-Multifile" && format != "OBJ-PerFeature" && format != "GLB" && format != "3DTiles" &&
+        format != "Shapefile" && format != "Shapefile-Multifile" &&
+        format != "PostGIS" && format != "PostGIS-Multi" && format != "PostGIS-PDOK" && format != "PostGIS-PDOK-CityGML" &&
+        format != "GDAL" && format != "GPKG") {
+        of.open(ofname);
+      }
+      if (format == "CityGML") {
+        std::clog << "CityGML output: " << ofname << std::endl;
+        onepass.push_back(std::make_pair(format, ofname));
+        continue;
+      }
+      else if (format == "CityGML-Multifile") {
+        std::clog << "CityGML multiple file output: " << ofname << std::endl;
+        map3d.get_citygml_multifile(ofname);
+      }
+      else if (format == "CityGML-IMGeo") {
+        std::clog << "IMGeo (CityGML ADE) output: " << ofname << std::endl;
+        onepass.push_back(std::make_pair(format, ofname));
+        continue;
+      }
+      else if (format == "CityGML-IMGeo-Multifile") {
+        std::clog << "IMGeo (CityGML ADE) multiple file output: " << ofname << std::endl;
+        map3d.get_citygml_imgeo_multifile(ofname);
+      }
+      else if (format == "CityJSON") {
+        std::clog << "CityJSON output: " << ofname << std::endl;
+        onepass.push_back(std::make_pair(format, ofname));
+        continue;
+      }
+      else if (format == "CityJSONSeq") {
+        std::clog << "CityJSONSeq output: " << ofname << std::endl;
+        onepass.push_back(std::make_pair(format, ofname));
+        continue;
+      }
+      else if (format == "OBJ") {
+        std::clog << "OBJ output: " << ofname << std::endl;
+        onepass.push_back(std::make_pair(format, ofname));
+        continue;
+      }
+      else if (format == "OBJ-NoID") {
+        std::clog << "OBJ (without IDs) output: " << ofname << std::endl;
+        fileWritten = map3d.get_obj_per_class(ofname);
+      }
+      else if (format == "OBJ-Multifile") {
+        std::clog << "OBJ multiple file output: " << ofname << std::endl;
+        fileWritten = map3d.get_obj_multifile(ofname, false);
+      }
+      else if (format == "OBJ-PerFeature") {
+        std::clog << "OBJ file per feature output: " << ofname << std::endl;
+        fileWritten = map3d.get_obj_multifile(ofname, true);
+      }
+      else if (format == "GLB") {
+        std::clog << "GLB (binary glTF) output: " << ofname << std::endl;
+        fileWritten = map3d.get_glb(ofname);
+      }
+      else if (format == "3DTiles") {
+        std::clog << "3D Tiles output: " << ofname << std::endl;
+        fileWritten = map3d.get_3dtiles(ofname);
+      }
+      else if (format == "CSV-BUILDINGS") {
+        std::clog << "CSV output (only of the buildings): " << ofname << std::endl;
+        map3d.get_csv_buildings(of);
+      }
+      else if (format == "CSV-BUILDINGS-MULTIPLE") {
+        std::clog << "CSV output with multiple heights (only of the buildings): " << ofname << std::endl;
+        map3d.get_csv_buildings_multiple_heights(of);
+      }
+      else if (format == "CSV-BUILDINGS-ALL-Z") {
+        std::clog << "CSV output with all z values (only of the buildings): " << ofname << std::endl;
+        map3d.get_csv_buildings_all_elevation_points(of);
+      }
+      else if (format == "Shapefile") {
+        std::clog << "Shapefile output: " << ofname << std::endl;
+        fileWritten = map3d.get_gdal_output(ofname, "ESRI Shapefile", false);
+      }
+      else if (format == "Shapefile-Multifile") {
+        std::clog << "Shapefile multiple file output: " << ofname << std::endl;
+        fileWritten = map3d.get_gdal_output(ofname, "ESRI Shapefile", true);
+      }
+      else if (format == "PostGIS") {
+        std::clog << "PostGIS output\n";
+        fileWritten = map3d.get_gdal_output(ofname, "PostgreSQL", false);
+      }
+      else if (format == "PostGIS-Multi") {
+        std::clog << "PostGIS multiple table output\n";
+        fileWritten = map3d.get_gdal_output(ofname, "PostgreSQL", true);
+      }
+      else if (format == "PostGIS-PDOK") {
+        std::clog << "PostGIS with IMGeo GML string output\n";
+        fileWritten = map3d.get_pdok_output(ofname);
+      }
+      else if (format == "PostGIS-PDOK-CityGML") {
+        std::clog << "PostGIS with CityGML string output\n";
+        fileWritten = map3d.get_pdok_citygml_output(ofname);
+      }
+      else if (format == "GPKG") {
+        std::clog << "GeoPackage output: " << ofname << std::endl;
+        fileWritten = map3d.get_gdal_output(ofname, "GPKG", false);
+      }
+      else if (format == "GDAL") { //-- TODO: what is this? a path? how to use?
+        if (nodes["output"] && nodes["output"]["gdal_driver"]) {
+          std::string driver = nodes["output"]["gdal_driver"].as<std::string>();
+          std::clog << "GDAL output using driver '" + driver + "'\n";
+          fileWritten = map3d.get_gdal_output(ofname, driver, false);
+        }
+      }
+      of.close();
+
+      if (fileWritten) {
+        print_duration("Features written in %d seconds || %02d:%02d:%02d\n", startFileWriting);
+      }
+      else {
+        std::cerr << "ERROR: Writing features failed for " << format << ". Aborting.\n";
+        return EXIT_FAILURE;
+      }
+    }
+    if (!onepass.empty()) {
+      auto startFileWriting = boost::chrono::high_resolution_clock::now();
+      if (!map3d.get_outputs(onepass)) {
+        std::cerr << "ERROR: Writing features failed. Aborting.\n";
+        return EXIT_FAILURE;
+      }
+      print_duration("Features written in %d seconds || %02d:%02d:%02d\n", startFileWriting);
     }
   }
 
@@ -736,362 +807,633 @@ void print_duration(std::string message, boost::chrono::time_point<boost::chrono
   );
 }
 
-bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
-  YAML::Node nodes;
-  try {
-    nodes = YAML::LoadFile(arg);
+//-- out.obj -> out_suffix.obj
+std::string add_filename_suffix(std::string filename, std::string suffix) {
+  boost::filesystem::path p(filename);
+  std::string name = p.stem().string() + "_" + suffix + p.extension().string();
+  return (p.parent_path() / name).string();
+}
+
+//-- the tile of a file output is added to its name: out.obj -> out_2_3.obj
+std::string get_tile_filename(std::string filename, int col, int row) {
+  return add_filename_suffix(filename, std::to_string(col) + "_" + std::to_string(row));
+}
+
+void set_lifting_options(Map3d& map3d, YAML::Node n) {
+  if (n["Building"]) {
+    if (n["Building"]["roof"]) {
+      if (n["Building"]["roof"]["height"]) {
+        std::string height = n["Building"]["roof"]["height"].as<std::string>();
+        map3d.set_building_heightref_roof(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+      }
+      YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class(LAS_BUILDING_ROOF, it2->as<int>());
+      if (n["Building"]["roof"]["use_LAS_classes_within"]) {
+        tmp = n["Building"]["roof"]["use_LAS_classes_within"];
+        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+          map3d.add_allowed_las_class_within(LAS_BUILDING_ROOF, it2->as<int>());
+      }
+    }
+    if (n["Building"]["ground"]) {
+      if (n["Building"]["ground"]["height"]) {
+        std::string height = n["Building"]["ground"]["height"].as<std::string>();
+        map3d.set_building_heightref_ground(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+      }
+      YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class(LAS_BUILDING_GROUND, it2->as<int>());
+      if (n["Building"]["ground"]["use_LAS_classes_within"]) {
+        tmp = n["Building"]["ground"]["use_LAS_classes_within"];
+        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+          map3d.add_allowed_las_class_within(LAS_BUILDING_GROUND, it2->as<int>());
+      }
+    }
+    if (n["Building"]["lod"]) {
+      map3d.set_building_lod(n["Building"]["lod"].as<int>());
+    }
+    if (n["Building"]["triangulate"]) {
+      if (n["Building"]["triangulate"].as<std::string>() == "true")
+        map3d.set_building_triangulate(true);
+      else
+        map3d.set_building_triangulate(false);
+    }
+    if (n["Building"]["floor"]) {
+      if (n["Building"]["floor"].as<std::string>() == "true")
+        map3d.set_building_include_floor(true);
+      else
+        map3d.set_building_include_floor(false);
+    }
+    if (n["Building"]["inner_walls"]) {
+      if (n["Building"]["inner_walls"].as<std::string>() == "true")
+        map3d.set_building_inner_walls(true);
+      else
+        map3d.set_building_inner_walls(false);
+    }
   }
-  catch (const std::exception&) {
-    std::cerr << "ERROR: YAML structure of config is invalid.\n";
-    return false;
+  if (n["Terrain"]) {
+    if (n["Terrain"]["simplification"])
+      map3d.set_terrain_simplification(n["Terrain"]["simplification"].as<int>());
+    if (n["Terrain"]["simplification_tinsimp"] != 0)
+      map3d.set_terrain_simplification_tinsimp(n["Terrain"]["simplification_tinsimp"].as<double>());
+    if (n["Terrain"]["simplification_tinsimp_method"] && n["Terrain"]["simplification_tinsimp_method"].as<std::string>() == "batch")
+      map3d.set_terrain_simplification_tinsimp_method(TINSIMP_BATCH);
+    if (n["Terrain"]["innerbuffer"])
+      map3d.set_terrain_innerbuffer(n["Terrain"]["innerbuffer"].as<float>());
+    YAML::Node tmp = n["Terrain"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_TERRAIN, it2->as<int>());
+    if (n["Terrain"]["use_LAS_classes_within"]) {
+      tmp = n["Terrain"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_TERRAIN, it2->as<int>());
+    }
+  }
+  if (n["Forest"]) {
+    if (n["Forest"]["simplification"])
+      map3d.set_forest_simplification(n["Forest"]["simplification"].as<int>());
+    if (n["Forest"]["simplification_tinsimp"] != 0)
+      map3d.set_forest_simplification_tinsimp(n["Forest"]["simplification_tinsimp"].as<double>());
+    if (n["Forest"]["simplification_tinsimp_method"] && n["Forest"]["simplification_tinsimp_method"].as<std::string>() == "batch")
+      map3d.set_forest_simplification_tinsimp_method(TINSIMP_BATCH);
+    if (n["Forest"]["innerbuffer"])
+      map3d.set_forest_innerbuffer(n["Forest"]["innerbuffer"].as<float>());
+    YAML::Node tmp = n["Forest"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_FOREST, it2->as<int>());
+    if (n["Forest"]["use_LAS_classes_within"]) {
+      tmp = n["Forest"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_FOREST, it2->as<int>());
+    }
+  }
+  if (n["Water"]) {
+    if (n["Water"]["height"]) {
+      std::string height = n["Water"]["height"].as<std::string>();
+      map3d.set_water_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    YAML::Node tmp = n["Water"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_WATER, it2->as<int>());
+    if (n["Water"]["use_LAS_classes_within"]) {
+      tmp = n["Water"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_WATER, it2->as<int>());
+    }
+  }
+  if (n["Road"]) {
+    if (n["Road"]["height"]) {
+      std::string height = n["Road"]["height"].as<std::string>();
+      map3d.set_road_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    if (n["Road"]["filter_outliers"]) {
+      if (n["Road"]["filter_outliers"].as<std::string>() == "true")
+        map3d.set_road_filter_outliers(true);
+      else
+        map3d.set_road_filter_outliers(false);
+    }
+    if (n["Road"]["flatten"]) {
+      if (n["Road"]["flatten"].as<std::string>() == "true")
+        map3d.set_road_flatten(true);
+      else
+        map3d.set_road_flatten(false);
+    }
+    YAML::Node tmp = n["Road"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_ROAD, it2->as<int>());
+    if (n["Road"]["use_LAS_classes_within"]) {
+      tmp = n["Road"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_ROAD, it2->as<int>());
+    }
+  }
+  if (n["Separation"]) {
+    if (n["Separation"]["height"]) {
+      std::string height = n["Separation"]["height"].as<std::string>();
+      map3d.set_separation_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    YAML::Node tmp = n["Separation"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_SEPARATION, it2->as<int>());
+    if (n["Separation"]["use_LAS_classes_within"]) {
+      tmp = n["Separation"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_SEPARATION, it2->as<int>());
+    }
+  }
+  if (n["Bridge/Overpass"]) {
+    if (n["Bridge/Overpass"]["height"]) {
+      std::string height = n["Bridge/Overpass"]["height"].as<std::string>();
+      map3d.set_bridge_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    if (n["Bridge/Overpass"]["flatten"]) {
+      if (n["Bridge/Overpass"]["flatten"].as<std::string>() == "true")
+        map3d.set_bridge_flatten(true);
+      else
+        map3d.set_bridge_flatten(false);
+    }
+    YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes"];
+    for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+      map3d.add_allowed_las_class(LAS_BRIDGE, it2->as<int>());
+    if (n["Bridge/Overpass"]["use_LAS_classes_within"]) {
+      tmp = n["Bridge/Overpass"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2)
+        map3d.add_allowed_las_class_within(LAS_BRIDGE, it2->as<int>());
+    }
   }
+}
+
+void set_map3d_options(Map3d& map3d, YAML::Node& nodes, bool& bStitching) {
+  //-- store the lifting options in the Map3d
+  if (nodes["lifting_options"])
+    set_lifting_options(map3d, nodes["lifting_options"]);
+
+  //-- set al general options
+  if (nodes["options"]) {
+    YAML::Node n = nodes["options"];
+    if (n["radius_vertex_elevation"])
+      map3d.set_radius_vertex_elevation(n["radius_vertex_elevation"].as<float>());
+    if (n["building_radius_vertex_elevation"])
+      map3d.set_building_radius_vertex_elevation(n["building_radius_vertex_elevation"].as<float>());
+    if (n["threshold_jump_edges"])
+      map3d.set_threshold_jump_edges(n["threshold_jump_edges"].as<float>());
+    if (n["stitching"] && n["stitching"].as<std::string>() == "false")
+      bStitching = false;
+    if (n["threads"])
+      map3d.set_threads(n["threads"].as<int>());
+    if (n["cdt_split_points"])
+      map3d.set_cdt_split_points(n["cdt_split_points"].as<int>());
+    if (n["cdt_split_area"])
+      map3d.set_cdt_split_area(n["cdt_split_area"].as<double>());
+    if (n["fast_triangulation"] && n["fast_triangulation"].as<std::string>() == "false")
+      map3d.set_fast_triangulation(false);
+    if (n["cdt_validation"] && n["cdt_validation"].as<std::string>() == "false")
+      map3d.set_cdt_validation(false);
+    if (n["lift_gap_fill"] && n["lift_gap_fill"].as<std::string>() == "interpolate")
+      map3d.set_lift_gap_interpolation(true);
+  }
+
+  //-- output options
+  if (nodes["output"]) {
+    YAML::Node n = nodes["output"];
+    if (n["cityjson_transform"] && n["cityjson_transform"].as<std::string>() == "true")
+      map3d.set_cityjson_transform(true);
+    if (n["obj_tile_size"])
+      map3d.set_obj_tile_size(n["obj_tile_size"].as<double>());
+    if (n["tileset_max_features"])
+      map3d.set_tileset_max_features(n["tileset_max_features"].as<int>());
+    if (n["tileset_epsg"])
+      map3d.set_tileset_epsg(n["tileset_epsg"].as<int>());
+  }
+}
+
+bool validate_lifting_options(YAML::Node n) {
   bool wentgood = true;
-  //-- 1. input polygons classes
-  if (nodes["input_polygons"]) {
-    YAML::Node n = nodes["input_polygons"];
-    for (auto it = n.begin(); it != n.end(); ++it) {
-      if ((*it)["lifting_per_layer"]) {
-        YAML::Node tmp = (*it)["lifting_per_layer"];
+  if (n["Building"]) {
+    if (n["Building"]["roof"]) {
+      if (n["Building"]["roof"]["height"]) {
+        std::string s = n["Building"]["roof"]["height"].as<std::string>();
+        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+          wentgood = false;
+          std::cerr << "\tOption 'Building.roof.height' invalid; must be 'percentile-XX'.\n";
+        }
+      }
+      if (n["Building"]["roof"]["use_LAS_classes"]) {
+        YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes"];
         for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (allowedFeatures.count((it2->second).as<std::string>()) == 0) {
-            std::cerr << "\tLifting class '" << (it2->second).as<std::string>() << "' unknown.\n";
+          if (is_string_integer(it2->as<std::string>()) == false) {
             wentgood = false;
+            std::cerr << "\tOption 'Building.roof.use_LAS_classes' invalid; must be an integer.\n";
           }
         }
       }
-      else if ((*it)["lifting"]) {
-        if ((*it)["lifting"].IsNull()) {
-          std::cerr << "Option 'lifting' invalid; supplied empty attribute. \n";
-          wentgood = false;
-        }
-        else if (allowedFeatures.count((*it)["lifting"].as<std::string>()) == 0) {
-          std::cerr << "\tLifting class '" << (*it)["lifting"].as<std::string>() << "' unknown.\n";
-          wentgood = false;
+      if (n["Building"]["roof"]["use_LAS_classes_within"]) {
+        YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes_within"];
+        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+          if (is_string_integer(it2->as<std::string>()) == false) {
+            wentgood = false;
+            std::cerr << "\tOption 'Building.roof.use_LAS_classes_within' invalid; must be an integer.\n";
+          }
         }
-        if ((*it)["uniqueid"].IsNull()) {
-          std::cerr << "Option 'uniqueid' invalid; supplied empty attribute. \n";
+      }
+    }
+    if (n["Building"]["ground"]) {
+      if (n["Building"]["ground"]["height"]) {
+        std::string s = n["Building"]["ground"]["height"].as<std::string>();
+        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
           wentgood = false;
+          std::cerr << "\tOption 'Building.ground.height' invalid; must be 'percentile-XX'.\n";
         }
-        if ((*it)["height_field"].IsNull()) {
-          std::cerr << "Option 'height_field' invalid; supplied empty attribute. \n";
-          wentgood = false;
+      }
+      if (n["Building"]["ground"]["use_LAS_classes"]) {
+        YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes"];
+        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+          if (is_string_integer(it2->as<std::string>()) == false) {
+            wentgood = false;
+            std::cerr << "\tOption 'Building.ground.use_LAS_classes' invalid; must be an integer.\n";
+          }
         }
       }
-    }
-  }
-  else {
-    std::cerr << "Group 'input_polygons' not defined. \n";
-    wentgood = false;
-  }
-
-  //-- 2. lifting_options
-  if (nodes["lifting_options"]) {
-    YAML::Node n = nodes["lifting_options"];
-    if (n["Building"]) {
-      if (n["Building"]["roof"]) {
-        if (n["Building"]["roof"]["height"]) {
-          std::string s = n["Building"]["roof"]["height"].as<std::string>();
-          if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-            (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+      if (n["Building"]["ground"]["use_LAS_classes_within"]) {
+        YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes_within"];
+        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+          if (is_string_integer(it2->as<std::string>()) == false) {
             wentgood = false;
-            std::cerr << "\tOption 'Building.roof.height' invalid; must be 'percentile-XX'.\n";
-          }
-        }
-        if (n["Building"]["roof"]["use_LAS_classes"]) {
-          YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-            if (is_string_integer(it2->as<std::string>()) == false) {
-              wentgood = false;
-              std::cerr << "\tOption 'Building.roof.use_LAS_classes' invalid; must be an integer.\n";
-            }
-          }
-        }
-        if (n["Building"]["roof"]["use_LAS_classes_within"]) {
-          YAML::Node tmp = n["Building"]["roof"]["use_LAS_classes_within"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-            if (is_string_integer(it2->as<std::string>()) == false) {
-              wentgood = false;
-              std::cerr << "\tOption 'Building.roof.use_LAS_classes_within' invalid; must be an integer.\n";
-            }
+            std::cerr << "\tOption 'Building.ground.use_LAS_classes_within' invalid; must be an integer.\n";
           }
         }
       }
-      if (n["Building"]["ground"]) {
-        if (n["Building"]["ground"]["height"]) {
-          std::string s = n["Building"]["ground"]["height"].as<std::string>();
-          if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-            (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
-            wentgood = false;
-            std::cerr << "\tOption 'Building.ground.height' invalid; must be 'percentile-XX'.\n";
-          }
-        }
-        if (n["Building"]["ground"]["use_LAS_classes"]) {
-          YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-            if (is_string_integer(it2->as<std::string>()) == false) {
-              wentgood = false;
-              std::cerr << "\tOption 'Building.ground.use_LAS_classes' invalid; must be an integer.\n";
-            }
-          }
-        }
-        if (n["Building"]["ground"]["use_LAS_classes_within"]) {
-          YAML::Node tmp = n["Building"]["ground"]["use_LAS_classes_within"];
-          for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-            if (is_string_integer(it2->as<std::string>()) == false) {
-              wentgood = false;
-              std::cerr << "\tOption 'Building.ground.use_LAS_classes_within' invalid; must be an integer.\n";
-            }
-          }
-        }
+    }
+    if (n["Building"]["lod"]) {
+      if (is_string_integer(n["Building"]["lod"].as<std::string>(), 0, 1) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'Building.lod' invalid; must be an integer between 0 and 1.\n";
+      }
+    }
+    if (n["Building"]["triangulate"]) {
+      std::string s = n["Building"]["triangulate"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Building.triangulate' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["Building"]["floor"]) {
+      std::string s = n["Building"]["floor"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Building.floor' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["Building"]["inner_walls"]) {
+      std::string s = n["Building"]["inner_walls"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Building.inner_walls' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+  }
+  if (n["Terrain"]) {
+    if (n["Terrain"]["simplification"]) {
+      if (is_string_integer(n["Terrain"]["simplification"].as<std::string>()) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.simplification' invalid; must be an integer.\n";
+      }
+    }
+    if (n["Terrain"]["simplification_tinsimp"]) {
+      try {
+        boost::lexical_cast<float>(n["Terrain"]["simplification_tinsimp"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.simplification_tinsimp' invalid; must be a double.\n";
+      }
+    }
+    if (n["Terrain"]["simplification_tinsimp_method"]) {
+      std::string s = n["Terrain"]["simplification_tinsimp_method"].as<std::string>();
+      if ((s != "greedy") && (s != "batch")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.simplification_tinsimp_method' invalid; must be 'greedy' or 'batch'.\n";
       }
-      if (n["Building"]["lod"]) {
-        if (is_string_integer(n["Building"]["lod"].as<std::string>(), 0, 1) == false) {
+    }
+    if (n["Terrain"]["innerbuffer"]) {
+      try {
+        boost::lexical_cast<float>(n["Terrain"]["innerbuffer"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.innerbuffer' invalid; must be a float.\n";
+      }
+    }        
+    if (n["Terrain"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Terrain"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Building.lod' invalid; must be an integer between 0 and 1.\n";
+          std::cerr << "\tOption 'Terrain.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
-      if (n["Building"]["triangulate"]) {
-        std::string s = n["Building"]["triangulate"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
+    }        
+    if (n["Terrain"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Terrain"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Building.triangulate' invalid; must be 'true' or 'false'.\n";
+          std::cerr << "\tOption 'Terrain.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
-      if (n["Building"]["floor"]) {
-        std::string s = n["Building"]["floor"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
+    }
+  }
+  if (n["Forest"]) {
+    if (n["Forest"]["simplification"]) {
+      if (is_string_integer(n["Forest"]["simplification"].as<std::string>()) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.simplification' invalid; must be an integer.\n";
+      }
+    }
+    if (n["Forest"]["simplification_tinsimp"]) {
+      try {
+        boost::lexical_cast<float>(n["Forest"]["simplification_tinsimp"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.simplification_tinsimp' invalid; must be a double.\n";
+      }
+    }
+    if (n["Forest"]["simplification_tinsimp_method"]) {
+      std::string s = n["Forest"]["simplification_tinsimp_method"].as<std::string>();
+      if ((s != "greedy") && (s != "batch")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.simplification_tinsimp_method' invalid; must be 'greedy' or 'batch'.\n";
+      }
+    }
+    if (n["Forest"]["innerbuffer"]) {
+      try {
+        boost::lexical_cast<float>(n["Forest"]["innerbuffer"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.innerbuffer' invalid; must be a float.\n";
+      }
+    }      
+    if (n["Forest"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Forest"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Building.floor' invalid; must be 'true' or 'false'.\n";
+          std::cerr << "\tOption 'Forest.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
-      if (n["Building"]["inner_walls"]) {
-        std::string s = n["Building"]["inner_walls"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
+    } 
+    if (n["Forest"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Forest"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Building.inner_walls' invalid; must be 'true' or 'false'.\n";
+          std::cerr << "\tOption 'Forest.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
     }
-    if (n["Terrain"]) {
-      if (n["Terrain"]["simplification"]) {
-        if (is_string_integer(n["Terrain"]["simplification"].as<std::string>()) == false) {
-          wentgood = false;
-          std::cerr << "\tOption 'Terrain.simplification' invalid; must be an integer.\n";
-        }
+  }
+  if (n["Water"]) {
+    if (n["Water"]["height"]) {
+      std::string s = n["Water"]["height"].as<std::string>();
+      if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+        (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+        wentgood = false;
+        std::cerr << "\tOption 'Water.height' invalid; must be 'percentile-XX'.\n";
       }
-      if (n["Terrain"]["simplification_tinsimp"]) {
-        try {
-          boost::lexical_cast<float>(n["Terrain"]["simplification_tinsimp"].as<std::string>());
-        }
-        catch (boost::bad_lexical_cast& e) {
+    }      
+    if (n["Water"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Water"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Terrain.simplification_tinsimp' invalid; must be a double.\n";
+          std::cerr << "\tOption 'Water.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
-      if (n["Terrain"]["innerbuffer"]) {
-        try {
-          boost::lexical_cast<float>(n["Terrain"]["innerbuffer"].as<std::string>());
-        }
-        catch (boost::bad_lexical_cast& e) {
+    }   
+    if (n["Water"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Water"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Terrain.innerbuffer' invalid; must be a float.\n";
-        }
-      }        
-      if (n["Terrain"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Terrain"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Terrain.use_LAS_classes' invalid; must be an integer.\n";
-          }
-        }
-      }        
-      if (n["Terrain"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Terrain"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Terrain.use_LAS_classes_within' invalid; must be an integer.\n";
-          }
+          std::cerr << "\tOption 'Water.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
     }
-    if (n["Forest"]) {
-      if (n["Forest"]["simplification"]) {
-        if (is_string_integer(n["Forest"]["simplification"].as<std::string>()) == false) {
-          wentgood = false;
-          std::cerr << "\tOption 'Forest.simplification' invalid; must be an integer.\n";
-        }
+  }
+  if (n["Road"]) {
+    if (n["Road"]["height"]) {
+      std::string s = n["Road"]["height"].as<std::string>();
+      if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+        (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+        wentgood = false;
+        std::cerr << "\tOption 'Road.height' invalid; must be 'percentile-XX'.\n";
       }
-      if (n["Forest"]["simplification_tinsimp"]) {
-        try {
-          boost::lexical_cast<float>(n["Forest"]["simplification_tinsimp"].as<std::string>());
-        }
-        catch (boost::bad_lexical_cast& e) {
+    }
+    if (n["Road"]["filter_outliers"]) {
+      std::string s = n["Road"]["filter_outliers"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Road.filter_outliers' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["Road"]["flatten"]) {
+      std::string s = n["Road"]["flatten"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Road.flatten' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["Road"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Road"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Forest.simplification_tinsimp' invalid; must be a double.\n";
+          std::cerr << "\tOption 'Road.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
-      if (n["Forest"]["innerbuffer"]) {
-        try {
-          boost::lexical_cast<float>(n["Forest"]["innerbuffer"].as<std::string>());
-        }
-        catch (boost::bad_lexical_cast& e) {
+    }
+    if (n["Road"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Road"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Forest.innerbuffer' invalid; must be a float.\n";
-        }
-      }      
-      if (n["Forest"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Forest"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Forest.use_LAS_classes' invalid; must be an integer.\n";
-          }
-        }
-      } 
-      if (n["Forest"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Forest"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Forest.use_LAS_classes_within' invalid; must be an integer.\n";
-          }
+          std::cerr << "\tOption 'Road.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
     }
-    if (n["Water"]) {
-      if (n["Water"]["height"]) {
-        std::string s = n["Water"]["height"].as<std::string>();
-        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+  }
+  if (n["Separation"]) {
+    if (n["Separation"]["height"]) {
+      std::string s = n["Separation"]["height"].as<std::string>();
+      if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+        (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+        wentgood = false;
+        std::cerr << "\tOption 'Separation.height' invalid; must be 'percentile-XX'.\n";
+      }
+    }
+    if (n["Separation"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Separation"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Water.height' invalid; must be 'percentile-XX'.\n";
-        }
-      }      
-      if (n["Water"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Water"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Water.use_LAS_classes' invalid; must be an integer.\n";
-          }
-        }
-      }   
-      if (n["Water"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Water"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Water.use_LAS_classes_within' invalid; must be an integer.\n";
-          }
+          std::cerr << "\tOption 'Separation.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
     }
-    if (n["Road"]) {
-      if (n["Road"]["height"]) {
-        std::string s = n["Road"]["height"].as<std::string>();
-        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+    if (n["Separation"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Separation"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Road.height' invalid; must be 'percentile-XX'.\n";
+          std::cerr << "\tOption 'Separation.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
-      if (n["Road"]["filter_outliers"]) {
-        std::string s = n["Road"]["filter_outliers"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
+    }
+  }
+  if (n["Bridge/Overpass"]) {
+    if (n["Bridge/Overpass"]["height"]) {
+      std::string s = n["Bridge/Overpass"]["height"].as<std::string>();
+      if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
+        (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+        wentgood = false;
+        std::cerr << "\tOption 'Bridge/Overpass.height' invalid; must be 'percentile-XX'.\n";
+      }
+    }
+    if (n["Bridge/Overpass"]["use_LAS_classes"]) {
+      YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Road.filter_outliers' invalid; must be 'true' or 'false'.\n";
+          std::cerr << "\tOption 'Bridge/Overpass.use_LAS_classes' invalid; must be an integer.\n";
         }
       }
-      if (n["Road"]["flatten"]) {
-        std::string s = n["Road"]["flatten"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
+    }
+    if (n["Bridge/Overpass"]["use_LAS_classes_within"]) {
+      YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes_within"];
+      for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
+        if (is_string_integer(it2->as<std::string>()) == false) {
           wentgood = false;
-          std::cerr << "\tOption 'Road.flatten' invalid; must be 'true' or 'false'.\n";
+          std::cerr << "\tOption 'Bridge/Overpass.use_LAS_classes_within' invalid; must be an integer.\n";
         }
       }
-      if (n["Road"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Road"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Road.use_LAS_classes' invalid; must be an integer.\n";
-          }
-        }
+    }
+    if (n["Bridge/Overpass"]["flatten"]) {
+      std::string s = n["Bridge/Overpass"]["flatten"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'Bridge/Overpass.flatten' invalid; must be 'true' or 'false'.\n";
       }
-      if (n["Road"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Road"]["use_LAS_classes_within"];
+    }
+  }
+  return wentgood;
+}
+
+bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
+  YAML::Node nodes;
+  try {
+    nodes = YAML::LoadFile(arg);
+  }
+  catch (const std::exception&) {
+    std::cerr << "ERROR: YAML structure of config is invalid.\n";
+    return false;
+  }
+  bool wentgood = true;
+  //-- 1. input polygons classes
+  if (nodes["input_polygons"]) {
+    YAML::Node n = nodes["input_polygons"];
+    for (auto it = n.begin(); it != n.end(); ++it) {
+      if ((*it)["lifting_per_layer"]) {
+        YAML::Node tmp = (*it)["lifting_per_layer"];
         for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
+          if (allowedFeatures.count((it2->second).as<std::string>()) == 0) {
+            std::cerr << "\tLifting class '" << (it2->second).as<std::string>() << "' unknown.\n";
             wentgood = false;
-            std::cerr << "\tOption 'Road.use_LAS_classes_within' invalid; must be an integer.\n";
           }
         }
       }
-    }
-    if (n["Separation"]) {
-      if (n["Separation"]["height"]) {
-        std::string s = n["Separation"]["height"].as<std::string>();
-        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+      else if ((*it)["lifting"]) {
+        if ((*it)["lifting"].IsNull()) {
+          std::cerr << "Option 'lifting' invalid; supplied empty attribute. \n";
           wentgood = false;
-          std::cerr << "\tOption 'Separation.height' invalid; must be 'percentile-XX'.\n";
         }
-      }
-      if (n["Separation"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Separation"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Separation.use_LAS_classes' invalid; must be an integer.\n";
-          }
+        else if (allowedFeatures.count((*it)["lifting"].as<std::string>()) == 0) {
+          std::cerr << "\tLifting class '" << (*it)["lifting"].as<std::string>() << "' unknown.\n";
+          wentgood = false;
         }
-      }
-      if (n["Separation"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Separation"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Separation.use_LAS_classes_within' invalid; must be an integer.\n";
-          }
+        if ((*it)["uniqueid"].IsNull()) {
+          std::cerr << "Option 'uniqueid' invalid; supplied empty attribute. \n";
+          wentgood = false;
         }
-      }
-    }
-    if (n["Bridge/Overpass"]) {
-      if (n["Bridge/Overpass"]["height"]) {
-        std::string s = n["Bridge/Overpass"]["height"].as<std::string>();
-        if ((s.substr(0, s.find_first_of("-")) != "percentile") ||
-          (is_string_integer(s.substr(s.find_first_of("-") + 1), 0, 100) == false)) {
+        if ((*it)["height_field"].IsNull()) {
+          std::cerr << "Option 'height_field' invalid; supplied empty attribute. \n";
           wentgood = false;
-          std::cerr << "\tOption 'Bridge/Overpass.height' invalid; must be 'percentile-XX'.\n";
         }
       }
-      if (n["Bridge/Overpass"]["use_LAS_classes"]) {
-        YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
-            wentgood = false;
-            std::cerr << "\tOption 'Bridge/Overpass.use_LAS_classes' invalid; must be an integer.\n";
-          }
-        }
+    }
+  }
+  else {
+    std::cerr << "Group 'input_polygons' not defined. \n";
+    wentgood = false;
+  }
+
+  //-- 2. lifting_options
+  if (nodes["lifting_options"]) {
+    if (validate_lifting_options(nodes["lifting_options"]) == false)
+      wentgood = false;
+  }
+  if (nodes["lifting_variants"]) {
+    YAML::Node n = nodes["lifting_variants"];
+    if (!n.IsMap()) {
+      wentgood = false;
+      std::cerr << "\tOption 'lifting_variants' invalid; must be a list of named lifting_options.\n";
+    }
+    for (auto it = n.begin(); n.IsMap() && it != n.end(); ++it) {
+      std::string name = it->first.as<std::string>();
+      if (name.empty() || name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != std::string::npos) {
+        wentgood = false;
+        std::cerr << "\tLifting variant '" << name << "' invalid; the name can only contain letters, digits, '_' and '-'.\n";
       }
-      if (n["Bridge/Overpass"]["use_LAS_classes_within"]) {
-        YAML::Node tmp = n["Bridge/Overpass"]["use_LAS_classes_within"];
-        for (auto it2 = tmp.begin(); it2 != tmp.end(); ++it2) {
-          if (is_string_integer(it2->as<std::string>()) == false) {
+      if (!it->second.IsMap() || validate_lifting_options(it->second) == false) {
+        wentgood = false;
+        std::cerr << "\tLifting variant '" << name << "' invalid.\n";
+        continue;
+      }
+      //-- the points are assigned once for all variants
+      for (auto c = it->second.begin(); c != it->second.end(); ++c) {
+        if (!c->second.IsMap())
+          continue;
+        std::vector<YAML::Node> tmp = { c->second, c->second["roof"], c->second["ground"] };
+        for (auto& t : tmp) {
+          if (t.IsMap() && (t["use_LAS_classes"] || t["use_LAS_classes_within"])) {
             wentgood = false;
-            std::cerr << "\tOption 'Bridge/Overpass.use_LAS_classes_within' invalid; must be an integer.\n";
+            std::cerr << "\tLifting variant '" << name << "' invalid; use_LAS_classes cannot differ between variants.\n";
           }
         }
       }
-      if (n["Bridge/Overpass"]["flatten"]) {
-        std::string s = n["Bridge/Overpass"]["flatten"].as<std::string>();
-        if ((s != "true") && (s != "false")) {
-          wentgood = false;
-          std::cerr << "\tOption 'Bridge/Overpass.flatten' invalid; must be 'true' or 'false'.\n";
-        }
-      }
     }
   }
 
@@ -1156,6 +1498,79 @@ bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
         std::cerr << "\tOption 'options.stitching' invalid; must be 'true' or 'false'.\n";
       }
     }
+    if (n["threads"]) {
+      if (is_string_integer(n["threads"].as<std::string>(), 1, 1024) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.threads' invalid; must be an integer between 1 and 1024.\n";
+      }
+    }
+    if (n["cdt_split_points"]) {
+      if (is_string_integer(n["cdt_split_points"].as<std::string>(), 0, std::numeric_limits<int>::max()) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.cdt_split_points' invalid; must be a positive integer or 0.\n";
+      }
+    }
+    if (n["cdt_split_area"]) {
+      try {
+        if (boost::lexical_cast<double>(n["cdt_split_area"].as<std::string>()) < 0) {
+          wentgood = false;
+          std::cerr << "\tOption 'options.cdt_split_area' invalid; must be a positive number or 0.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.cdt_split_area' invalid.\n";
+      }
+    }
+    if (n["fast_triangulation"]) {
+      std::string s = n["fast_triangulation"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.fast_triangulation' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["cdt_validation"]) {
+      std::string s = n["cdt_validation"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.cdt_validation' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["lift_gap_fill"]) {
+      std::string s = n["lift_gap_fill"].as<std::string>();
+      if ((s != "nearest") && (s != "interpolate")) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.lift_gap_fill' invalid; must be 'nearest' or 'interpolate'.\n";
+      }
+    }
+    if (n["tile_size"]) {
+      try {
+        if (boost::lexical_cast<double>(n["tile_size"].as<std::string>()) < 0) {
+          wentgood = false;
+          std::cerr << "\tOption 'options.tile_size' invalid; must be a positive number or 0.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.tile_size' invalid.\n";
+      }
+    }
+    if (n["tile_buffer"]) {
+      try {
+        if (boost::lexical_cast<double>(n["tile_buffer"].as<std::string>()) < 0) {
+          wentgood = false;
+          std::cerr << "\tOption 'options.tile_buffer' invalid; must be a positive number or 0.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'options.tile_buffer' invalid.\n";
+      }
+    }
+    if (n["polygon_cache"] && n["polygon_cache"].as<std::string>().empty()) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.polygon_cache' invalid; must be a file path.\n";
+    }
     if (n["extent"]) {
       std::vector<std::string> extent_split = stringsplit(n["extent"].as<std::string>(), ',');
       double xmin, xmax, ymin, ymax;
@@ -1183,6 +1598,49 @@ bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
       wentgood = false;
       std::cerr << "\tOutput format GDAL needs gdal_driver setting\n";
     }
+    if (n["cityjson_transform"]) {
+      std::string s = n["cityjson_transform"].as<std::string>();
+      if ((s != "true") && (s != "false")) {
+        wentgood = false;
+        std::cerr << "\tOption 'output.cityjson_transform' invalid; must be 'true' or 'false'.\n";
+      }
+    }
+    if (n["obj_tile_size"]) {
+      try {
+        if (boost::lexical_cast<double>(n["obj_tile_size"].as<std::string>()) < 0) {
+          wentgood = false;
+          std::cerr << "\tOption 'output.obj_tile_size' invalid; must be a positive number or 0.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'output.obj_tile_size' invalid.\n";
+      }
+    }
+    if (n["tileset_max_features"]) {
+      try {
+        if (boost::lexical_cast<int>(n["tileset_max_features"].as<std::string>()) < 1) {
+          wentgood = false;
+          std::cerr << "\tOption 'output.tileset_max_features' invalid; must be a positive integer.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'output.tileset_max_features' invalid.\n";
+      }
+    }
+    if (n["tileset_epsg"]) {
+      try {
+        if (boost::lexical_cast<int>(n["tileset_epsg"].as<std::string>()) < 0) {
+          wentgood = false;
+          std::cerr << "\tOption 'output.tileset_epsg' invalid; must be an EPSG code, or 0 for no transform.\n";
+        }
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'output.tileset_epsg' invalid.\n";
+      }
+    }
   }
 
   return wentgood;
@@ -0,0 +1,197 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef __3DFIER__Parallel__
+#define __3DFIER__Parallel__
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-- true in the threads of a pool while they run an item, a loop started from
+//-- there runs serially instead of starting threads * threads threads
+inline bool& in_parallel_worker() {
+  static thread_local bool inside = false;
+  return inside;
+}
+
+//-- marks the current thread as a worker of a pool for its lifetime
+class ParallelWorkerScope {
+public:
+  ParallelWorkerScope() : _previous(in_parallel_worker()) {
+    in_parallel_worker() = true;
+  }
+  ~ParallelWorkerScope() {
+    in_parallel_worker() = _previous;
+  }
+private:
+  bool _previous;
+};
+
+//-- run func(i, threadid) for i in [0, n) on a pool of threads. Work is handed
+//-- out one index at a time through a shared counter, so a thread that finished
+//-- its items steals the next pending one. With threads <= 1, or when called
+//-- from a thread of another pool, the loop runs in the calling thread in index
+//-- order. The first exception thrown by func is rethrown once all threads are
+//-- joined.
+template <typename Func>
+void parallel_for(std::size_t n, int threads, Func func) {
+  if (threads <= 1 || n <= 1 || in_parallel_worker()) {
+    for (std::size_t i = 0; i < n; i++) {
+      func(i, 0);
+    }
+    return;
+  }
+  if (std::size_t(threads) > n) {
+    threads = int(n);
+  }
+  std::atomic<std::size_t> next(0);
+  std::exception_ptr error = nullptr;
+  std::mutex errormutex;
+  auto worker = [&](int threadid) {
+    ParallelWorkerScope scope;
+    std::size_t i;
+    while ((i = next.fetch_add(1)) < n) {
+      try {
+        func(i, threadid);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(errormutex);
+        if (error == nullptr) {
+          error = std::current_exception();
+        }
+        next = n;
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++) {
+    pool.push_back(std::thread(worker, t));
+  }
+  worker(0);
+  for (auto& t : pool) {
+    t.join();
+  }
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+//-- run render(i, threadid) for i in [0, n) on a pool of threads and emit(i)
+//-- in the calling thread in index order, each as soon as render(i) is done.
+//-- An index is only handed out when it is less than window ahead of the next
+//-- one to emit, so at most window results are in memory and render(i) and
+//-- emit(i) can share the slot i % window of the caller. With threads <= 1
+//-- each index is rendered and emitted in turn in the calling thread, as when
+//-- called from a thread of another pool. The
+//-- first exception thrown by render or emit is rethrown once all threads
+//-- are joined.
+template <typename Render, typename Emit>
+void parallel_ordered(std::size_t n, int threads, std::size_t window, Render render, Emit emit) {
+  if (threads <= 1 || n <= 1 || window <= 1 || in_parallel_worker()) {
+    for (std::size_t i = 0; i < n; i++) {
+      render(i, 0);
+      emit(i);
+    }
+    return;
+  }
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::size_t next = 0;
+  std::size_t emitted = 0;
+  std::vector<char> rendered(window, 0);
+  bool stop = false;
+  std::exception_ptr error = nullptr;
+  auto fail = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error == nullptr) {
+      error = std::current_exception();
+    }
+    stop = true;
+    cv.notify_all();
+  };
+  auto worker = [&](int threadid) {
+    ParallelWorkerScope scope;
+    while (true) {
+      std::size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stop || next >= n || next < emitted + window; });
+        if (stop || next >= n) {
+          return;
+        }
+        i = next++;
+      }
+      try {
+        render(i, threadid);
+      }
+      catch (...) {
+        fail();
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      rendered[i % window] = 1;
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++) {
+    pool.push_back(std::thread(worker, t));
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return stop || rendered[i % window] != 0; });
+      if (stop) {
+        break;
+      }
+    }
+    try {
+      emit(i);
+    }
+    catch (...) {
+      fail();
+      break;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    rendered[i % window] = 0;
+    emitted = i + 1;
+    cv.notify_all();
+  }
+  for (auto& t : pool) {
+    t.join();
+  }
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+#endif
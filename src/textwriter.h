@@ -0,0 +1,179 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef __3DFIER__TextWriter__
+#define __3DFIER__TextWriter__
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+//-- a buffered writer of UTF-8 text for the GML outputs. The strings are
+//-- copied as bytes (no codecvt), the buffer goes to the file in large
+//-- writes, and the doubles are written as an ostream would with the same
+//-- std::fixed and std::setprecision(), so the output is unchanged. Without
+//-- a file the text stays in memory and is read with str().
+class TextWriter {
+public:
+  TextWriter() : _file(nullptr) {}
+
+  explicit TextWriter(const std::string& filename) : _file(new std::ofstream(filename)) {
+    _buf.reserve(BUFSIZE);
+  }
+
+  ~TextWriter() {
+    close();
+  }
+
+  bool is_open() const {
+    return _file != nullptr && _file->is_open();
+  }
+
+  void close() {
+    if (_file != nullptr) {
+      flush();
+      delete _file;
+      _file = nullptr;
+    }
+  }
+
+  void flush() {
+    if (_file != nullptr && !_buf.empty()) {
+      _file->write(_buf.data(), _buf.size());
+      _buf.clear();
+    }
+  }
+
+  const std::string& str() const {
+    return _buf;
+  }
+
+  void clear() {
+    _buf.clear();
+  }
+
+  void write(const char* s, std::size_t n) {
+    if (_file != nullptr && _buf.size() + n > BUFSIZE)
+      flush();
+    _buf.append(s, n);
+  }
+
+  TextWriter& operator<<(const std::string& s) {
+    write(s.data(), s.size());
+    return *this;
+  }
+
+  TextWriter& operator<<(const char* s) {
+    write(s, std::strlen(s));
+    return *this;
+  }
+
+  TextWriter& operator<<(char c) {
+    write(&c, 1);
+    return *this;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value, TextWriter&>::type operator<<(T v) {
+    std::string s = std::to_string(v);
+    write(s.data(), s.size());
+    return *this;
+  }
+
+  TextWriter& operator<<(double v) {
+    bool fixed = (_fmt.flags() & std::ios_base::floatfield) == std::ios_base::fixed;
+    int precision = int(_fmt.precision());
+    if (!fixed || !write_fixed(v, precision)) {
+      char buf[512];
+      int n = std::snprintf(buf, sizeof(buf), fixed ? "%.*f" : "%.*g", precision, v);
+      write(buf, std::size_t(n) < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+    return *this;
+  }
+
+  //-- std::setprecision() and std::fixed/std::defaultfloat, kept in a
+  //-- stream that is never written to so they mean what they mean there
+  TextWriter& operator<<(decltype(std::setprecision(0)) m) {
+    _fmt << m;
+    return *this;
+  }
+
+  TextWriter& operator<<(std::ios_base& (*m)(std::ios_base&)) {
+    m(_fmt);
+    return *this;
+  }
+
+private:
+  enum { BUFSIZE = 1 << 20 };
+  std::ofstream*     _file;
+  std::string        _buf;
+  std::ostringstream _fmt;
+
+  //-- "%.*f" from the rounded integer v * 10^precision. Falls back (returns
+  //-- false) when that product is too close to a half for its rounding
+  //-- error, when it is too large and for the negative values that round
+  //-- to 0, so that the result is always the one of printf.
+  bool write_fixed(double v, int precision) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    if (precision < 0 || precision > 9)
+      return false;
+    double scaled = std::fabs(v) * pow10[precision];
+    if (!(scaled < 1e15))
+      return false;
+    double whole = std::floor(scaled);
+    double frac = scaled - whole;
+    if (std::fabs(frac - 0.5) <= (scaled + 1.0) * 1e-15)
+      return false;
+    unsigned long long u = (unsigned long long)whole + (frac > 0.5 ? 1 : 0);
+    if (u == 0 && std::signbit(v))
+      return false;
+    char buf[32];
+    char* p = buf + sizeof(buf);
+    for (int i = 0; i < precision; i++) {
+      *--p = char('0' + u % 10);
+      u /= 10;
+    }
+    if (precision > 0)
+      *--p = '.';
+    do {
+      *--p = char('0' + u % 10);
+      u /= 10;
+    } while (u > 0);
+    if (std::signbit(v))
+      *--p = '-';
+    write(p, buf + sizeof(buf) - p);
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2018  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef __3DFIER__VertexPool__
+#define __3DFIER__VertexPool__
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+//-- the vertices of an output, deduplicated on their quantised coordinates:
+//-- x and y in mm and z in cm, the precision of gen_key_bucket(). The ids
+//-- are given in the order of first use, starting at 0. The lookup is an
+//-- open-addressing table of indices in the vertices, so a vertex costs its
+//-- 3 integers and about 2 slots of 4 bytes.
+class VertexPool {
+public:
+  typedef std::array<long long, 3> Vertex;
+
+  VertexPool() : _table(1024, EMPTY) {}
+
+  unsigned long add(double x, double y, double z) {
+    Vertex v = { { std::llround(x * 1000.0), std::llround(y * 1000.0), std::llround(z * 100.0) } };
+    return add(v);
+  }
+
+  //-- a vertex already quantised, as in the vertices() of another pool. Adding
+  //-- a vertex that is in the pool does not modify it, so threads can share a
+  //-- pool in which all their vertices have been added beforehand.
+  unsigned long add(const Vertex& v) {
+    std::size_t mask = _table.size() - 1;
+    std::size_t i = hash(v) & mask;
+    while (_table[i] != EMPTY) {
+      if (_vertices[_table[i]] == v)
+        return _table[i];
+      i = (i + 1) & mask;
+    }
+    std::uint32_t id = std::uint32_t(_vertices.size());
+    _table[i] = id;
+    _vertices.push_back(v);
+    if (_vertices.size() * 2 > _table.size())
+      grow();
+    return id;
+  }
+
+  const std::vector<Vertex>& vertices() const {
+    return _vertices;
+  }
+
+  std::size_t size() const {
+    return _vertices.size();
+  }
+
+  //-- a small table is kept, pools cleared for every feature stay cheap
+  void clear() {
+    _vertices.clear();
+    if (_table.size() == 1024)
+      std::fill(_table.begin(), _table.end(), std::uint32_t(EMPTY));
+    else
+      std::vector<std::uint32_t>(1024, EMPTY).swap(_table);
+  }
+
+private:
+  enum : std::uint32_t { EMPTY = 0xffffffff };
+  std::vector<Vertex>        _vertices;
+  std::vector<std::uint32_t> _table;
+
+  static std::size_t hash(const Vertex& v) {
+    std::uint64_t h = std::uint64_t(v[0]) * 0x9E3779B97F4A7C15ULL;
+    h ^= std::uint64_t(v[1]) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= std::uint64_t(v[2]) * 0x165667B19E3779F9ULL;
+    return std::size_t(h ^ (h >> 29));
+  }
+
+  void grow() {
+    std::vector<std::uint32_t> table(_table.size() * 2, EMPTY);
+    std::size_t mask = table.size() - 1;
+    for (std::uint32_t id = 0; id < _vertices.size(); id++) {
+      std::size_t i = hash(_vertices[id]) & mask;
+      while (table[i] != EMPTY)
+        i = (i + 1) & mask;
+      table[i] = id;
+    }
+    _table.swap(table);
+  }
+};
+
+//-- writes v / 10^decimals with exactly that many decimals, without going
+//-- through a double so that the quantised values are written as they are
+inline void write_fixed(std::ostream& of, long long v, int decimals) {
+  char buf[32];
+  char* p = buf + sizeof(buf);
+  bool negative = (v < 0);
+  unsigned long long u = negative ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+  for (int i = 0; i < decimals; i++) {
+    *--p = char('0' + u % 10);
+    u /= 10;
+  }
+  if (decimals > 0)
+    *--p = '.';
+  do {
+    *--p = char('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (negative)
+    *--p = '-';
+  of.write(p, buf + sizeof(buf) - p);
+}
+
+#endif
@@ -173,4 +173,118 @@ void polyval3d(std::vector<T>& x, std::vector<T>& y, std::vector<T>& coeff, std:
   A.multiply(Y, AY);
   calculated = AY.data();
 }
+/*
+Least-squares quadric fit of polyfit3d from which points can be removed one at
+a time. The normal equations are downdated with the row of the removed point
+instead of being rebuilt from all the remaining points; fit(coeffs, true)
+rebuilds them in the same order as polyfit3d, which gives the exact same
+coefficients. As in polyfit3d the x and y values are relative to the first
+remaining point.
+*/
+template<typename T>
+class polyfit3d_downdate {
+public:
+  polyfit3d_downdate(const std::vector<T>& oX, const std::vector<T>& oY, const std::vector<T>& oZ)
+    : m_oX(oX), m_oY(oY), m_oZ(oZ), m_oRemoved(oX.size(), false), m_nFirst(0), m_nCount(oX.size()),
+      m_oATA(6, 6), m_oATZ(6, 1), m_bNormalize(true), m_bExact(false) {
+    if (oX.size() != oY.size() || oX.size() != oZ.size())
+      throw std::invalid_argument("X and Y or X and Z vector sizes do not match");
+  }
+
+  size_t size() {
+    return m_nCount;
+  }
+
+  size_t first() {
+    return m_nFirst;
+  }
+
+  bool removed(size_t i) {
+    return m_oRemoved[i];
+  }
+
+  void remove(size_t i) {
+    if (m_bNormalize == false) {
+      T a[6];
+      row(i, a);
+      for (int r = 0; r < 6; r++) {
+        for (int c = 0; c < 6; c++)
+          m_oATA(r, c) -= a[r] * a[c];
+        m_oATZ(r, 0) -= a[r] * m_oZ[i];
+      }
+    }
+    m_oRemoved[i] = true;
+    m_nCount--;
+    if (i == m_nFirst) {
+      while (m_nFirst < m_oX.size() && m_oRemoved[m_nFirst])
+        m_nFirst++;
+      m_bNormalize = true;
+    }
+    m_bExact = false;
+  }
+
+  void fit(std::vector<T>& coeffs, bool exact) {
+    if (m_bNormalize) {
+      //-- new first point, shift the frame as combineXY does
+      for (size_t i = m_nFirst + 1; i < m_oX.size(); i++) {
+        if (m_oRemoved[i] == false) {
+          m_oX[i] = m_oX[i] - m_oX[m_nFirst];
+          m_oY[i] = m_oY[i] - m_oY[m_nFirst];
+        }
+      }
+      m_oX[m_nFirst] = 0;
+      m_oY[m_nFirst] = 0;
+      m_bNormalize = false;
+      exact = true;
+    }
+    if (exact && m_bExact == false) {
+      m_oATA = mathalgo::matrix<T>(6, 6);
+      m_oATZ = mathalgo::matrix<T>(6, 1);
+      T a[6];
+      for (size_t i = 0; i < m_oX.size(); i++) {
+        if (m_oRemoved[i])
+          continue;
+        row(i, a);
+        for (int r = 0; r < 6; r++) {
+          for (int c = 0; c < 6; c++)
+            m_oATA(r, c) += a[r] * a[c];
+          m_oATZ(r, 0) += a[r] * m_oZ[i];
+        }
+      }
+      m_bExact = true;
+    }
+    mathalgo::Givens<T> oGivens;
+    oGivens.Decompose(m_oATA);
+    mathalgo::matrix<T> Y;
+    oGivens.Solve(m_oATZ, Y);
+    coeffs = Y.data();
+  }
+
+  //-- fitted value at point i, computed as the product A*Y of polyfit3d
+  T value(const std::vector<T>& coeffs, size_t i) {
+    T a[6];
+    row(i, a);
+    T v = 0;
+    for (int c = 0; c < 6; c++)
+      v += a[c] * coeffs[c];
+    return v;
+  }
+
+private:
+  void row(size_t i, T* a) {
+    a[0] = 1;
+    a[1] = m_oX[i];
+    a[2] = m_oY[i];
+    a[3] = m_oX[i] * m_oY[i];
+    a[4] = std::pow(m_oX[i], 2);
+    a[5] = std::pow(m_oY[i], 2);
+  }
+
+  std::vector<T> m_oX, m_oY, m_oZ;
+  std::vector<bool> m_oRemoved;
+  size_t m_nFirst, m_nCount;
+  mathalgo::matrix<T> m_oATA, m_oATZ;
+  bool m_bNormalize, m_bExact;
+};
+
 #endif
\ No newline at end of file